@@ -3,19 +3,42 @@
  * @brief M5Cardputer Mic Web Server & Audio Visualizer
  * * WHAT THIS SKETCH DOES:
  * 1. Records audio from the built-in microphone into a circular buffer.
- * 2. Displays a real-time audio waveform on the Cardputer screen.
+ * 2. Displays a real-time audio waveform, VU meter or spectrum on the Cardputer screen ('v').
  * 3. Connects to WiFi (SD Card config first, then Hardcoded fallback).
  * 4. Serves two different Web Apps:
  * - Root (/): The sophisticated "Audio Console" (VU Meter Dashboard).
  * - Spectrum (/sv): A frequency spectrum analyzer.
  * 5. Provides an API endpoint (/data) that serves raw audio samples as JSON.
+ * - /loudness: EBU R128 loudness (Momentary/Short-Term/Integrated LUFS) and true peak.
+ * - /tones: Goertzel tone detectors (alarms/beacons) loaded from /tones.txt on SD.
+ * - /pitch: YIN fundamental frequency (f0) + confidence for every hop.
+ * - /status: VAD state and bytes saved by sending heartbeats while silent.
+ * - /agc: Automatic gain control settings; /data reports the gain applied to each chunk.
+ * - /filter: Capture filter (DC blocker, high-pass, FIR mic EQ from /mic_eq.txt).
+ * - /scope + /scopedata: Triggered oscilloscope page and its min/max frame API.
+ * - /envelope: Min/max/RMS of any stretch of recent history at any width (envelope pyramid).
+ * - /rec: Continuous WAV recording to SD (/rec/REC_xxxxx.wav segments) with writer stats.
+ * - /event: Pre-trigger event capture to SD (level, tone, key or HTTP trigger).
+ * - /capture.wav: The last seconds of the RAM ring as a WAV download (streamed from loop()).
+ * - /render: Screen frame rate target ("?fps=") and render time / dropped frame counters.
+ * - /metrics: Prometheus scrape (requests/bytes per endpoint, clients, chunk health, memory, RSSI, battery, stages).
+ * - /metrics.json: p50/p95/p99/max time per loop stage (capture, DSP, draw, network, input, SD); /metrics/reset.
+ * - /trace.json: Chrome trace of the last ~1000 hot-path events (build with MICTALK_TRACE 1).
  * 6. Button A Logic:
  * - HOLD: Adjusts the microphone noise filter level.
  * - CLICK: Stops recording and plays back the last ~3 seconds of audio.
  * 7. Keyboard Logic:
- * - UP (';'): Increases Scaling Factor (SF) sent to clients.
- * - DOWN ('.'): Decreases Scaling Factor (SF).
- * - 'q': Displays CPU Load % and Loop Time (ms).
+ * - UP (';'): Increases Scaling Factor (SF) sent to clients (switches AGC off).
+ * - DOWN ('.'): Decreases Scaling Factor (SF) (switches AGC off).
+ * - 'a': Turns Automatic Gain Control (AGC) back on.
+ * - 't': Cycles the scope trigger (OFF/AUTO/NORM/SINGLE), 'e' flips the edge,
+ *   '-' / '=' move the level, 'h' steps the holdoff, LEFT (',') / RIGHT ('/') change the timebase,
+ *   ENTER re-arms SINGLE.
+ * - 'r': Starts / stops continuous recording to the SD card.
+ * - 'm': Marks an event (saves the seconds before and after it to SD).
+ * - 'v': Cycles the screen view (WAVE / VU / SPECTRUM).
+ * - 'p': Displays the p95 time (us) of each loop stage.
+ * - 'q': Displays CPU Load % and Loop Time (ms), plus screen FPS, SPI transfer time and draw time per view.
  * 8. Displays Host ID, Battery %, and feedback for NF/SF changes.
  * * @note Includes separate headers for VU Meter (webapp.h) and Spectrum (spectrum.h)
  */
@@ -24,8 +47,37 @@
 #include <WiFi.h>
 #include <WebServer.h>
 #include <SD.h> // Added for SD Card support
+// Hot-path event trace for /trace.json (Perfetto / chrome://tracing). 0 compiles every TRACE_* out.
+#define MICTALK_TRACE 0
+#include "trace.h"
 #include "webapp.h"   // VU Meter (Root)
 #include "spectrum.h" // Spectrum Analyzer (/sv)
+#include "scope.h"    // Triggered Oscilloscope (/scope)
+#include "capture_filter.h" // DC Blocker / High-Pass / Mic EQ (/filter)
+#include "loudness.h" // EBU R128 Loudness Meter (/loudness)
+#include "tones.h"    // Goertzel Tone Detectors (/tones)
+#include "pitch.h"    // YIN Pitch Tracker (/pitch)
+#include "vad.h"      // Voice Activity Detector (silence gating)
+#include "agc.h"      // Automatic Gain Control (/agc)
+#include "trigger.h"  // Scope Trigger + Timebase (screen and /scopedata)
+#include "envelope.h" // Min/Max/RMS History Pyramid (/envelope, long timebases)
+#include "sd_recorder.h" // Continuous WAV Recording to SD (/rec)
+// Compressed history: the raw ring below keeps the newest ~0.9 s for the screen, scope and /data,
+// older chunks move into an IMA ADPCM tier (124 bytes per chunk). In the RAM the 256-chunk raw
+// ring used (~3.6 s) it holds ~11 s for /capture.wav, event pre-trigger and playback.
+// Set to 0 (and record_number back to 256) for the raw ring alone.
+#define HISTORY_ADPCM_CHUNKS 727
+#include "history.h" // Chunk History + ADPCM Tier
+#include "event_recorder.h" // Pre-Trigger Event Capture to SD (/event)
+#include "ring_stream.h" // WAV Download of the RAM Ring (/capture.wav)
+#include "playback.h" // Non-Blocking History Playback (BtnA)
+#include "wifi_boot.h" // Async WiFi from a Cached AP + Boot Timing (/boot)
+#include "sd_archive.h" // Time-Indexed SD Archive (/archive)
+#include "render_task.h" // Screen on its Own Task, Paced (/render)
+#include "viz.h"      // Fixed-Point Spectrum / VU + Bar Renderers (shared with the Tab5)
+#include "profiler.h" // Per-Stage Timing Histograms (/metrics)
+#include "metrics.h" // Prometheus /metrics (HTTP, audio, memory health)
+#include "alloc_stats.h" // Allocation Rate + Largest Free Block (/metrics)
 
 // --- WI-FI SETTINGS (FALLBACK) ---
 String wifi_ssid = "SSID_HERE";
@@ -34,14 +86,12 @@ String wifi_pass = "WIFI_PASSWORD_HERE";
 // --- UI SETTINGS ---
 const int ui_x_pos = 150; // X position for REC/Battery info (120=Center, 150=Right)
 
-WebServer server(80);
+MetricsServer server(80); // WebServer that counts requests, bytes and latency (metrics.h)
 
-static constexpr const size_t record_number     = 256;
+static constexpr const size_t record_number     = HISTORY_ADPCM_CHUNKS ? 68 : 256; // 68: room for the 64x scope timebase
 static constexpr const size_t record_length     = 240;
 static constexpr const size_t record_size       = record_number * record_length;
 static constexpr const size_t record_samplerate = 17000;
-static int16_t prev_y[record_length];
-static int16_t prev_h[record_length];
 static size_t rec_record_idx  = 2;
 static size_t draw_record_idx = 0;
 static int16_t *rec_data;
@@ -49,11 +99,214 @@ static int16_t *rec_data;
 // --- SCALING FACTOR SETTINGS ---
 const int scale_factors[] = {1, 2, 4, 6, 8, 12};
 int scale_idx = 0; // Default to index 0 (1x)
+bool agc_enabled = true; // AGC levels the signal; ';' / '.' switch to manual SF, 'a' back to AGC
+
+// Gain the VU / spectrum views still have to apply (AGC output is already levelled)
+int currentScale() { return agc_enabled ? 1 : scale_factors[scale_idx]; }
 
 // --- PERFORMANCE MONITORING ---
 unsigned long max_loop_time = 0;
 unsigned long loop_start_time = 0;
 
+// --- AUDIO ANALYSIS ---
+CaptureFilter micFilter;
+LoudnessMeter loudness;
+ToneBank tones;
+PitchTracker pitch;
+VoiceActivityDetector vad;
+AutoGain agc;
+EnvelopePyramid envelope;
+SdRecorder sdrec;
+EventRecorder events;
+ChunkHistory history;
+RingStream ringStream;
+HistoryPlayer player;
+ArchiveStream archive;
+bool sd_ready = false; // SD card mounted in loadConfig()
+BootTimeline boot;     // Boot phase timing (/boot)
+WifiBoot wifiBoot;     // Connects in the background from loop()
+
+// --- SCOPE TRIGGER ---
+ScopeTrigger scope;     // On-screen waveform
+ScopeTrigger web_scope; // /scopedata (clients send their settings with every request)
+static int16_t scope_min[record_length];
+static int16_t scope_max[record_length];
+static constexpr size_t scope_history = (record_number - 3) * record_length; // Chunks the mic is not writing to
+const uint16_t scope_timebases[] = {1, 2, 4, 8, 16, 32, 64, 256, 1024, 4096}; // Samples per column
+const int scope_timebase_count = sizeof(scope_timebases) / sizeof(scope_timebases[0]);
+static constexpr uint16_t scope_max_raw_spp = 64; // Longer timebases roll from the envelope pyramid
+int timebase_idx = 0;
+const uint16_t scope_holdoffs_ms[] = {0, 1, 5, 20, 100}; // On-device holdoff steps (/scopedata takes any value)
+const int scope_holdoff_count = sizeof(scope_holdoffs_ms) / sizeof(scope_holdoffs_ms[0]);
+int holdoff_idx = 0;
+
+// --- CHUNK TAGS & SILENCE GATING ---
+static constexpr uint8_t CHUNK_ACTIVE = 0x01; // VAD heard sound in this chunk
+static constexpr uint8_t CHUNK_GAP    = 0x02; // First chunk after the mic paused (playback)
+static constexpr uint8_t CHUNK_READ   = 0x04; // Served by /data at least once
+static uint8_t rec_flags[record_number];      // Per-chunk tags, parallel to rec_data
+static uint16_t rec_gain[record_number];      // Gain applied to each chunk (Q8, 256 = 1.0x)
+static bool mic_resumed = false;              // Set when playback hands the mic back
+static size_t ready_record_idx = 0;           // Newest chunk that is fully recorded and processed
+static uint32_t chunk_seq = 0;                // Sequence number of that chunk (counts from 1)
+std::atomic<uint32_t> chunks_dropped{0};      // Chunks missing from the stream (timing gaps, estimate)
+std::atomic<uint32_t> chunks_unread{0};       // Overwritten in the ring before /data served them
+uint32_t last_data_ms = 0;                    // Last /data request (unread chunks only count while polled)
+uint32_t net_full_replies = 0;
+uint32_t net_heartbeats = 0;
+uint32_t net_bytes_sent = 0;
+uint32_t net_bytes_saved = 0;
+uint32_t last_full_len = record_length * 6;   // Size of the last full /data reply (estimate until one is sent)
+
+// --- SCREEN ---
+// The screen belongs to the render task (render_task.h): it wakes at render_fps, draws the newest
+// chunk and goes back to sleep, so capture never waits on the display. loop() only changes the
+// state below (under renderer.lock()) and the next frame picks it up.
+// The waveform is drawn into an off-screen band (everything below the header) and sent in one
+// DMA transfer; capture, processing and the web server carry on on the other core while it goes
+// out. The band is only rewritten after the transfer has finished, so a frame never shows half
+// drawn. The header (REC dot, label, tone squares) is redrawn only when it changes.
+static constexpr int band_y = 25;  // Below the header
+static constexpr int band_h = 110; // 240 x 110 x 16 bpp = 52.8 KB of DMA-capable RAM
+static constexpr uint16_t render_fps = 30; // Default target; /render?fps= changes it
+RenderTask renderer;
+M5Canvas band;
+bool band_ok = false;              // Canvas allocated (else the waveform is skipped)
+bool screen_clear = false;         // Wipe the whole screen on the next frame
+bool header_dirty = true;          // Header needs a redraw (screen cleared, dot colour expired...)
+char status_text[96] = "";         // Feedback line (SF/NF/trigger/CPU) at the top of the band
+uint16_t status_dot = RED;         // REC dot colour while the feedback is up
+unsigned long status_until = 0;    // millis() the feedback expires
+float spi_ms = 0;                  // Last band transfer, start to completion
+int bat_level = 0;                 // Read by loop() (I2C stays on one task), shown by the header
+
+// Views ('v'): the band shows the scope, a peak/average meter or a 32-bar spectrum of the newest chunk
+int visualMode = 0;
+const char *modeNames[] = {"WAVE", "VU", "SPECTRUM"};
+const int modeCount = sizeof(modeNames) / sizeof(modeNames[0]);
+static constexpr int spec_bars = 32;   // 4 bins each, 7 px wide
+VizSpectrum spectrum;
+uint32_t mode_us[modeCount] = {};      // Draw time per view (analysis + band), smoothed; shown by 'q'
+
+// Sample clock: samples processed since boot (chunk_seq chunks)
+uint64_t sampleClock() { return (uint64_t)chunk_seq * record_length; }
+
+StageProfiler profiler; // Stage timings: loop() records all but draw, the render task records draw
+
+// --- CAPTURE PROCESSING ---
+// Runs once on every chunk the mic has finished filling, before anything draws or serves it.
+void processChunk(int16_t *data) {
+    TRACE_SCOPE("dsp");
+    // Clean-up first, written back into the ring, so every consumer below shares it
+    micFilter.process(data, record_length);
+
+    loudness.process(data, record_length);
+    uint16_t tone_onsets = tones.process(data, record_length, millis());
+    pitch.process(data, record_length);
+
+    // Stream health for /metrics: gaps between chunks (not the playback pause), and whether the
+    // chunk this one overwrites ever reached a /data client
+    static uint32_t last_chunk_us = 0;
+    const uint32_t period_us = record_length * 1000000UL / record_samplerate;
+    uint32_t now_us = micros();
+    if (last_chunk_us && !mic_resumed && now_us - last_chunk_us > 2 * period_us)
+        chunks_dropped.fetch_add((now_us - last_chunk_us) / period_us - 1, std::memory_order_relaxed);
+    last_chunk_us = now_us;
+    if (chunk_seq >= record_number && !(rec_flags[draw_record_idx] & CHUNK_READ) && millis() - last_data_ms < 2000)
+        chunks_unread.fetch_add(1, std::memory_order_relaxed);
+
+    rec_flags[draw_record_idx] = vad.process(data, record_length) ? CHUNK_ACTIVE : 0;
+    if (mic_resumed) { // Samples before this one are from before the pause: say so in /data
+        rec_flags[draw_record_idx] |= CHUNK_GAP;
+        mic_resumed = false;
+    }
+
+    // AGC runs last: the analysis above sees the raw mic, everything downstream the levelled signal.
+    // In manual mode the SF is applied later (display / /data), so report it as the chunk gain.
+    if (agc_enabled) rec_gain[draw_record_idx] = agc.process(data, record_length) >> 8;
+    else rec_gain[draw_record_idx] = scale_factors[scale_idx] << 8;
+    envelope.push(data, record_length); // History pyramid gets exactly what the ring holds
+    sdrec.push(data, record_length, sampleClock()); // memcpy into the SD double buffer, never waits on the card
+    ready_record_idx = draw_record_idx;
+    chunk_seq++;
+    TRACE_INSTANT("chunk", chunk_seq);
+    if (chunk_seq == 1) boot.mark("first_chunk");
+    history.push(chunk_seq);             // Compresses the chunk leaving the raw window (if the tier is on)
+    events.process(data, record_length); // Advances the event clock, checks the level trigger
+    if (tone_onsets & events.cfg.tone_mask) events.trigger(EVT_TONE);
+}
+
+// Min/max/mean-square of samples [s0, s1): raw ring below 16 samples per pixel, else a pyramid level.
+// now is the sample clock of the caller's one chunk_seq snapshot; the raw ring is read relative to it.
+bool historySpan(int level, uint64_t now, uint64_t s0, uint64_t s1, EnvBin &out) {
+    if (level >= 0) return envelope.span(level, s0, s1, out);
+
+    uint64_t oldest = (now > scope_history) ? now - scope_history : 0;
+    if (s0 < oldest) s0 = oldest;
+    if (s1 > now) s1 = now;
+    if (s0 >= s1) return false;
+
+    size_t newest = ((now / record_length) % record_number) * record_length; // One past the chunk ending at now
+    size_t pos = (newest + record_size - (size_t)(now - s0)) % record_size;
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    uint64_t sum = 0;
+    for (uint64_t s = s0; s < s1; s++) {
+        int32_t v = rec_data[pos];
+        if (v < mn) mn = v;
+        if (v > mx) mx = v;
+        sum += (uint64_t)(v * v);
+        if (++pos >= record_size) pos = 0;
+    }
+    out.mn = mn;
+    out.mx = mx;
+    out.ms = (uint32_t)(sum / (s1 - s0));
+    return true;
+}
+
+// Level for a view at spp samples per pixel starting at sample s0: the coarsest with a bin per pixel
+// or less (-1: raw ring), moved up to the finest whose reach still includes s0
+int historyLevel(uint64_t spp, uint64_t now, uint64_t s0) {
+    int level = EnvelopePyramid::levelFor(spp);
+    if (level < 0 && s0 >= ((now > scope_history) ? now - scope_history : 0)) return -1;
+    return envelope.covering(level < 0 ? 0 : level, s0);
+}
+
+// Runs a trigger search over the ring, ending at the newest processed chunk.
+// Timebases beyond the raw ring's reach roll (untriggered) from the envelope pyramid instead.
+bool scopeCapture(ScopeTrigger &trig, int cols, int16_t *mins, int16_t *maxs) {
+    uint32_t seq = chunk_seq; // One read: the render task runs this while capture moves on
+    if (trig.cfg.spp > scope_max_raw_spp) {
+        uint64_t now = (uint64_t)seq * record_length; // The pyramid already holds this much (pushed first)
+        uint64_t spp = trig.cfg.spp;
+        uint64_t span = (uint64_t)cols * spp;
+        int level = historyLevel(spp, now, now > span ? now - span : 0);
+        for (int c = 0; c < cols; c++) {
+            uint64_t back = (uint64_t)(cols - c) * spp;
+            EnvBin b;
+            if (back <= now && historySpan(level, now, now - back, now - back + spp, b)) {
+                mins[c] = b.mn;
+                maxs[c] = b.mx;
+            } else {
+                mins[c] = maxs[c] = 0;
+            }
+        }
+        return true;
+    }
+    size_t newest = (seq % record_number) * record_length; // Chunk seq sits at (seq - 1) % record_number
+    return trig.capture(rec_data, record_size, newest, (uint64_t)seq * record_length, scope_history,
+                        cols, mins, maxs);
+}
+
+// Small lit/unlit squares (2 rows of 8) left of the REC dot, one per configured tone
+void drawToneIndicators() {
+    uint16_t mask = tones.activeMask();
+    for (int i = 0; i < tones.size(); i++) {
+        int x = 2 + (i & 7) * 6;
+        int y = 4 + (i >> 3) * 7;
+        M5Cardputer.Display.fillRect(x, y, 5, 5, (mask & (1u << i)) ? ORANGE : DARKGREY);
+    }
+}
+
 // --- WEB SERVER HANDLERS ---
 
 void handleRoot() {
@@ -64,31 +317,555 @@ void handleSpectrum() {
     server.send(200, "text/html", spectrum_html);
 }
 
+void handleScope() {
+    server.send(200, "text/html", scope_html);
+}
+
+// Triggered scope frame: "?cols=<n>&mode=0-3&edge=0|1&level=<raw>&holdoff=<ms>&tb=<samples/col>&arm=1"
+// Each column is the min/max of tb samples, "pre" is the trigger column.
+// No min/max in the reply means NORMAL/SINGLE is still waiting: keep showing the last frame.
+void handleScopeData() {
+    server.enableCORS(true);
+    static constexpr int max_cols = 512;
+    static int16_t mins[max_cols], maxs[max_cols];
+    int current_scale = agc_enabled ? 1 : scale_factors[scale_idx];
+
+    int cols = server.hasArg("cols") ? server.arg("cols").toInt() : record_length;
+    cols = constrain(cols, 16, max_cols);
+    TriggerConfig &c = web_scope.cfg;
+    if (server.hasArg("mode")) c.mode = (TriggerMode)constrain(server.arg("mode").toInt(), TRIG_OFF, TRIG_SINGLE);
+    if (server.hasArg("edge")) c.edge = server.arg("edge").toInt() ? EDGE_FALLING : EDGE_RISING;
+    if (server.hasArg("level")) c.level = constrain(server.arg("level").toInt() / current_scale, -32767, 32767);
+    if (server.hasArg("holdoff")) c.holdoff = server.arg("holdoff").toInt() * record_samplerate / 1000;
+    if (server.hasArg("tb")) c.spp = constrain(server.arg("tb").toInt(), 1, 4096);
+    if (server.hasArg("arm")) web_scope.arm();
+
+    static char json[max_cols * 2 * 7 + 128];
+    int len = snprintf(json, sizeof(json), "{\"seq\":%lu,\"mode\":\"%s\"",
+                       (unsigned long)chunk_seq, triggerModeNames[c.mode]);
+    if (scopeCapture(web_scope, cols, mins, maxs)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"trig\":%d,\"spp\":%u,\"fs\":%u,\"pre\":%d,\"min\":[",
+                        web_scope.triggered() ? 1 : 0, c.spp, (unsigned)record_samplerate,
+                        cols / ScopeTrigger::kPreDivisor);
+        for (int i = 0; i < cols; i++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s%ld", i ? "," : "",
+                            constrain((long)mins[i] * current_scale, -32768L, 32767L));
+        }
+        len += snprintf(json + len, sizeof(json) - len, "],\"max\":[");
+        for (int i = 0; i < cols; i++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s%ld", i ? "," : "",
+                            constrain((long)maxs[i] * current_scale, -32768L, 32767L));
+        }
+        len += snprintf(json + len, sizeof(json) - len, "]");
+    }
+    snprintf(json + len, sizeof(json) - len, "}");
+    server.send(200, "application/json", json);
+}
+
+// History envelope: "?from=<sample>&to=<sample>&width=<px>" on the sample clock reported as "now"
+// ("?last=<s>" instead of from/to = the newest s seconds, default 10). Replies one [min,max,rms]
+// per pixel (null where the history no longer reaches) in O(width), whatever the range.
+void handleEnvelope() {
+    server.enableCORS(true);
+    int current_scale = agc_enabled ? 1 : scale_factors[scale_idx];
+    uint64_t now = envelope.samples();
+    uint64_t to = server.hasArg("to") ? strtoull(server.arg("to").c_str(), nullptr, 10) : now;
+    if (to > now) to = now;
+    uint64_t last = (uint64_t)record_samplerate * (server.hasArg("last") ? server.arg("last").toInt() : 10);
+    uint64_t from = server.hasArg("from") ? strtoull(server.arg("from").c_str(), nullptr, 10)
+                                          : (to > last ? to - last : 0);
+    if (from >= to) from = (to > 0) ? to - 1 : 0;
+    int width = server.hasArg("width") ? server.arg("width").toInt() : 512;
+    width = constrain(width, 1, 2048);
+
+    uint64_t range = to - from;
+    int level = historyLevel(range / width, now, from);
+
+    // Streamed in pieces: up to 2048 triples would not fit a static reply buffer
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/json", "");
+    char buf[1024];
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"now\":%llu,\"pyramid\":%d,\"fs\":%u,\"from\":%llu,\"to\":%llu,\"bin\":%lu,\"oldest\":%llu,\"px\":[",
+                       (unsigned long long)now, envelope.enabled() ? 1 : 0, (unsigned)record_samplerate, (unsigned long long)from,
+                       (unsigned long long)to, (unsigned long)(level >= 0 ? EnvelopePyramid::factor(level) : 1),
+                       (unsigned long long)(level >= 0 ? envelope.oldest(level)
+                                                       : (now > scope_history ? now - scope_history : 0)));
+    for (int p = 0; p < width; p++) {
+        uint64_t s0 = from + range * p / width;
+        uint64_t s1 = from + range * (p + 1) / width;
+        if (s1 <= s0) s1 = s0 + 1;
+        EnvBin b;
+        if (historySpan(level, now, s0, s1, b)) {
+            len += snprintf(buf + len, sizeof(buf) - len, "%s[%ld,%ld,%ld]", p ? "," : "",
+                            constrain((long)b.mn * current_scale, -32768L, 32767L),
+                            constrain((long)b.mx * current_scale, -32768L, 32767L),
+                            constrain((long)(sqrtf((float)b.ms) * current_scale), 0L, 32767L));
+        } else {
+            len += snprintf(buf + len, sizeof(buf) - len, "%snull", p ? "," : "");
+        }
+        if (len > (int)sizeof(buf) - 64) {
+            server.sendContent(buf, len);
+            len = 0;
+        }
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "]}");
+    server.sendContent(buf, len);
+    server.sendContent("");
+}
+
+// SD recorder: "?start=1" / "?stop=1", replies with the current file and writer health
+// (write latency per block, and the smallest headroom left before a buffer would have been dropped)
+void handleRec() {
+    server.enableCORS(true);
+    if (server.hasArg("start") && sd_ready) sdrec.start();
+    if (server.hasArg("stop")) sdrec.stop();
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"sd\":%d,\"on\":%d,\"file\":\"%s\",\"segment\":%lu,\"seconds\":%.1f,\"blocks\":%lu,"
+             "\"bytes\":%llu,\"write_ms\":{\"avg\":%.1f,\"max\":%.1f},\"buffer_ms\":%.0f,"
+             "\"headroom_ms\":%.1f,\"dropped\":%lu}",
+             sd_ready ? 1 : 0, sdrec.isRecording() ? 1 : 0, sdrec.currentFile(), (unsigned long)sdrec.segment(),
+             sdrec.segmentSeconds(), (unsigned long)sdrec.blocksWritten(), (unsigned long long)sdrec.bytesWritten(),
+             sdrec.avgWriteMs(), sdrec.maxWriteMs(), sdrec.bufferMs(), sdrec.minHeadroomMs(),
+             (unsigned long)sdrec.droppedSamples());
+    server.send(200, "application/json", json);
+}
+
+// Event capture: "?trigger=1" marks an event now; "?pre=<s>&post=<s>" set the window,
+// "?level=<dBFS peak, 0 = off>" and "?tones=<bit mask>" the automatic triggers.
+void handleEvent() {
+    server.enableCORS(true);
+    EventConfig &c = events.cfg;
+    if (server.hasArg("pre"))    c.pre_s = constrain(server.arg("pre").toFloat(), 0.0f, events.maxPreSeconds());
+    if (server.hasArg("post"))   c.post_s = constrain(server.arg("post").toFloat(), 0.0f, EventRecorder::kMaxEventSeconds);
+    if (server.hasArg("level"))  c.level_dbfs = server.arg("level").toFloat();
+    if (server.hasArg("tones"))  c.tone_mask = (uint16_t)server.arg("tones").toInt();
+    bool queued = server.hasArg("trigger") && sd_ready && events.trigger(EVT_HTTP);
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"sd\":%d,\"queued\":%d,\"pre\":%.1f,\"max_pre\":%.1f,\"post\":%.1f,\"level\":%.1f,\"tones\":%u,"
+             "\"events\":%lu,\"writing\":%d,\"file\":\"%s\",\"lost\":%lu,\"missed\":%lu,\"headroom_ms\":%.0f}",
+             sd_ready ? 1 : 0, queued ? 1 : 0, c.pre_s, events.maxPreSeconds(), c.post_s, c.level_dbfs,
+             c.tone_mask, (unsigned long)events.events(), events.isWriting() ? 1 : 0, events.lastFile(),
+             (unsigned long)events.lostSamples(), (unsigned long)events.missedTriggers(), events.minHeadroomMs());
+    server.send(200, "application/json", json);
+}
+
+// WAV download of the RAM ring, oldest first: "?seconds=<s>" (default: all there is), "?freeze=1"
+// keeps the mic from recording over the requested span until it is sent (allows the full ring).
+// Samples are sent as stored (after AGC, before the manual SF); the transfer runs from loop().
+void handleCaptureWav() {
+    if (ringStream.active()) {
+        server.send(503, "text/plain", "Busy: one capture download at a time");
+        return;
+    }
+    bool freeze = server.hasArg("freeze") && server.arg("freeze").toInt() != 0;
+    uint64_t now = sampleClock();
+    uint64_t want = ringStream.maxSamples(freeze);
+    if (server.hasArg("seconds")) {
+        uint64_t s = (uint64_t)(server.arg("seconds").toFloat() * record_samplerate);
+        if (s > 0 && s < want) want = s;
+    }
+    if (want > now) want = now;
+    if (!ringStream.start(server.client(), now - want, now, freeze, "capture.wav")) {
+        server.send(503, "text/plain", "Nothing recorded yet");
+    }
+}
+
+// SD archive: no arguments -> JSON with the extent of the index on the archive clock ("now" is
+// the live position); "?from=<t>&to=<t>" -> WAV of that span (unrecorded holes as silence),
+// seekable with HTTP Range, so only the bytes a player asks for are read. The transfer runs
+// from loop(). "to" defaults to the end of the archive, "from" to one minute before "to".
+void handleArchive() {
+    server.enableCORS(true);
+    uint64_t first = 0, last = 0;
+    bool any = sd_ready && archive.extent(first, last);
+    if (!server.hasArg("from") && !server.hasArg("to")) {
+        char json[256];
+        snprintf(json, sizeof(json),
+                 "{\"sd\":%d,\"now\":%llu,\"fs\":%u,\"first\":%llu,\"end\":%llu,\"entries\":%lu,\"recording\":%d,"
+                 "\"busy\":%d,\"read_ms_max\":%lu}",
+                 sd_ready ? 1 : 0, (unsigned long long)sdrec.archiveTime(sampleClock()), (unsigned)record_samplerate,
+                 (unsigned long long)first, (unsigned long long)last, (unsigned long)archive.entries(),
+                 sdrec.isRecording() ? 1 : 0, archive.active() ? 1 : 0, (unsigned long)archive.maxReadMs());
+        server.send(200, "application/json", json);
+        return;
+    }
+    if (!any) {
+        server.send(404, "text/plain", "Archive is empty");
+        return;
+    }
+    if (archive.active()) {
+        server.send(503, "text/plain", "Busy: one archive download at a time");
+        return;
+    }
+
+    static constexpr uint64_t max_span = (UINT32_MAX - kWavHeaderBytes) / sizeof(int16_t); // WAV sizes are 32-bit
+    uint64_t to = server.hasArg("to") ? strtoull(server.arg("to").c_str(), nullptr, 10) : last;
+    uint64_t from = server.hasArg("from") ? strtoull(server.arg("from").c_str(), nullptr, 10)
+                                          : (to > 60 * record_samplerate ? to - 60 * record_samplerate : 0);
+    if (to <= from) {
+        server.send(400, "text/plain", "Empty span");
+        return;
+    }
+    if (to - from > max_span) to = from + max_span;
+
+    // "Range: bytes=a-b", "bytes=a-" or "bytes=-n" on the WAV file (header included)
+    uint64_t total = ArchiveStream::fileBytes(to - from);
+    uint64_t r0 = 0, r1 = total - 1;
+    bool partial = false;
+    String range = server.header("Range");
+    if (range.startsWith("bytes=")) {
+        const char *spec = range.c_str() + 6;
+        char *rest;
+        if (*spec == '-') {
+            uint64_t n = strtoull(spec + 1, nullptr, 10);
+            r0 = (n < total) ? total - n : 0;
+        } else {
+            r0 = strtoull(spec, &rest, 10);
+            if (*rest == '-' && rest[1]) r1 = strtoull(rest + 1, nullptr, 10);
+        }
+        if (r1 >= total) r1 = total - 1;
+        if (r0 > r1) {
+            char cr[48];
+            snprintf(cr, sizeof(cr), "bytes */%llu", (unsigned long long)total);
+            server.sendHeader("Content-Range", cr);
+            server.send(416, "text/plain", "Range not satisfiable");
+            return;
+        }
+        partial = true;
+    }
+    if (!archive.start(server.client(), from, to, partial, r0, r1)) {
+        server.send(500, "text/plain", "Cannot open the archive index");
+    }
+}
+
+// Boot timing and WiFi cache: per-phase breakdown (ms since power-on / since the previous phase)
+// and how WiFi came up. "?static=1|0" reuses the last lease as a static IP from the next boot,
+// "?forget=1" drops the cached AP so the next boot scans.
+void handleBoot() {
+    server.enableCORS(true);
+    if (server.hasArg("static")) wifiBoot.setStaticIp(server.arg("static").toInt() != 0);
+    if (server.hasArg("forget")) wifiBoot.forget();
+
+    char json[768];
+    int len = snprintf(json, sizeof(json), "{\"phases\":");
+    len += boot.json(json + len, sizeof(json) - len);
+    len += snprintf(json + len, sizeof(json) - len, ",\"wifi\":");
+    len += wifiBoot.json(json + len, sizeof(json) - len);
+    snprintf(json + len, sizeof(json) - len, "}");
+    server.send(200, "application/json", json);
+}
+
+// Screen pacing: "?fps=<1-120>" sets the target frame rate, "?reset=1" clears the counters.
+// Replies the achieved rate, render time per frame (avg/max/last, us) and frames dropped
+// because a frame overran its slot.
+void handleRender() {
+    server.enableCORS(true);
+    if (server.hasArg("fps")) renderer.setFps(server.arg("fps").toInt());
+    if (server.hasArg("reset")) renderer.resetStats();
+
+    char json[224];
+    snprintf(json, sizeof(json),
+             "{\"target_fps\":%u,\"fps\":%.1f,\"frames\":%lu,\"dropped\":%lu,\"render_us\":%lu,"
+             "\"max_render_us\":%lu,\"last_render_us\":%lu,\"spi_ms\":%.2f}",
+             renderer.targetFps(), (float)renderer.fps, (unsigned long)renderer.frames,
+             (unsigned long)renderer.dropped, (unsigned long)renderer.avgUs(), (unsigned long)renderer.max_us,
+             (unsigned long)renderer.last_us, spi_ms);
+    server.send(200, "application/json", json);
+}
+
+// Stage timing histograms since boot or the last /metrics/reset (see profiler.h)
+void handleMetricsJson() {
+    server.enableCORS(true);
+    char json[768];
+    profiler.json(json, sizeof(json));
+    server.send(200, "application/json", json);
+}
+
+// Prometheus text format: HTTP per endpoint / client, audio stream, memory, WiFi, battery, stage timings.
+// Formatted into a static buffer and sent with one sendContent(); no String, no heap.
+void handleMetrics() {
+    static char prom[8192];
+    PromWriter w(prom, sizeof(prom));
+    w.family("mictalk_device_info", "gauge", "Device model.");
+    w.value("mictalk_device_info", "device=\"cardputer\"", (uint32_t)1);
+    w.gauge("mictalk_uptime_seconds", "Time since boot.", millis() / 1000.0);
+    server.writeMetrics(w);
+    w.counter("mictalk_audio_chunks_captured_total", "Chunks recorded and processed.", chunk_seq);
+    w.counter("mictalk_audio_chunks_dropped_total", "Chunks missing from the stream (gaps in chunk timing, estimate).",
+              chunks_dropped.load(std::memory_order_relaxed));
+    w.counter("mictalk_audio_chunks_overwritten_unread_total",
+              "Chunks overwritten in the ring before /data served them (while /data is polled).",
+              chunks_unread.load(std::memory_order_relaxed));
+    w.gauge("mictalk_heap_free_bytes", "Free internal heap.", ESP.getFreeHeap());
+    w.gauge("mictalk_heap_min_free_bytes", "Lowest free internal heap since boot.", ESP.getMinFreeHeap());
+    w.gauge("mictalk_psram_free_bytes", "Free PSRAM (0 without PSRAM).", ESP.getFreePsram());
+    w.gauge("mictalk_psram_min_free_bytes", "Lowest free PSRAM since boot.", ESP.getMinFreePsram());
+    writeAllocMetrics(w, allocStats);
+    w.gauge("mictalk_wifi_rssi_dbm", "WiFi signal strength.", WiFi.RSSI());
+    w.gauge("mictalk_battery_percent", "Battery level.", bat_level);
+    writeStageMetrics(w, profiler);
+
+    server.setContentLength(w.length());
+    server.send(200, "text/plain; version=0.0.4; charset=utf-8", "");
+    server.sendContent(w.text(), w.length());
+}
+
+// Trace ring as Chrome trace_event JSON, streamed in chunks (see trace.h); ?clear=1 empties it afterwards
+void handleTrace() {
+    server.enableCORS(true);
+#if MICTALK_TRACE
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/json", "");
+    static char out[1024];
+    size_t used = 0;
+    traceRing.writeJson([&used](const char *text, int len) {
+        if (used + len > sizeof(out)) {
+            server.sendContent(out, used);
+            used = 0;
+        }
+        memcpy(out + used, text, len);
+        used += len;
+    });
+    if (used) server.sendContent(out, used);
+    server.sendContent("");
+    if (server.hasArg("clear")) traceRing.clear();
+#else
+    server.send(404, "text/plain", "Tracing is compiled out: set MICTALK_TRACE to 1 and rebuild");
+#endif
+}
+
+void handleMetricsReset() {
+    server.enableCORS(true);
+    profiler.reset();
+    server.send(200, "application/json", "{\"reset\":true}");
+}
+
+// Decimal v at p, no terminator; returns the end
+static char *appendInt(char *p, int32_t v) {
+    uint32_t u = v < 0 ? -(uint32_t)v : v;
+    if (v < 0) *p++ = '-';
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
 void handleGetData() {
     server.enableCORS(true); 
-    auto data = &rec_data[draw_record_idx * record_length];
-    
-    int current_scale = scale_factors[scale_idx];
+    auto data = &rec_data[ready_record_idx * record_length];
+    rec_flags[ready_record_idx] |= CHUNK_READ;
+    last_data_ms = millis();
+
+    // Capture paused for playback: "playing" while it lasts, then "gap" (ms) on the first chunk after
+    char extra[32] = "";
+    if (player.active()) snprintf(extra, sizeof(extra), ",\"playing\":1");
+    else if (rec_flags[ready_record_idx] & CHUNK_GAP)
+        snprintf(extra, sizeof(extra), ",\"gap\":%lu", (unsigned long)player.gapMs());
+
+    // --- SILENCE GATING ---
+    // Quiet chunks get a tiny heartbeat instead of the samples ("?full=1" always sends samples).
+    // So does every poll during playback: there are no new samples to send.
+    if (player.active() || (!(rec_flags[ready_record_idx] & CHUNK_ACTIVE) && !server.hasArg("full"))) {
+        char beat[72];
+        int len = snprintf(beat, sizeof(beat), "{\"seq\":%lu,\"vad\":0%s}", (unsigned long)chunk_seq, extra);
+        server.send(200, "application/json", beat);
+        net_heartbeats++;
+        net_bytes_sent += len;
+        if (last_full_len > (uint32_t)len) net_bytes_saved += last_full_len - len;
+        return;
+    }
     
-    String json = "{\"data\":[";
+    // Formatted into a static buffer (7 characters per sample at most) and sent from it: /data is
+    // polled at the chunk rate, a String here grew and freed ~2 KB of heap per request
+    static char json[128 + record_length * 7];
+    int current_scale = agc_enabled ? 1 : scale_factors[scale_idx];
+    char *p = json + snprintf(json, 128, "{\"seq\":%lu%s,\"vad\":1,\"gain\":%.2f,\"data\":[", (unsigned long)chunk_seq,
+                              extra, rec_gain[ready_record_idx] / 256.0f);
     for (int i = 0; i < record_length; i++) {
-        // Apply Scaling Factor here
-        // (int16_t * int) promotes to int32, so no overflow risk for these values
-        json += String(data[i] * current_scale);
-        if (i < record_length - 1) json += ",";
+        // Apply Scaling Factor here, saturating to the int16 range clients expect
+        int32_t v = data[i] * current_scale;
+        if (v > 32767) v = 32767;
+        if (v < -32768) v = -32768;
+        p = appendInt(p, v);
+        *p++ = i < record_length - 1 ? ',' : ']';
+    }
+    *p++ = '}';
+    *p = 0;
+    last_full_len = p - json;
+    net_full_replies++;
+    net_bytes_sent += last_full_len;
+    server.send(200, "application/json", json);
+}
+
+// AGC settings: "?on=0|1&target=<dBFS>&attack=<ms>&release=<ms>&max=<dB>&limit=<dBFS>"
+void handleAgc() {
+    server.enableCORS(true);
+    AgcConfig c = agc.config();
+    if (server.hasArg("target"))  c.target_dbfs = server.arg("target").toFloat();
+    if (server.hasArg("attack"))  c.attack_ms   = server.arg("attack").toFloat();
+    if (server.hasArg("release")) c.release_ms  = server.arg("release").toFloat();
+    if (server.hasArg("max"))     c.max_gain_db = server.arg("max").toFloat();
+    if (server.hasArg("limit"))   c.limit_dbfs  = server.arg("limit").toFloat();
+    agc.configure(c);
+    c = agc.config(); // As applied (max gain clamped to what rec_gain can hold)
+    if (server.hasArg("on")) agc_enabled = server.arg("on").toInt() != 0;
+
+    char json[200];
+    snprintf(json, sizeof(json),
+             "{\"on\":%d,\"gain\":%.2f,\"target\":%.1f,\"attack\":%.1f,\"release\":%.1f,\"max\":%.1f,\"limit\":%.1f}",
+             agc_enabled ? 1 : 0, agc.currentGain() / (float)AutoGain::kUnity, c.target_dbfs,
+             c.attack_ms, c.release_ms, c.max_gain_db, c.limit_dbfs);
+    server.send(200, "application/json", json);
+}
+
+// VAD state and silence-gating savings for /data
+void handleStatus() {
+    server.enableCORS(true);
+    char json[512];
+    snprintf(json, sizeof(json),
+             "{\"seq\":%lu,\"vad\":{\"active\":%d,\"db\":%.1f,\"floor\":%.1f,\"flat\":%.2f},"
+             "\"net\":{\"full\":%lu,\"heartbeats\":%lu,\"bytes_sent\":%lu,\"bytes_saved\":%lu},"
+             "\"history\":{\"s\":%.1f,\"raw_s\":%.1f,\"tier_bytes\":%u},"
+             "\"playback\":{\"on\":%d,\"gaps\":%lu,\"last_gap_ms\":%lu},"
+             "\"screen\":{\"ok\":%d,\"fps\":%.1f,\"spi_ms\":%.2f,\"dropped\":%lu}}",
+             (unsigned long)chunk_seq, vad.isActive() ? 1 : 0, vad.levelDb(), vad.noiseFloorDb(),
+             vad.spectralFlatness(), (unsigned long)net_full_replies, (unsigned long)net_heartbeats,
+             (unsigned long)net_bytes_sent, (unsigned long)net_bytes_saved,
+             (float)history.samples() / record_samplerate, (float)scope_history / record_samplerate,
+             (unsigned)history.tierBytes(), player.active() ? 1 : 0, (unsigned long)player.gapCount(),
+             (unsigned long)player.gapMs(), band_ok ? 1 : 0, (float)renderer.fps, spi_ms,
+             (unsigned long)renderer.dropped);
+    server.send(200, "application/json", json);
+}
+
+// Loudness readout for the VU console. "?reset=1" restarts the integrated measurement.
+void handleLoudness() {
+    server.enableCORS(true);
+    if (server.hasArg("reset")) loudness.reset();
+
+    char json[160];
+    snprintf(json, sizeof(json),
+             "{\"m\":%.1f,\"s\":%.1f,\"i\":%.1f,\"tp\":%.1f,\"tpm\":%.1f}",
+             loudness.momentary(), loudness.shortTerm(), loudness.integrated(),
+             loudness.truePeak(), loudness.truePeakMomentary());
+    server.send(200, "application/json", json);
+}
+
+// Tone detector bank: "?clear=1" empties it, "?add=<Hz>&on=<dBFS>&off=<dBFS>" adds a tone.
+void handleTones() {
+    server.enableCORS(true);
+    if (server.hasArg("clear")) tones.clear();
+    if (server.hasArg("add")) {
+        float on = server.hasArg("on") ? server.arg("on").toFloat() : -40.0f;
+        float off = server.hasArg("off") ? server.arg("off").toFloat() : on - 6.0f;
+        tones.add(server.arg("add").toFloat(), on, off);
+    }
+
+    static char json[2048];
+    int len = snprintf(json, sizeof(json), "{\"now\":%lu,\"tones\":[", (unsigned long)millis());
+    for (int i = 0; i < tones.size() && len < (int)sizeof(json); i++) {
+        const ToneDetector &t = tones.tone(i);
+        len += snprintf(json + len, sizeof(json) - len,
+                        "%s{\"f\":%.1f,\"db\":%.1f,\"on\":%d,\"t\":%lu,\"hits\":%lu,\"on_db\":%.1f,\"off_db\":%.1f}",
+                        i ? "," : "", t.freq, t.level_db, t.active ? 1 : 0,
+                        (unsigned long)t.event_ms, (unsigned long)t.hits, t.on_db, t.off_db);
+    }
+    if (len < (int)sizeof(json)) snprintf(json + len, sizeof(json) - len, "]}");
+    server.send(200, "application/json", json);
+}
+
+// Tiny numeric pitch feed: every hop since "?since=<hop>" (default: latest only).
+// f0 is in Hz (0 = unvoiced), conf is the YIN confidence in percent.
+void handlePitch() {
+    server.enableCORS(true);
+    uint32_t hops = pitch.hops();
+    uint32_t oldest = (hops > PitchTracker::kResults) ? hops - PitchTracker::kResults : 0;
+    uint32_t since = server.hasArg("since") ? (uint32_t)server.arg("since").toInt() : (hops ? hops - 1 : 0);
+    if (since < oldest || since > hops) since = oldest;
+
+    static char json[1200];
+    int len = snprintf(json, sizeof(json), "{\"hop\":%lu,\"hz\":%.1f,\"f0\":[",
+                       (unsigned long)hops, (float)record_samplerate / PitchTracker::kHop);
+    for (uint32_t h = since; h < hops; h++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%.1f", (h == since) ? "" : ",", pitch.result(h).f0);
+    }
+    len += snprintf(json + len, sizeof(json) - len, "],\"conf\":[");
+    for (uint32_t h = since; h < hops; h++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%d", (h == since) ? "" : ",",
+                        (int)(pitch.result(h).confidence * 100));
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    server.send(200, "application/json", json);
+}
+
+// Capture filter chain: "?dc=0|1&hp=<Hz, 0 = off>&eq=0|1" (eq=1 reloads /mic_eq.txt)
+void handleFilter() {
+    server.enableCORS(true);
+    if (server.hasArg("dc")) micFilter.dc_enabled = server.arg("dc").toInt() != 0;
+    if (server.hasArg("hp")) micFilter.setHighPass(server.arg("hp").toFloat());
+    if (server.hasArg("eq")) {
+        if (server.arg("eq").toInt()) loadMicEq();
+        else micFilter.clearFir();
     }
-    json += "]}";
+
+    char json[80];
+    snprintf(json, sizeof(json), "{\"dc\":%d,\"hp\":%.1f,\"eq_taps\":%d}",
+             micFilter.dc_enabled ? 1 : 0, micFilter.highPassHz(), micFilter.firTaps());
     server.send(200, "application/json", json);
 }
 
+// Reads the tone bank from "/tones.txt" (one "<Hz> [on_dBFS] [off_dBFS]" per line)
+void loadTones() {
+    File file = SD.open("/tones.txt");
+    if (!file) return;
+    while (file.available()) {
+        String line = file.readStringUntil('\n');
+        tones.parseLine(line.c_str());
+    }
+    file.close();
+}
+
+// Reads mic-response correction taps from "/mic_eq.txt" (numbers separated by spaces, commas or newlines)
+void loadMicEq() {
+    File file = SD.open("/mic_eq.txt");
+    if (!file) return;
+    float taps[CaptureFilter::kMaxTaps];
+    int n = 0;
+    while (file.available() && n < CaptureFilter::kMaxTaps) {
+        String tok = file.readStringUntil(',');
+        tok.trim();
+        // Tokens may still hold several whitespace separated values
+        const char *p = tok.c_str();
+        char *end;
+        for (float v = strtof(p, &end); end != p && n < CaptureFilter::kMaxTaps; v = strtof(p, &end)) {
+            taps[n++] = v;
+            p = end;
+        }
+    }
+    file.close();
+    micFilter.setFir(taps, n);
+}
+
 void loadConfig() {
     // Try to mount SD card
     // M5Cardputer SD CS pin is typically GPIO 12
     if (!SD.begin(GPIO_NUM_12, SPI, 25000000)) { 
         M5Cardputer.Display.drawString("No SD Card found.", 120, 80);
-        delay(1000);
         return; 
     }
+    sd_ready = true;
+
+    loadTones();
+    loadMicEq();
 
     File file = SD.open("/config.txt");
     if (file) {
@@ -110,117 +887,305 @@ void loadConfig() {
         
         file.close();
         M5Cardputer.Display.drawString("Config Loaded!", 120, 100);
-        delay(1000);
     } else {
         M5Cardputer.Display.drawString("Config file missing", 120, 80);
-        delay(1000);
     }
 }
 
 void setup(void) {
     auto cfg = M5.config();
     M5Cardputer.begin(cfg);
+    profiler.begin();
+    tones.begin(record_samplerate); // Before loadConfig() so /tones.txt can fill it
+    micFilter.begin(record_samplerate); // ...and /mic_eq.txt
 
     M5Cardputer.Display.setRotation(1);
     M5Cardputer.Display.setTextDatum(top_center);
     M5Cardputer.Display.setTextColor(WHITE);
     M5Cardputer.Display.setFont(&fonts::FreeSansBoldOblique12pt7b);
+    boot.mark("display");
+
+    // Off-screen waveform band first: 52.8 KB of internal, DMA-capable RAM in one block (no PSRAM on
+    // the Cardputer), before the ring, history tier, envelope and SD buffers split the heap up
+    band.setColorDepth(16);
+    band_ok = band.createSprite(M5Cardputer.Display.width(), band_h) != nullptr;
+    band.setTextDatum(top_center);
+    band.setTextColor(WHITE);
+    band.setFont(&fonts::FreeSansBoldOblique12pt7b);
+    band.setTextSize(0.8);
+    if (!band_ok) boot.mark("band_failed"); // Shown in /boot; /status reports screen.ok = 0
     
     // --- LOAD CONFIG FROM SD ---
     loadConfig();
+    boot.mark("sd_config");
     
-    M5Cardputer.Display.clear();
-    M5Cardputer.Display.drawString("Connecting to:", 120, 40);
-    M5Cardputer.Display.drawString(wifi_ssid, 120, 70);
-    
-    // Use c_str() to convert String object to char* for begin()
-    WiFi.begin(wifi_ssid.c_str(), wifi_pass.c_str());
-    
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        M5Cardputer.Display.print(".");
-    }
-    
-    M5Cardputer.Display.clear();
+    // --- WIFI IN THE BACKGROUND ---
+    // Straight to the AP/channel cached last time (full scan if there is none or it fails);
+    // loop() polls it while capture and the screen already run, the header shows the IP once up
+    wifiBoot.begin(wifi_ssid.c_str(), wifi_pass.c_str(), &boot);
     M5Cardputer.Display.setTextSize(0.8);
-    M5Cardputer.Display.drawString("IP: " + WiFi.localIP().toString(), 120, 60);
-    delay(3000); 
 
     // --- REGISTER ROUTES ---
     server.on("/", handleRoot);         // VU Meter
     server.on("/sv", handleSpectrum);   // Spectrum Visualizer
     server.on("/data", handleGetData);  // Data API
+    server.on("/loudness", handleLoudness); // LUFS / True Peak API
+    server.on("/tones", handleTones);       // Tone Detector API
+    server.on("/pitch", handlePitch);       // Pitch (f0) Feed
+    server.on("/status", handleStatus);     // VAD / Gating Stats
+    server.on("/agc", handleAgc);           // AGC Settings
+    server.on("/filter", handleFilter);     // Capture Filter Settings
+    server.on("/scope", handleScope);       // Triggered Oscilloscope
+    server.on("/scopedata", handleScopeData); // Scope Frame API
+    server.on("/envelope", handleEnvelope); // History Envelope API
+    server.on("/rec", handleRec);           // SD Recorder
+    server.on("/event", handleEvent);       // Event Capture
+    server.on("/capture.wav", handleCaptureWav); // RAM Ring Download
+    server.on("/archive", handleArchive);   // SD Archive (time index + Range)
+    server.on("/boot", handleBoot);         // Boot Timing + WiFi Cache
+    server.on("/render", handleRender);     // Screen Frame Rate + Render Stats
+    server.on("/metrics", handleMetrics);   // Prometheus Scrape
+    server.on("/metrics.json", handleMetricsJson); // Stage Timing Histograms
+    server.on("/metrics/reset", handleMetricsReset);
+    server.on("/trace.json", handleTrace);  // Chrome Trace of the Hot Path
     
+    const char *collect[] = {"Range"}; // /archive seeking
+    server.collectHeaders(collect, 1);
     server.begin();
+    boot.mark("server");
 
     rec_data = (typeof(rec_data))heap_caps_malloc(record_size * sizeof(int16_t), MALLOC_CAP_8BIT);
     memset(rec_data, 0, record_size * sizeof(int16_t));
+    loudness.begin(record_samplerate);
+    pitch.begin(record_samplerate);
+    vad.begin();
+    agc.begin(record_samplerate);
+    if (!envelope.begin()) boot.mark("envelope_off"); // Allocation failed: pyramid freed and off, raw ring only
+    if (sd_ready) sdrec.begin(record_samplerate);
+    if (sd_ready) archive.begin(record_samplerate);
+    history.begin(rec_data, record_number, record_length, record_number - 3); // Chunks the mic is not writing to
+    if (sd_ready) events.begin(history, record_samplerate);
+    ringStream.begin(history, record_samplerate);
+    player.begin(history, record_samplerate);
+    boot.mark("buffers");
     M5Cardputer.Speaker.setVolume(255);
     M5Cardputer.Speaker.end();
     M5Cardputer.Mic.begin();
+    boot.mark("audio");
     
     M5Cardputer.Display.clear();
-    M5Cardputer.Display.fillCircle(70, 15, 8, RED);
-    
-    // Show REC-ID and Initial Battery Level using global X position
-    String hostId = String(WiFi.localIP()[3]);
-    int bat = M5.Power.getBatteryLevel();
-    M5Cardputer.Display.drawString("REC-" + hostId + " " + String(bat) + "%", ui_x_pos, 3);
+    header_dirty = true; // REC-ID and battery are drawn with the first frame
+    renderer.begin(renderFrame, render_fps); // From here on only the render task draws
+}
+
+// Feedback for a key/button: dot colour and a line of text ('\n' starts another) at the top of the band,
+// for 3 s. Called from loop() with the renderer locked.
+void showStatus(uint16_t dot, const char *text) {
+    screen_clear = true;
+    status_dot = dot;
+    snprintf(status_text, sizeof(status_text), "%s", text);
+    status_until = millis() + 3000;
+}
+
+// Draws the newest frame of the current view into the band (renderer locked: reads the status line).
+// w: scope columns captured into scope_min/max; data: newest chunk for the VU and spectrum views.
+void drawBand(int32_t w, const int16_t *data) {
+    static constexpr int shift = 6;
+    band.fillScreen(TFT_BLACK);
+    auto noMark = [](int, int, int, int) {}; // Whole band goes out anyway
+    if (visualMode == 0) {
+        int32_t mid = (M5Cardputer.Display.height() >> 1) - band_y; // Same screen position as before
+        for (int32_t x = 0; x < w; ++x) {
+            int32_t y = mid + (scope_min[x] >> shift);
+            int32_t h = mid + (scope_max[x] >> shift) + 1 - y;
+            band.drawFastVLine(x, y, h, WHITE);
+        }
+    } else if (visualMode == 1) {
+        // Same scale as the Tab5 meter: full width at peak 12800 / average 6400
+        VuLevel vu = vuMeasure(data, record_length);
+        int32_t prev_w = 0; // Band was just cleared
+        vizDrawHBar(band, 0, 58, vuWidth(vu.peak, currentScale(), band.width(), 12800), 22, prev_w, WHITE, BLACK, noMark);
+        prev_w = 0;
+        vizDrawHBar(band, 0, 84, vuWidth(vu.avg, currentScale(), band.width(), 6400), 22, prev_w, WHITE, BLACK, noMark);
+        band.setTextColor(DARKGREY); // Readable on the white bar and on black
+        band.setTextDatum(middle_left);
+        band.drawString("PEAK", 4, 58 + 11);
+        band.drawString("AVG", 4, 84 + 11);
+        band.setTextDatum(top_center);
+        band.setTextColor(WHITE);
+    } else {
+        uint8_t levels[spec_bars];
+        int16_t prev_top[spec_bars];
+        spectrum.analyze(data, record_length, currentScale(), levels, spec_bars);
+        for (int i = 0; i < spec_bars; i++) prev_top[i] = band_h; // Band was just cleared
+        int barW = band.width() / spec_bars;
+        vizDrawBars(band, (band.width() - barW * spec_bars) / 2, band_h, band_h - 4, barW, 1, levels, spec_bars, prev_top,
+                    WHITE, BLACK, noMark);
+    }
+    // Status lines ('\n' separated), 22 px apart
+    char line[sizeof(status_text)];
+    int y = 0;
+    for (const char *start = status_text; *start; y += 22) {
+        const char *nl = strchr(start, '\n');
+        size_t len = nl ? nl - start : strlen(start);
+        memcpy(line, start, len);
+        line[len] = 0;
+        band.drawString(line, band.width() / 2, y);
+        start += nl ? len + 1 : len;
+    }
+}
+
+// Sends the band in one DMA transfer; the render task waits it out, capture runs on the other core
+void pushBand() {
+    TRACE_SCOPE("spi");
+    unsigned long t = micros();
+    M5Cardputer.Display.startWrite(); // DMA only runs inside a transaction
+    M5Cardputer.Display.pushImageDMA(0, band_y, band.width(), band.height(), (lgfx::swap565_t *)band.getBuffer());
+    M5Cardputer.Display.waitDMA(); // Blocks the render task only
+    M5Cardputer.Display.endWrite();
+    spi_ms = (micros() - t) / 1000.0f;
+}
+
+// --- RENDER TASK ---
+// One frame: header if it changed, then the band if a new chunk came in since the last frame.
+// Runs on the render task with the renderer locked.
+void renderFrame() {
+    ProfileScope prof(profiler, PROF_DRAW); // Lock wait and band transfer included
+    TRACE_SCOPE("draw");
+    static uint32_t drawn_seq = 0;
+    static bool was_playing = false;
+    static char last_label[24] = "";
+    static uint16_t last_tones = 0xFFFF;
+    static bool band_error_drawn = false;
+
+    renderer.lock();
+    if (screen_clear) {
+        M5Cardputer.Display.clear();
+        screen_clear = false;
+        header_dirty = true;
+        drawn_seq = 0; // Band comes back with the next frame
+        band_error_drawn = false;
+    }
+    if (!band_ok && !band_error_drawn) { // No band to draw into: say so where it would be (audio and web still run)
+        M5Cardputer.Display.setTextColor(RED);
+        M5Cardputer.Display.drawString("NO SCREEN BUFFER", M5Cardputer.Display.width() / 2, band_y + 30);
+        M5Cardputer.Display.drawString("WEB ONLY", M5Cardputer.Display.width() / 2, band_y + 60);
+        M5Cardputer.Display.setTextColor(WHITE);
+        band_error_drawn = true;
+    }
+
+    // --- HEADER (only when something in it changed) ---
+    if (status_until && millis() > status_until) { // Feedback expired: back to the REC dot
+        status_text[0] = 0;
+        status_dot = RED;
+        status_until = 0;
+        header_dirty = true;
+        drawn_seq = 0;
+    }
+    bool playing = player.active();
+    if (playing != was_playing) {
+        header_dirty = true;
+        was_playing = playing;
+    }
+    char label[sizeof(last_label)];
+    if (playing) snprintf(label, sizeof(label), "PLAY");
+    else headerLabel(label, sizeof(label), bat_level);
+    if (header_dirty || strcmp(label, last_label)) {
+        // --- FIX: Clear background before drawing text ---
+        // (from the REC dot to the right edge: the label changes length as WiFi comes up)
+        int box_w = 180;
+        int box_h = 25;
+        int box_x = 60;
+        M5Cardputer.Display.fillRect(box_x, 0, box_w, box_h, BLACK);
+
+        if (playing) { // Play symbol and label where the REC dot and ID were
+            M5Cardputer.Display.fillTriangle(70 - 8, 15 - 8, 70 - 8, 15 + 8, 70 + 8, 15, 0x1c9f);
+            M5Cardputer.Display.drawString(label, 120, 3);
+        } else {
+            // Updated to use global variable ui_x_pos
+            M5Cardputer.Display.drawString(label, ui_x_pos, 3);
+            M5Cardputer.Display.fillCircle(70, 15, 8, status_dot);
+        }
+        memcpy(last_label, label, sizeof(label));
+    }
+    if (header_dirty || tones.activeMask() != last_tones) {
+        drawToneIndicators();
+        last_tones = tones.activeMask();
+    }
+    header_dirty = false;
+
+    // Triggered frame (min/max per column) from whatever chunk is newest now; chunks in between
+    // are skipped. NORMAL/SINGLE keep the old trace until they fire. VU and spectrum use the
+    // newest chunk as it is.
+    uint32_t seq = chunk_seq;
+    int32_t w = M5Cardputer.Display.width();
+    if (w > record_length) w = record_length;
+    int mode = visualMode;
+    unsigned long t = micros();
+    bool frame = band_ok && seq != drawn_seq && seq > 0 &&
+                 (mode != 0 || scopeCapture(scope, w, scope_min, scope_max));
+    if (frame) {
+        drawBand(w, &rec_data[((seq - 1) % record_number) * record_length]);
+        mode_us[mode] += ((int32_t)(micros() - t) - (int32_t)mode_us[mode]) / 8; // ~8 frame average
+    }
+    drawn_seq = seq;
+    renderer.unlock(); // The frame is in the band: loop() may change state during the transfer
+    if (frame) pushBand();
+}
+
+// Header text: "WiFi.." until connected, then the full IP for a few seconds (boot used to
+// stop and show it), then "REC-<last octet>" with the battery level. Formatted into out: drawn every frame.
+void headerLabel(char *out, size_t len, int bat) {
+    IPAddress ip = WiFi.localIP();
+    if (!wifiBoot.connected()) snprintf(out, len, "WiFi.. %d%%", bat);
+    else if (millis() - wifiBoot.connectedAt() < 5000) snprintf(out, len, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    else snprintf(out, len, "REC-%u %d%%", ip[3], bat);
 }
 
 void loop(void) {
     loop_start_time = millis(); // START TIMER
+    uint32_t loop_t0 = StageProfiler::now();
+    allocStats.tick(); // Allocation rate and largest free block, once a second (/metrics)
 
+    uint32_t t0 = StageProfiler::now();
     M5Cardputer.update();
+    uint32_t input_cycles = StageProfiler::now() - t0; // Keys and button below add to it
+
+    t0 = StageProfiler::now();
     server.handleClient();
+    ringStream.pump(sampleClock()); // /capture.wav transfer, a few KB per pass
+    profiler.record(PROF_NET, t0);
+    if (player.pump()) { // Playback step; true once the mic is back
+        mic_resumed = true;
+        renderer.lock();
+        screen_clear = true; // ID and Battery come back with the next frame
+        renderer.unlock();
+    }
+    wifiBoot.poll(); // Background WiFi bring-up (the header picks up the IP)
+
+    // --- BATTERY UPDATE LOGIC ---
+    static unsigned long last_bat_check = 0;
+    if (last_bat_check == 0 || millis() - last_bat_check > 2000) { // Check every 2 seconds
+        bat_level = M5.Power.getBatteryLevel();
+        last_bat_check = millis();
+    }
+    t0 = StageProfiler::now();
+    archive.pump();                 // /archive transfer, one SD block read per pass
+    profiler.record(PROF_SD, t0);
 
     if (M5Cardputer.Mic.isEnabled()) {
-        static constexpr int shift = 6;
         auto data = &rec_data[rec_record_idx * record_length];
         
-        if (M5Cardputer.Mic.record(data, record_length, record_samplerate)) {
+        // A frozen /capture.wav holds back the mic from chunks it has not sent yet; a pending
+        // playback needs it to finish its queued buffer (no new ones) before it can be released
+        t0 = StageProfiler::now();
+        bool got = !player.active() && !ringStream.holds() && M5Cardputer.Mic.record(data, record_length, record_samplerate);
+        profiler.record(PROF_CAPTURE, t0);
+        if (got) {
             data = &rec_data[draw_record_idx * record_length];
-
-            int32_t w = M5Cardputer.Display.width();
-            if (w > record_length - 1) w = record_length - 1;
-
-            M5Cardputer.Display.startWrite();
-            for (int32_t x = 0; x < w; ++x) {
-                M5Cardputer.Display.writeFastVLine(x, prev_y[x], prev_h[x], TFT_BLACK);
-                
-                int32_t y1 = (data[x] >> shift);
-                int32_t y2 = (data[x + 1] >> shift);
-                if (y1 > y2) { int32_t tmp = y1; y1 = y2; y2 = tmp; }
-                
-                int32_t y = ((M5Cardputer.Display.height()) >> 1) + y1;
-                int32_t h = ((M5Cardputer.Display.height()) >> 1) + y2 + 1 - y;
-                
-                prev_y[x] = y;
-                prev_h[x] = h;
-                M5Cardputer.Display.writeFastVLine(x, prev_y[x], prev_h[x], WHITE);
-            }
-            M5Cardputer.Display.endWrite();
-            M5Cardputer.Display.display();
-            
-            // --- BATTERY UPDATE LOGIC ---
-            static int bat_level = M5.Power.getBatteryLevel();
-            static unsigned long last_bat_check = 0;
-            if (millis() - last_bat_check > 2000) { // Check every 2 seconds
-                bat_level = M5.Power.getBatteryLevel();
-                last_bat_check = millis();
-            }
-
-            String hostId = String(WiFi.localIP()[3]);
-            
-            // --- FIX: Clear background before drawing text ---
-            int box_w = 100;
-            int box_h = 25;
-            int box_x = ui_x_pos + 10;
-            M5Cardputer.Display.fillRect(box_x, 0, box_w, box_h, BLACK);
-
-            // Updated to use global variable ui_x_pos
-            M5Cardputer.Display.drawString("REC-" + hostId + " " + String(bat_level) + "%", ui_x_pos, 3); 
-            M5Cardputer.Display.fillCircle(70, 15, 8, RED);
+            t0 = StageProfiler::now();
+            processChunk(data); // The render task draws it (or a newer one) on its next frame
+            profiler.record(PROF_DSP, t0);
 
             if (++draw_record_idx >= record_number) draw_record_idx = 0;
             if (++rec_record_idx >= record_number) rec_record_idx = 0;
@@ -228,53 +1193,150 @@ void loop(void) {
     }
     
     // --- KEYBOARD LOGIC ---
+    t0 = StageProfiler::now();
     if (M5Cardputer.Keyboard.isChange()) {
         if (M5Cardputer.Keyboard.isPressed()) {
             Keyboard_Class::KeysState status = M5Cardputer.Keyboard.keysState();
+            renderer.lock(); // Scope settings and feedback are read by the render task
             bool scaleChanged = false;
             bool showCpu = false;
+            bool showProfile = false;
+            bool trigChanged = false;
+            bool recChanged = false;
             
+            if (status.enter) {
+                scope.arm(); // Re-arm SINGLE
+                trigChanged = true;
+            }
+
             for (auto i : status.word) {
-                // Up Arrow (mapped to ';')
+                // Up Arrow (mapped to ';') - manual SF overrides AGC
                 if (i == ';') {
-                    if (scale_idx < 5) {
-                        scale_idx++;
-                        scaleChanged = true;
-                    }
+                    if (agc_enabled) agc_enabled = false;
+                    else if (scale_idx < 5) scale_idx++;
+                    scaleChanged = true;
                 }
                 // Down Arrow (mapped to '.')
                 if (i == '.') {
-                    if (scale_idx > 0) {
-                        scale_idx--;
-                        scaleChanged = true;
-                    }
+                    if (agc_enabled) agc_enabled = false;
+                    else if (scale_idx > 0) scale_idx--;
+                    scaleChanged = true;
+                }
+                // 'a' Key - Back to Automatic Gain Control
+                if (i == 'a') {
+                    agc_enabled = true;
+                    scaleChanged = true;
+                }
+                // 'r' Key - SD Recording On/Off
+                if (i == 'r') {
+                    if (sdrec.isRecording()) sdrec.stop();
+                    else if (sd_ready) sdrec.start();
+                    recChanged = true;
+                }
+                // 'm' Key - Mark an Event
+                if (i == 'm' && sd_ready) {
+                    events.trigger(EVT_KEY);
+                    showStatus(MAGENTA, "MARK");
+                }
+                // 'v' Key - Next View
+                if (i == 'v') {
+                    visualMode = (visualMode + 1) % modeCount;
+                    showStatus(BLUE, modeNames[visualMode]);
                 }
                 // 'q' Key - Show CPU Load
                 if (i == 'q') {
                     showCpu = true;
                 }
+                // 'p' Key - Show Stage Timings
+                if (i == 'p') {
+                    showProfile = true;
+                }
+                // Scope trigger: 't' mode, 'e' edge, '-' / '=' level
+                if (i == 't') {
+                    scope.cfg.mode = (TriggerMode)((scope.cfg.mode + 1) % 4);
+                    scope.arm();
+                    trigChanged = true;
+                }
+                if (i == 'e') {
+                    scope.cfg.edge = (scope.cfg.edge == EDGE_RISING) ? EDGE_FALLING : EDGE_RISING;
+                    trigChanged = true;
+                }
+                if (i == '-' && scope.cfg.level > -16384) {
+                    scope.cfg.level -= 512;
+                    trigChanged = true;
+                }
+                if (i == '=' && scope.cfg.level < 16384) {
+                    scope.cfg.level += 512;
+                    trigChanged = true;
+                }
+                // 'h' Key - Next Holdoff step
+                if (i == 'h') {
+                    holdoff_idx = (holdoff_idx + 1) % scope_holdoff_count;
+                    scope.cfg.holdoff = scope_holdoffs_ms[holdoff_idx] * record_samplerate / 1000;
+                    trigChanged = true;
+                }
+                // Left / Right Arrows (',' / '/') - Timebase
+                if (i == ',' && timebase_idx > 0) {
+                    scope.cfg.spp = scope_timebases[--timebase_idx];
+                    trigChanged = true;
+                }
+                if (i == '/' && timebase_idx < scope_timebase_count - 1) {
+                    scope.cfg.spp = scope_timebases[++timebase_idx];
+                    trigChanged = true;
+                }
             }
 
             if (scaleChanged) {
-                M5Cardputer.Display.clear();
-                M5Cardputer.Display.fillCircle(70, 15, 8, YELLOW);
-                M5Cardputer.Display.drawString("SF:" + String(scale_factors[scale_idx]), 120, 25);
+                char info[16];
+                if (agc_enabled) snprintf(info, sizeof(info), "AGC");
+                else snprintf(info, sizeof(info), "SF:%d", scale_factors[scale_idx]);
+                showStatus(YELLOW, info);
             }
             
+            if (recChanged) {
+                showStatus(sdrec.isRecording() ? MAGENTA : DARKGREY,
+                           !sd_ready ? "NO SD" : sdrec.isRecording() ? "SD REC" : "SD STOP");
+            }
+
+            if (trigChanged) {
+                char info[40];
+                snprintf(info, sizeof(info), "%s %s %d x%d H%d", triggerModeNames[scope.cfg.mode],
+                         scope.cfg.edge == EDGE_RISING ? "R" : "F", (int)scope.cfg.level, (int)scope.cfg.spp,
+                         (int)scope_holdoffs_ms[holdoff_idx]);
+                showStatus(ORANGE, info);
+            }
+
             if (showCpu) {
-                M5Cardputer.Display.clear();
-                M5Cardputer.Display.fillCircle(70, 15, 8, BLUE); // Blue for CPU/System
-                
                 // Calculate Load based on 40ms target (25fps)
                 // If loop takes 40ms, CPU is "100% busy" for that frame rate goal
                 int load_pct = (max_loop_time * 100) / 40;
                 if (load_pct > 100) load_pct = 100;
                 
-                String debugInfo = "CPU:" + String(load_pct) + "% " + String(max_loop_time) + "ms";
-                M5Cardputer.Display.drawString(debugInfo, 120, 25);
+                // Second line: screen frames per second, render time (avg ms) and SPI time of one band transfer
+                // Third line: draw time (ms) of each view, analysis included (0 until it has been shown)
+                char debugInfo[96];
+                snprintf(debugInfo, sizeof(debugInfo), "CPU:%d%% %lums\n%.0ffps R:%.1f SPI:%.1f\nW:%.1f V:%.1f S:%.1f",
+                         load_pct, (unsigned long)max_loop_time, (float)renderer.fps, renderer.avgUs() / 1000.0f, spi_ms,
+                         mode_us[0] / 1000.0f, mode_us[1] / 1000.0f, mode_us[2] / 1000.0f);
+                showStatus(BLUE, debugInfo); // Blue for CPU/System
                 
                 max_loop_time = 0; // Reset max counter
             }
+
+            if (showProfile) {
+                // p95 in us per stage (capture, DSP, draw, network, input, SD, whole loop)
+                char info[96];
+                snprintf(info, sizeof(info), "C:%lu D:%lu R:%lu\nN:%lu I:%lu SD:%lu\nLOOP p95:%lu",
+                         (unsigned long)profiler.stage(PROF_CAPTURE).percentile(95),
+                         (unsigned long)profiler.stage(PROF_DSP).percentile(95),
+                         (unsigned long)profiler.stage(PROF_DRAW).percentile(95),
+                         (unsigned long)profiler.stage(PROF_NET).percentile(95),
+                         (unsigned long)profiler.stage(PROF_INPUT).percentile(95),
+                         (unsigned long)profiler.stage(PROF_SD).percentile(95),
+                         (unsigned long)profiler.stage(PROF_LOOP).percentile(95));
+                showStatus(CYAN, info);
+            }
+            renderer.unlock();
         }
     }
 
@@ -284,48 +1346,32 @@ void loop(void) {
         cfg.noise_filter_level = (cfg.noise_filter_level + 8) & 255;
         M5Cardputer.Mic.config(cfg);
         
-        M5Cardputer.Display.clear();
-        M5Cardputer.Display.fillCircle(70, 15, 8, GREEN);
         // NF display always centered at 120
-        M5Cardputer.Display.drawString("NF:" + String(cfg.noise_filter_level), 120, 25);
+        renderer.lock();
+        char info[16];
+        snprintf(info, sizeof(info), "NF:%d", cfg.noise_filter_level);
+        showStatus(GREEN, info);
+        renderer.unlock();
 
     } else if (M5Cardputer.BtnA.wasClicked()) {
-        if (M5Cardputer.Speaker.isEnabled()) {
-            M5Cardputer.Display.clear();
-            while (M5Cardputer.Mic.isRecording()) delay(1);
-            
-            M5Cardputer.Mic.end();
-            M5Cardputer.Speaker.begin();
-
-            M5Cardputer.Display.fillTriangle(70 - 8, 15 - 8, 70 - 8, 15 + 8, 70 + 8, 15, 0x1c9f);
-            M5Cardputer.Display.drawString("PLAY", 120, 3);
-            
-            int start_pos = rec_record_idx * record_length;
-            if (start_pos < record_size) {
-                M5Cardputer.Speaker.playRaw(&rec_data[start_pos], record_size - start_pos, record_samplerate, false, 1, 0);
-            }
-            if (start_pos > 0) {
-                M5Cardputer.Speaker.playRaw(rec_data, start_pos, record_samplerate, false, 1, 0);
-            }
-            do {
-                delay(1);
-                M5Cardputer.update();
-            } while (M5Cardputer.Speaker.isPlaying());
-
-            M5Cardputer.Speaker.end();
-            M5Cardputer.Mic.begin();
-
-            M5Cardputer.Display.clear();
-            M5Cardputer.Display.fillCircle(70, 15, 8, RED);
-            
-            // Redraw ID and Battery after playback using global variable
-            String hostId = String(WiFi.localIP()[3]);
-            int bat = M5.Power.getBatteryLevel();
-            M5Cardputer.Display.drawString("REC-" + hostId + " " + String(bat) + "%", ui_x_pos, 3);
+        // Plays the whole history from loop() (see the player step at the top); a second click stops it
+        if (player.active()) {
+            player.stop();
+            renderer.lock();
+            screen_clear = true; // Header back to the ID if it stopped before the mic was released
+            renderer.unlock();
+        } else if (M5Cardputer.Speaker.isEnabled() && player.start()) {
+            renderer.lock();
+            screen_clear = true; // The render task shows PLAY in the header while the player runs
+            renderer.unlock();
         }
     }
     
+    input_cycles += StageProfiler::now() - t0;
+    profiler.recordCycles(PROF_INPUT, input_cycles);
+
     // END TIMER & UPDATE MAX
+    profiler.record(PROF_LOOP, loop_t0);
     unsigned long loop_duration = millis() - loop_start_time;
     if (loop_duration > max_loop_time) {
         max_loop_time = loop_duration;
@@ -5,34 +5,96 @@
  * @date 2025-11-28
  *
  * HARDWARE: M5Stack Tab5
- * LIBRARY DEPENDENCY: "arduinoFFT" by Enrique Condes (Version 2.x) - Install via Library Manager
  *
  * FEATURES:
  * 1. WiFi Data Server: Serves audio data to connected web clients.
  * 2. Visualizers: 
- * - Waveform: Real-time oscilloscope style.
+ * - Waveform: Triggered oscilloscope (edge/level/holdoff, AUTO/NORM/SINGLE, min/max timebase).
  * - VU Meter: Split stereo-simulation peak/rms meter.
- * - Spectrum: 64-band FFT frequency analyzer.
+ * - Spectrum: 64-band fixed-point FFT frequency analyzer (dB scale).
+ * - Pitch: Scrolling YIN fundamental frequency trace with note readout.
+ * - Waterfall: Spectrogram sweeping down the screen, one row per captured chunk.
+ * - Phosphor: Waveform intensity built from every chunk, fading like a CRT.
+ * - Profile: p50/p95/p99/max time per loop stage (same numbers as /metrics.json).
  * 3. Touch Interface: 5 on-screen buttons for control.
  * 4. Recording/Playback: Records to RAM and plays back via speaker (Doesn't correctly work).
+ * 5. Loudness: EBU R128 LUFS and true-peak meter served at /loudness.
+ * 6. Tone Detectors: Goertzel bank for alarm/beacon frequencies (/tones, /tones.txt on SD).
+ * 7. Pitch Tracker: YIN f0 + confidence per hop, streamed at /pitch.
+ * 8. Silence Gating: VAD-tagged chunks; /data sends a tiny heartbeat while silent (/status).
+ * 9. AGC: Smooth fixed-point gain + limiter (/agc); per-chunk gain is reported in /data.
+ * 10. Capture Filter: DC blocker, high-pass and optional FIR mic EQ from /mic_eq.txt (/filter).
+ * 11. Scope: Tap the WAVE view to change the trigger (mode, edge, level, holdoff) / timebase; web scope at /scope (/scopedata).
+ * 12. History Envelope: Min/max/RMS pyramid over ~30 minutes in PSRAM (/envelope, long timebases).
+ * 13. SD Recorder: Continuous WAV segments on the SD card from a background task (/rec).
+ * 14. Event Capture: Seconds before + after a trigger to SD (level, tone, status-bar tap or /event).
+ * 15. Ring Download: /capture.wav streams the RAM ring as a WAV file without stopping capture.
+ * 16. Screen: Drawn into a PSRAM canvas; only the changed 32x32 tiles are pushed (stats in /status).
+ * 17. Render Task: The screen is drawn on its own task at a target frame rate (/render).
+ * 18. Waterfall: Per-chunk FFT rows written straight into the canvas through a colour LUT.
+ * 19. Phosphor: Decaying 8-bit hit buffer fed by every chunk, so rare glitches stay visible.
+ * 20. Profiler: Cycle-counter timing histograms per loop stage (/metrics.json, /metrics/reset).
+ * 21. Prometheus: /metrics for Grafana (HTTP per endpoint/client, chunk health, memory, RSSI, battery).
+ * 22. Trace: /trace.json, a Chrome trace of the last ~4000 hot-path events (build with MICTALK_TRACE 1).
  */
 
 #include <M5Unified.h>
 #include <WiFi.h>
 #include <WebServer.h>
 #include <SD.h> 
-#include <arduinoFFT.h> // REQUIRED: Install "arduinoFFT" Version 2.x
+
+// Hot-path event trace for /trace.json (Perfetto / chrome://tracing). 0 compiles every TRACE_* out.
+#define MICTALK_TRACE 0
+#define TRACE_EVENTS 4096 // 48 KB when on
+#include "trace.h"
 
 // Import HTML content for the web interface (must be in sketch folder)
 #include "webapp.h"   
 #include "spectrum.h" 
+#include "scope.h"    // Triggered oscilloscope page
+#include "capture_filter.h" // DC blocker / high-pass / mic EQ at capture time
+#include "loudness.h" // EBU R128 / BS.1770 loudness meter
+#include "tones.h"    // Goertzel tone-detector bank
+#include "pitch.h"    // YIN pitch tracker
+#include "vad.h"      // Voice activity detector (silence gating)
+#include "agc.h"      // Fixed-point automatic gain control
+#include "trigger.h"  // Scope trigger + min/max timebase
+
+// Envelope pyramid rings live in PSRAM: ~62 s at 16x, ~4 min at 256x, ~33 min at 4096x
+#define ENVELOPE_L1_BINS 65536
+#define ENVELOPE_L2_BINS 16384
+#define ENVELOPE_L3_BINS 8192
+#define ENVELOPE_ALLOC(bytes) heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM)
+#include "envelope.h" // Min/max/RMS history pyramid
+#include "palette.h"  // Level -> RGB565 colour map
+#include "waterfall.h" // Spectrogram rows for the WATERFALL view
+#include "phosphor.h" // Persistence buffer for the PHOSPHOR view
+#include "viz.h"      // Fixed-point spectrum / VU + bar renderers (shared with the Cardputer)
+#include "profiler.h" // Per-stage timing histograms (/metrics)
+#include "metrics.h"      // Prometheus /metrics (HTTP, audio, memory health)
+#include "alloc_stats.h"  // Allocation rate + largest free block (/metrics)
+
+// SD recorder double buffers in PSRAM: 2 x 64 KB (~1.9 s each) rides out long card stalls
+#define SDREC_BUFFER_BYTES 65536
+#define SDREC_ALLOC(bytes) heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM)
+#include "sd_recorder.h" // Continuous WAV recording to SD
+#include "event_recorder.h" // Pre-trigger event capture to SD
+#include "history.h"      // Chunk history (+ optional ADPCM tier, HISTORY_ADPCM_CHUNKS)
+#include "ring_stream.h"  // /capture.wav straight from the ring
+#include "wifi_boot.h"    // Async WiFi from a cached AP + boot timing
+#include "playback.h"     // Non-blocking history playback
+#define ARCHIVE_READ_BYTES 32768
+#define ARCHIVE_ALLOC(bytes) heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM)
+#include "sd_archive.h"   // Time-indexed /archive reader
+#include "compositor.h"   // Dirty-tile tracking for the off-screen frame
+#include "render_task.h"  // Screen on its own task, paced to a target frame rate
 
 // --- WI-FI SETTINGS (FALLBACK) ---
 // These are used if 'config.txt' is not found on the SD card.
 String wifi_ssid = "YOUR_SSID_HERE";
 String wifi_pass = "YOUR_PASSWORD_HERE";
 
-WebServer server(80);
+MetricsServer server(80); // WebServer that counts requests, bytes and latency (metrics.h)
 
 // --- AUDIO CONSTANTS ---
 // record_length of 256 is chosen to divide evenly into the 1280px screen width.
@@ -55,16 +117,22 @@ static int16_t prev_h[record_length]; // Height of the previous frame's bar
 static int32_t prev_vu_w[2] = {0, 0}; // [0]=Top Bar Width, [1]=Bottom Bar Width
 
 // Spectrum Buffers
-#define FFT_SAMPLES 256 // Must be a power of 2 (matches record_length)
-#define FFT_BARS 64     // Display 64 distinct frequency bands
+#define FFT_BARS 64     // Display 64 distinct frequency bands (2 bins each)
+VizSpectrum spectrum;   // Q15 FFT, same code as the Cardputer's SPECTRUM view
+static int16_t prev_spec_y[FFT_BARS]; // Previous Y-positions for spectrum bars
 
-// --- FFT OBJECT SETUP (arduinoFFT v2.x) ---
-// v2.x requires passing the arrays and size to the constructor.
-double vReal[FFT_SAMPLES];
-double vImag[FFT_SAMPLES];
-ArduinoFFT<double> FFT = ArduinoFFT<double>(vReal, vImag, FFT_SAMPLES, record_samplerate);
+// Pitch Trace State (sweeps left to right, 2px per hop)
+static int32_t pitch_x = 0;         // Next column to draw
+static uint32_t pitch_drawn_hop = 0; // Last hop already on screen
 
-static int16_t prev_spec_y[FFT_BARS]; // Previous Y-positions for spectrum bars
+// Waterfall State (sweeps top to bottom, 1 row per chunk, wraps)
+Palette565 palette;
+Waterfall waterfall;
+static int32_t wf_y = LAYOUT_VISUALIZER_TOP; // Next row to write
+
+// Phosphor State (buffer rows that had light on screen; dark ones are skipped)
+Phosphor phosphor;
+static bool phos_lit[Phosphor::kRows];
 
 // --- AUDIO POINTERS ---
 // We use a large circular buffer in PSRAM to store audio.
@@ -75,15 +143,90 @@ static int16_t *rec_data;          // Pointer to the large buffer in PSRAM
 // --- STATE VARIABLES ---
 const int scale_factors[] = {1, 2, 4, 6, 8, 12}; // Vertical zoom levels
 int scale_idx = 0; 
+bool agc_enabled = true; // AGC levels the signal; the SCALE buttons switch to manual SF
 
-// Visualizer Mode: 0 = WAVE, 1 = VU METER, 2 = SPECTRUM
+// Gain the visualizers and /data still have to apply (AGC output is already levelled)
+int currentScale() { return agc_enabled ? 1 : scale_factors[scale_idx]; }
+
+// Visualizer Mode: 0 = WAVE, 1 = VU METER, 2 = SPECTRUM, 3 = PITCH, 4 = WATERFALL, 5 = PHOSPHOR, 6 = PROFILE
 int visualMode = 0; 
-const char* modeNames[] = {"WAVE", "VU METER", "SPECTRUM"};
+const char* modeNames[] = {"WAVE", "VU METER", "SPECTRUM", "PITCH", "WATERFALL", "PHOSPHOR", "PROFILE"};
+const int modeCount = sizeof(modeNames) / sizeof(modeNames[0]);
 
 // --- PERFORMANCE MONITORING ---
-unsigned long max_loop_time = 0;   // Track longest frame time
+StageProfiler profiler; // Stage timings: loop() records all but draw, the render task records draw
+unsigned long max_loop_time = 0;   // Track longest frame time (written by loop() only)
+std::atomic<bool> max_loop_reset{false}; // Status bar has shown it: loop() starts a new period
 unsigned long loop_start_time = 0; // Start of current frame
 
+// --- AUDIO ANALYSIS ---
+CaptureFilter micFilter; // Cleans each chunk in place before anything else reads it
+LoudnessMeter loudness; // Momentary / Short-Term / Integrated LUFS + True Peak
+ToneBank tones;         // Targeted frequency detectors (see /tones.txt)
+static uint16_t drawn_tone_mask = 0xFFFF; // Indicator state currently on screen
+PitchTracker pitch;     // f0 estimate every PitchTracker::kHop samples
+VoiceActivityDetector vad; // Tags chunks ACTIVE/SILENT for /data gating
+AutoGain agc;           // Replaces manual SF stepping when agc_enabled
+EnvelopePyramid envelope; // Zoomable long history (16x / 256x / 4096x min/max/RMS)
+SdRecorder sdrec;       // Background WAV writer (/rec)
+EventRecorder events;   // Pre/post-trigger event files (/event)
+ChunkHistory history;   // Sample-clock reads across the raw ring (and compressed tier)
+RingStream ringStream;  // /capture.wav transfer, pumped from loop()
+HistoryPlayer player;   // PLAY button, stepped from loop()
+ArchiveStream archive;  // /archive transfer, pumped from loop()
+bool sd_ready = false;  // SD card mounted in loadConfig()
+BootTimeline boot;      // Boot phase timing (/boot)
+WifiBoot wifiBoot;      // Connects in the background from loop()
+
+// --- SCOPE TRIGGER ---
+// WAVE mode draws a triggered frame searched in the ring instead of the newest chunk.
+ScopeTrigger scope;     // On-screen waveform (tap the WAVE view to change it)
+ScopeTrigger web_scope; // /scopedata (clients send their settings with every request)
+static int16_t scope_min[record_length]; // Per-column minimum of the current frame
+static int16_t scope_max[record_length]; // Per-column maximum
+static constexpr size_t scope_history = (record_number - 3) * record_length; // Chunks the mic is not writing to
+const uint16_t scope_timebases[] = {1, 2, 4, 8, 16, 32, 64, 256, 1024, 4096}; // Samples per column
+const int scope_timebase_count = sizeof(scope_timebases) / sizeof(scope_timebases[0]);
+static constexpr uint16_t scope_max_raw_spp = 64; // Longer timebases roll from the envelope pyramid
+int timebase_idx = 0;
+const uint16_t scope_holdoffs_ms[] = {0, 1, 5, 20, 100}; // On-device holdoff steps (/scopedata takes any value)
+const int scope_holdoff_count = sizeof(scope_holdoffs_ms) / sizeof(scope_holdoffs_ms[0]);
+int holdoff_idx = 0;
+
+// --- CHUNK TAGS & SILENCE GATING ---
+static constexpr uint8_t CHUNK_ACTIVE = 0x01; // VAD heard sound in this chunk
+static constexpr uint8_t CHUNK_GAP    = 0x02; // First chunk after the mic paused (playback)
+static constexpr uint8_t CHUNK_READ   = 0x04; // Served by /data at least once
+static uint8_t rec_flags[record_number];      // Per-chunk tags, parallel to rec_data
+static uint16_t rec_gain[record_number];      // Gain applied to each chunk (Q8, 256 = 1.0x)
+static bool mic_resumed = false;              // Set when playback hands the mic back
+static size_t ready_record_idx = 0;           // Newest chunk that is fully recorded and processed
+static uint32_t chunk_seq = 0;                // Sequence number of that chunk (counts from 1)
+std::atomic<uint32_t> chunks_dropped{0};      // Chunks missing from the stream (timing gaps, estimate)
+std::atomic<uint32_t> chunks_unread{0};       // Overwritten in the ring before /data served them
+uint32_t last_data_ms = 0;                    // Last /data request (unread chunks only count while polled)
+uint32_t net_full_replies = 0;
+uint32_t net_heartbeats = 0;
+uint32_t net_bytes_sent = 0;
+uint32_t net_bytes_saved = 0;
+uint32_t last_full_len = record_length * 6;   // Size of the last full /data reply (estimate until one is sent)
+
+// --- SCREEN COMPOSITOR ---
+// Everything draws into `canvas` (1280x720, PSRAM) and marks what it touched in `comp`;
+// flushScreen() runs once per frame and pushes only the merged dirty tiles to the panel.
+// Frames come from the render task (renderFrame(), render_fps), not from capture: loop() draws
+// into the canvas only from touch handlers, with renderer.lock() held like the render task.
+M5Canvas canvas;
+bool canvas_ok = false;          // Frame allocated; without it the screen shows an error and stays put
+TileCompositor comp;
+RenderTask renderer;
+static constexpr uint16_t render_fps = 30; // Default target; /render?fps= changes it
+uint32_t flush_us = 0;           // Time of the last flush
+int bat_level = 0;               // Read by loop() (I2C stays on one task), shown in the status bar
+char toast_text[48] = "";        // Centre toast (mode / NF / trigger / event), drawn on every frame
+uint16_t toast_color = BLUE;
+unsigned long toast_until = 0;   // millis() it goes away (0 = none)
+
 // --- LAYOUT CONSTANTS (SCREEN GEOMETRY) ---
 const int LAYOUT_STATUS_H = 50;           // Height of top status bar
 const int LAYOUT_VISUALIZER_TOP = 50;     // Y-coordinate where visualizer starts
@@ -100,13 +243,14 @@ struct VirtualButton {
 
     // Draw the button (Inverts text color if pressed)
     void draw() {
-        M5.Display.fillRoundRect(x, y, w, h, 10, pressed ? WHITE : color);
-        M5.Display.drawRoundRect(x, y, w, h, 10, LIGHTGREY); 
-        M5.Display.setTextColor(pressed ? BLACK : WHITE);
-        M5.Display.setTextDatum(middle_center);
-        M5.Display.setTextSize(2);
-        M5.Display.drawString(label, x + (w/2), y + (h/2));
-        M5.Display.setTextDatum(top_center); // Reset datum
+        canvas.fillRoundRect(x, y, w, h, 10, pressed ? WHITE : color);
+        canvas.drawRoundRect(x, y, w, h, 10, LIGHTGREY); 
+        canvas.setTextColor(pressed ? BLACK : WHITE);
+        canvas.setTextDatum(middle_center);
+        canvas.setTextSize(2);
+        canvas.drawString(label, x + (w/2), y + (h/2));
+        canvas.setTextDatum(top_center); // Reset datum
+        comp.mark(x, y, w, h);
     }
 
     // Check if a touch coordinate (tx, ty) is inside this button
@@ -121,27 +265,244 @@ VirtualButton keys[5]; // Array of 5 buttons
 // Serves the HTML pages stored in webapp.h and spectrum.h
 void handleRoot() { server.send(200, "text/html", index_html); } 
 void handleSpectrum() { server.send(200, "text/html", spectrum_html); }
+void handleScope() { server.send(200, "text/html", scope_html); }
 
 // Serves raw JSON audio data to connected browsers
+// Stage timing histograms since boot or the last /metrics/reset (see profiler.h)
+void handleMetricsJson() {
+    server.enableCORS(true);
+    char json[768];
+    profiler.json(json, sizeof(json));
+    server.send(200, "application/json", json);
+}
+
+// Prometheus text format: HTTP per endpoint / client, audio stream, memory, WiFi, battery, stage timings.
+// Formatted into a static buffer and sent with one sendContent(); no String, no heap.
+void handleMetrics() {
+    static char prom[8192];
+    PromWriter w(prom, sizeof(prom));
+    w.family("mictalk_device_info", "gauge", "Device model.");
+    w.value("mictalk_device_info", "device=\"tab5\"", (uint32_t)1);
+    w.gauge("mictalk_uptime_seconds", "Time since boot.", millis() / 1000.0);
+    server.writeMetrics(w);
+    w.counter("mictalk_audio_chunks_captured_total", "Chunks recorded and processed.", chunk_seq);
+    w.counter("mictalk_audio_chunks_dropped_total", "Chunks missing from the stream (gaps in chunk timing, estimate).",
+              chunks_dropped.load(std::memory_order_relaxed));
+    w.counter("mictalk_audio_chunks_overwritten_unread_total",
+              "Chunks overwritten in the ring before /data served them (while /data is polled).",
+              chunks_unread.load(std::memory_order_relaxed));
+    w.gauge("mictalk_heap_free_bytes", "Free internal heap.", ESP.getFreeHeap());
+    w.gauge("mictalk_heap_min_free_bytes", "Lowest free internal heap since boot.", ESP.getMinFreeHeap());
+    w.gauge("mictalk_psram_free_bytes", "Free PSRAM (0 without PSRAM).", ESP.getFreePsram());
+    w.gauge("mictalk_psram_min_free_bytes", "Lowest free PSRAM since boot.", ESP.getMinFreePsram());
+    writeAllocMetrics(w, allocStats);
+    w.gauge("mictalk_wifi_rssi_dbm", "WiFi signal strength.", WiFi.RSSI());
+    w.gauge("mictalk_battery_percent", "Battery level.", bat_level);
+    writeStageMetrics(w, profiler);
+
+    server.setContentLength(w.length());
+    server.send(200, "text/plain; version=0.0.4; charset=utf-8", "");
+    server.sendContent(w.text(), w.length());
+}
+
+// Trace ring as Chrome trace_event JSON, streamed in chunks (see trace.h); ?clear=1 empties it afterwards
+void handleTrace() {
+    server.enableCORS(true);
+#if MICTALK_TRACE
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/json", "");
+    static char out[1024];
+    size_t used = 0;
+    traceRing.writeJson([&used](const char *text, int len) {
+        if (used + len > sizeof(out)) {
+            server.sendContent(out, used);
+            used = 0;
+        }
+        memcpy(out + used, text, len);
+        used += len;
+    });
+    if (used) server.sendContent(out, used);
+    server.sendContent("");
+    if (server.hasArg("clear")) traceRing.clear();
+#else
+    server.send(404, "text/plain", "Tracing is compiled out: set MICTALK_TRACE to 1 and rebuild");
+#endif
+}
+
+void handleMetricsReset() {
+    server.enableCORS(true);
+    profiler.reset();
+    server.send(200, "application/json", "{\"reset\":true}");
+}
+
+// Decimal v at p, no terminator; returns the end
+static char *appendInt(char *p, int32_t v) {
+    uint32_t u = v < 0 ? -(uint32_t)v : v;
+    if (v < 0) *p++ = '-';
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
 void handleGetData() {
     server.enableCORS(true); // Allow cross-origin requests (for testing)
-    auto data = &rec_data[draw_record_idx * record_length];
+    auto data = &rec_data[ready_record_idx * record_length];
+    rec_flags[ready_record_idx] |= CHUNK_READ;
+    last_data_ms = millis();
+
+    // Capture paused for playback: "playing" while it lasts, then "gap" (ms) on the first chunk after
+    char extra[32] = "";
+    if (player.active()) snprintf(extra, sizeof(extra), ",\"playing\":1");
+    else if (rec_flags[ready_record_idx] & CHUNK_GAP)
+        snprintf(extra, sizeof(extra), ",\"gap\":%lu", (unsigned long)player.gapMs());
+
+    // --- SILENCE GATING ---
+    // Quiet chunks get a tiny heartbeat instead of the samples ("?full=1" always sends samples).
+    // So does every poll during playback: there are no new samples to send.
+    if (player.active() || (!(rec_flags[ready_record_idx] & CHUNK_ACTIVE) && !server.hasArg("full"))) {
+        char beat[72];
+        int len = snprintf(beat, sizeof(beat), "{\"seq\":%lu,\"vad\":0%s}", (unsigned long)chunk_seq, extra);
+        server.send(200, "application/json", beat);
+        net_heartbeats++;
+        net_bytes_sent += len;
+        if (last_full_len > (uint32_t)len) net_bytes_saved += last_full_len - len;
+        return;
+    }
     
-    int current_scale = scale_factors[scale_idx];
-    String json = "{\"data\":["; 
+    // Formatted into a static buffer (7 characters per sample at most) and sent from it: /data is
+    // polled at the chunk rate, a String here grew and freed ~2 KB of heap per request
+    static char json[128 + record_length * 7];
+    int current_scale = currentScale();
+    char *p = json + snprintf(json, 128, "{\"seq\":%lu%s,\"vad\":1,\"gain\":%.2f,\"data\":[", (unsigned long)chunk_seq,
+                              extra, rec_gain[ready_record_idx] / 256.0f);
     for (int i = 0; i < record_length; i++) {
-        // We apply the scaling factor server-side before sending
-        json += String(data[i] * current_scale);
-        if (i < record_length - 1) json += ","; 
+        // We apply the scaling factor server-side before sending (saturating, never wrapping)
+        int32_t v = data[i] * current_scale;
+        if (v > 32767) v = 32767;
+        if (v < -32768) v = -32768;
+        p = appendInt(p, v);
+        *p++ = i < record_length - 1 ? ',' : ']';
     }
-    json += "]}";
-    server.send(200, "application/json", json); 
+    *p++ = '}';
+    *p = 0;
+    last_full_len = p - json;
+    net_full_replies++;
+    net_bytes_sent += last_full_len;
+    server.send(200, "application/json", json);
+}
+
+// AGC settings: "?on=0|1&target=<dBFS>&attack=<ms>&release=<ms>&max=<dB>&limit=<dBFS>"
+void handleAgc() {
+    server.enableCORS(true);
+    AgcConfig c = agc.config();
+    if (server.hasArg("target"))  c.target_dbfs = server.arg("target").toFloat();
+    if (server.hasArg("attack"))  c.attack_ms   = server.arg("attack").toFloat();
+    if (server.hasArg("release")) c.release_ms  = server.arg("release").toFloat();
+    if (server.hasArg("max"))     c.max_gain_db = server.arg("max").toFloat();
+    if (server.hasArg("limit"))   c.limit_dbfs  = server.arg("limit").toFloat();
+    agc.configure(c);
+    c = agc.config(); // As applied (max gain clamped to what rec_gain can hold)
+    if (server.hasArg("on")) agc_enabled = server.arg("on").toInt() != 0;
+
+    char json[200];
+    snprintf(json, sizeof(json),
+             "{\"on\":%d,\"gain\":%.2f,\"target\":%.1f,\"attack\":%.1f,\"release\":%.1f,\"max\":%.1f,\"limit\":%.1f}",
+             agc_enabled ? 1 : 0, agc.currentGain() / (float)AutoGain::kUnity, c.target_dbfs,
+             c.attack_ms, c.release_ms, c.max_gain_db, c.limit_dbfs);
+    server.send(200, "application/json", json);
+}
+
+// VAD state and silence-gating savings for /data
+void handleStatus() {
+    server.enableCORS(true);
+    char json[576];
+    snprintf(json, sizeof(json),
+             "{\"seq\":%lu,\"vad\":{\"active\":%d,\"db\":%.1f,\"floor\":%.1f,\"flat\":%.2f},"
+             "\"net\":{\"full\":%lu,\"heartbeats\":%lu,\"bytes_sent\":%lu,\"bytes_saved\":%lu},"
+             "\"history\":{\"s\":%.1f,\"raw_s\":%.1f,\"tier_bytes\":%u},"
+             "\"playback\":{\"on\":%d,\"gaps\":%lu,\"last_gap_ms\":%lu},"
+             "\"screen\":{\"fps\":%.1f,\"dropped\":%lu,\"flush_us\":%lu,\"bytes\":%lu,\"avg_bytes\":%lu,\"peak_bytes\":%lu,"
+             "\"full_bytes\":%lu,\"rects\":%lu,\"tiles\":%lu}}",
+             (unsigned long)chunk_seq, vad.isActive() ? 1 : 0, vad.levelDb(), vad.noiseFloorDb(),
+             vad.spectralFlatness(), (unsigned long)net_full_replies, (unsigned long)net_heartbeats,
+             (unsigned long)net_bytes_sent, (unsigned long)net_bytes_saved,
+             (float)history.samples() / record_samplerate, (float)scope_history / record_samplerate,
+             (unsigned)history.tierBytes(), player.active() ? 1 : 0, (unsigned long)player.gapCount(),
+             (unsigned long)player.gapMs(), (float)renderer.fps, (unsigned long)renderer.dropped, (unsigned long)flush_us, (unsigned long)comp.last_bytes,
+             (unsigned long)comp.avgBytes(), (unsigned long)comp.peak_bytes, (unsigned long)comp.screenBytes(),
+             (unsigned long)comp.last_rects, (unsigned long)comp.last_tiles);
+    server.send(200, "application/json", json);
+}
+
+// Serves the loudness meter readings ("?reset=1" restarts the integrated measurement)
+void handleLoudness() {
+    server.enableCORS(true);
+    if (server.hasArg("reset")) loudness.reset();
+
+    char json[160];
+    snprintf(json, sizeof(json),
+             "{\"m\":%.1f,\"s\":%.1f,\"i\":%.1f,\"tp\":%.1f,\"tpm\":%.1f}",
+             loudness.momentary(), loudness.shortTerm(), loudness.integrated(),
+             loudness.truePeak(), loudness.truePeakMomentary());
+    server.send(200, "application/json", json);
+}
+
+// Tone detector bank: "?clear=1" empties it, "?add=<Hz>&on=<dBFS>&off=<dBFS>" adds a tone.
+void handleTones() {
+    server.enableCORS(true);
+    if (server.hasArg("clear")) tones.clear();
+    if (server.hasArg("add")) {
+        float on = server.hasArg("on") ? server.arg("on").toFloat() : -40.0f;
+        float off = server.hasArg("off") ? server.arg("off").toFloat() : on - 6.0f;
+        tones.add(server.arg("add").toFloat(), on, off);
+    }
+
+    static char json[2048];
+    int len = snprintf(json, sizeof(json), "{\"now\":%lu,\"tones\":[", (unsigned long)millis());
+    for (int i = 0; i < tones.size() && len < (int)sizeof(json); i++) {
+        const ToneDetector &t = tones.tone(i);
+        len += snprintf(json + len, sizeof(json) - len,
+                        "%s{\"f\":%.1f,\"db\":%.1f,\"on\":%d,\"t\":%lu,\"hits\":%lu,\"on_db\":%.1f,\"off_db\":%.1f}",
+                        i ? "," : "", t.freq, t.level_db, t.active ? 1 : 0,
+                        (unsigned long)t.event_ms, (unsigned long)t.hits, t.on_db, t.off_db);
+    }
+    if (len < (int)sizeof(json)) snprintf(json + len, sizeof(json) - len, "]}");
+    server.send(200, "application/json", json);
+}
+
+// Tiny numeric pitch feed: every hop since "?since=<hop>" (default: latest only).
+// f0 is in Hz (0 = unvoiced), conf is the YIN confidence in percent.
+void handlePitch() {
+    server.enableCORS(true);
+    uint32_t hops = pitch.hops();
+    uint32_t oldest = (hops > PitchTracker::kResults) ? hops - PitchTracker::kResults : 0;
+    uint32_t since = server.hasArg("since") ? (uint32_t)server.arg("since").toInt() : (hops ? hops - 1 : 0);
+    if (since < oldest || since > hops) since = oldest;
+
+    static char json[1200];
+    int len = snprintf(json, sizeof(json), "{\"hop\":%lu,\"hz\":%.1f,\"f0\":[",
+                       (unsigned long)hops, (float)record_samplerate / PitchTracker::kHop);
+    for (uint32_t h = since; h < hops; h++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%.1f", (h == since) ? "" : ",", pitch.result(h).f0);
+    }
+    len += snprintf(json + len, sizeof(json) - len, "],\"conf\":[");
+    for (uint32_t h = since; h < hops; h++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s%d", (h == since) ? "" : ",",
+                        (int)(pitch.result(h).confidence * 100));
+    }
+    snprintf(json + len, sizeof(json) - len, "]}");
+    server.send(200, "application/json", json);
 }
 
 // --- INITIALIZATION HELPERS ---
 
 void setupButtons() {
-    int screenW = M5.Display.width();
+    int screenW = canvas.width();
     int btnH = 100; 
     int btnY = LAYOUT_BUTTON_Y; 
     int margin = 10;
@@ -160,9 +521,380 @@ void setupButtons() {
     for(int i=0; i<5; i++) keys[i].draw(); 
 }
 
+// Min/max/mean-square of samples [s0, s1): raw ring below 16 samples per pixel, else a pyramid level.
+// now is the sample clock of the caller's one chunk_seq snapshot; the raw ring is read relative to it.
+bool historySpan(int level, uint64_t now, uint64_t s0, uint64_t s1, EnvBin &out) {
+    if (level >= 0) return envelope.span(level, s0, s1, out);
+
+    uint64_t oldest = (now > scope_history) ? now - scope_history : 0;
+    if (s0 < oldest) s0 = oldest;
+    if (s1 > now) s1 = now;
+    if (s0 >= s1) return false;
+
+    size_t newest = ((now / record_length) % record_number) * record_length; // One past the chunk ending at now
+    size_t pos = (newest + record_size - (size_t)(now - s0)) % record_size;
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    uint64_t sum = 0;
+    for (uint64_t s = s0; s < s1; s++) {
+        int32_t v = rec_data[pos];
+        if (v < mn) mn = v;
+        if (v > mx) mx = v;
+        sum += (uint64_t)(v * v);
+        if (++pos >= record_size) pos = 0;
+    }
+    out.mn = mn;
+    out.mx = mx;
+    out.ms = (uint32_t)(sum / (s1 - s0));
+    return true;
+}
+
+// Sample clock: samples processed since boot (chunk_seq chunks)
+uint64_t sampleClock() { return (uint64_t)chunk_seq * record_length; }
+
+// Level for a view at spp samples per pixel starting at sample s0: the coarsest with a bin per pixel
+// or less (-1: raw ring), moved up to the finest whose reach still includes s0
+int historyLevel(uint64_t spp, uint64_t now, uint64_t s0) {
+    int level = EnvelopePyramid::levelFor(spp);
+    if (level < 0 && s0 >= ((now > scope_history) ? now - scope_history : 0)) return -1;
+    return envelope.covering(level < 0 ? 0 : level, s0);
+}
+
+// Runs a trigger search over the ring, ending at the newest processed chunk.
+// Timebases beyond the raw ring's reach roll (untriggered) from the envelope pyramid instead.
+bool scopeCapture(ScopeTrigger &trig, int cols, int16_t *mins, int16_t *maxs) {
+    uint32_t seq = chunk_seq; // One read: the render task runs this while capture moves on
+    if (trig.cfg.spp > scope_max_raw_spp) {
+        uint64_t now = (uint64_t)seq * record_length; // The pyramid already holds this much (pushed first)
+        uint64_t spp = trig.cfg.spp;
+        uint64_t span = (uint64_t)cols * spp;
+        int level = historyLevel(spp, now, now > span ? now - span : 0);
+        for (int c = 0; c < cols; c++) {
+            uint64_t back = (uint64_t)(cols - c) * spp;
+            EnvBin b;
+            if (back <= now && historySpan(level, now, now - back, now - back + spp, b)) {
+                mins[c] = b.mn;
+                maxs[c] = b.mx;
+            } else {
+                mins[c] = maxs[c] = 0;
+            }
+        }
+        return true;
+    }
+    size_t newest = (seq % record_number) * record_length; // Chunk seq sits at (seq - 1) % record_number
+    return trig.capture(rec_data, record_size, newest, (uint64_t)seq * record_length, scope_history,
+                        cols, mins, maxs);
+}
+
+// Triggered scope frame: "?cols=<n>&mode=0-3&edge=0|1&level=<raw>&holdoff=<ms>&tb=<samples/col>&arm=1"
+// Each column is the min/max of tb samples, "pre" is the trigger column.
+// No min/max in the reply means NORMAL/SINGLE is still waiting: keep showing the last frame.
+void handleScopeData() {
+    server.enableCORS(true);
+    static constexpr int max_cols = 512;
+    static int16_t mins[max_cols], maxs[max_cols];
+    int current_scale = currentScale();
+
+    int cols = server.hasArg("cols") ? server.arg("cols").toInt() : record_length;
+    cols = constrain(cols, 16, max_cols);
+    TriggerConfig &c = web_scope.cfg;
+    if (server.hasArg("mode")) c.mode = (TriggerMode)constrain(server.arg("mode").toInt(), TRIG_OFF, TRIG_SINGLE);
+    if (server.hasArg("edge")) c.edge = server.arg("edge").toInt() ? EDGE_FALLING : EDGE_RISING;
+    if (server.hasArg("level")) c.level = constrain(server.arg("level").toInt() / current_scale, -32767, 32767);
+    if (server.hasArg("holdoff")) c.holdoff = server.arg("holdoff").toInt() * record_samplerate / 1000;
+    if (server.hasArg("tb")) c.spp = constrain(server.arg("tb").toInt(), 1, 4096);
+    if (server.hasArg("arm")) web_scope.arm();
+
+    static char json[max_cols * 2 * 7 + 128];
+    int len = snprintf(json, sizeof(json), "{\"seq\":%lu,\"mode\":\"%s\"",
+                       (unsigned long)chunk_seq, triggerModeNames[c.mode]);
+    if (scopeCapture(web_scope, cols, mins, maxs)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"trig\":%d,\"spp\":%u,\"fs\":%u,\"pre\":%d,\"min\":[",
+                        web_scope.triggered() ? 1 : 0, c.spp, (unsigned)record_samplerate,
+                        cols / ScopeTrigger::kPreDivisor);
+        for (int i = 0; i < cols; i++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s%ld", i ? "," : "",
+                            constrain((long)mins[i] * current_scale, -32768L, 32767L));
+        }
+        len += snprintf(json + len, sizeof(json) - len, "],\"max\":[");
+        for (int i = 0; i < cols; i++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s%ld", i ? "," : "",
+                            constrain((long)maxs[i] * current_scale, -32768L, 32767L));
+        }
+        len += snprintf(json + len, sizeof(json) - len, "]");
+    }
+    snprintf(json + len, sizeof(json) - len, "}");
+    server.send(200, "application/json", json);
+}
+
+// History envelope: "?from=<sample>&to=<sample>&width=<px>" on the sample clock reported as "now"
+// ("?last=<s>" instead of from/to = the newest s seconds, default 10). Replies one [min,max,rms]
+// per pixel (null where the history no longer reaches) in O(width), whatever the range.
+void handleEnvelope() {
+    server.enableCORS(true);
+    int current_scale = currentScale();
+    uint64_t now = envelope.samples();
+    uint64_t to = server.hasArg("to") ? strtoull(server.arg("to").c_str(), nullptr, 10) : now;
+    if (to > now) to = now;
+    uint64_t last = (uint64_t)record_samplerate * (server.hasArg("last") ? server.arg("last").toInt() : 10);
+    uint64_t from = server.hasArg("from") ? strtoull(server.arg("from").c_str(), nullptr, 10)
+                                          : (to > last ? to - last : 0);
+    if (from >= to) from = (to > 0) ? to - 1 : 0;
+    int width = server.hasArg("width") ? server.arg("width").toInt() : 512;
+    width = constrain(width, 1, 2048);
+
+    uint64_t range = to - from;
+    int level = historyLevel(range / width, now, from);
+
+    // Streamed in pieces: up to 2048 triples would not fit a static reply buffer
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/json", "");
+    char buf[1024];
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"now\":%llu,\"pyramid\":%d,\"fs\":%u,\"from\":%llu,\"to\":%llu,\"bin\":%lu,\"oldest\":%llu,\"px\":[",
+                       (unsigned long long)now, envelope.enabled() ? 1 : 0, (unsigned)record_samplerate, (unsigned long long)from,
+                       (unsigned long long)to, (unsigned long)(level >= 0 ? EnvelopePyramid::factor(level) : 1),
+                       (unsigned long long)(level >= 0 ? envelope.oldest(level)
+                                                       : (now > scope_history ? now - scope_history : 0)));
+    for (int p = 0; p < width; p++) {
+        uint64_t s0 = from + range * p / width;
+        uint64_t s1 = from + range * (p + 1) / width;
+        if (s1 <= s0) s1 = s0 + 1;
+        EnvBin b;
+        if (historySpan(level, now, s0, s1, b)) {
+            len += snprintf(buf + len, sizeof(buf) - len, "%s[%ld,%ld,%ld]", p ? "," : "",
+                            constrain((long)b.mn * current_scale, -32768L, 32767L),
+                            constrain((long)b.mx * current_scale, -32768L, 32767L),
+                            constrain((long)(sqrtf((float)b.ms) * current_scale), 0L, 32767L));
+        } else {
+            len += snprintf(buf + len, sizeof(buf) - len, "%snull", p ? "," : "");
+        }
+        if (len > (int)sizeof(buf) - 64) {
+            server.sendContent(buf, len);
+            len = 0;
+        }
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "]}");
+    server.sendContent(buf, len);
+    server.sendContent("");
+}
+
+// SD recorder: "?start=1" / "?stop=1", replies with the current file and writer health
+// (write latency per block, and the smallest headroom left before a buffer would have been dropped)
+void handleRec() {
+    server.enableCORS(true);
+    if (server.hasArg("start") && sd_ready) sdrec.start();
+    if (server.hasArg("stop")) sdrec.stop();
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"sd\":%d,\"on\":%d,\"file\":\"%s\",\"segment\":%lu,\"seconds\":%.1f,\"blocks\":%lu,"
+             "\"bytes\":%llu,\"write_ms\":{\"avg\":%.1f,\"max\":%.1f},\"buffer_ms\":%.0f,"
+             "\"headroom_ms\":%.1f,\"dropped\":%lu}",
+             sd_ready ? 1 : 0, sdrec.isRecording() ? 1 : 0, sdrec.currentFile(), (unsigned long)sdrec.segment(),
+             sdrec.segmentSeconds(), (unsigned long)sdrec.blocksWritten(), (unsigned long long)sdrec.bytesWritten(),
+             sdrec.avgWriteMs(), sdrec.maxWriteMs(), sdrec.bufferMs(), sdrec.minHeadroomMs(),
+             (unsigned long)sdrec.droppedSamples());
+    server.send(200, "application/json", json);
+}
+
+// Event capture: "?trigger=1" marks an event now; "?pre=<s>&post=<s>" set the window,
+// "?level=<dBFS peak, 0 = off>" and "?tones=<bit mask>" the automatic triggers.
+void handleEvent() {
+    server.enableCORS(true);
+    EventConfig &c = events.cfg;
+    if (server.hasArg("pre"))    c.pre_s = constrain(server.arg("pre").toFloat(), 0.0f, events.maxPreSeconds());
+    if (server.hasArg("post"))   c.post_s = constrain(server.arg("post").toFloat(), 0.0f, EventRecorder::kMaxEventSeconds);
+    if (server.hasArg("level"))  c.level_dbfs = server.arg("level").toFloat();
+    if (server.hasArg("tones"))  c.tone_mask = (uint16_t)server.arg("tones").toInt();
+    bool queued = server.hasArg("trigger") && sd_ready && events.trigger(EVT_HTTP);
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"sd\":%d,\"queued\":%d,\"pre\":%.1f,\"max_pre\":%.1f,\"post\":%.1f,\"level\":%.1f,\"tones\":%u,"
+             "\"events\":%lu,\"writing\":%d,\"file\":\"%s\",\"lost\":%lu,\"missed\":%lu,\"headroom_ms\":%.0f}",
+             sd_ready ? 1 : 0, queued ? 1 : 0, c.pre_s, events.maxPreSeconds(), c.post_s, c.level_dbfs,
+             c.tone_mask, (unsigned long)events.events(), events.isWriting() ? 1 : 0, events.lastFile(),
+             (unsigned long)events.lostSamples(), (unsigned long)events.missedTriggers(), events.minHeadroomMs());
+    server.send(200, "application/json", json);
+}
+
+// WAV download of the RAM ring, oldest first: "?seconds=<s>" (default: all there is), "?freeze=1"
+// keeps the mic from recording over the requested span until it is sent (allows the full ring).
+// Samples are sent as stored (after AGC, before the manual SF); the transfer runs from loop().
+void handleCaptureWav() {
+    if (ringStream.active()) {
+        server.send(503, "text/plain", "Busy: one capture download at a time");
+        return;
+    }
+    bool freeze = server.hasArg("freeze") && server.arg("freeze").toInt() != 0;
+    uint64_t now = sampleClock();
+    uint64_t want = ringStream.maxSamples(freeze);
+    if (server.hasArg("seconds")) {
+        uint64_t s = (uint64_t)(server.arg("seconds").toFloat() * record_samplerate);
+        if (s > 0 && s < want) want = s;
+    }
+    if (want > now) want = now;
+    if (!ringStream.start(server.client(), now - want, now, freeze, "capture.wav")) {
+        server.send(503, "text/plain", "Nothing recorded yet");
+    }
+}
+
+// SD archive: no arguments -> JSON with the extent of the index on the archive clock ("now" is
+// the live position); "?from=<t>&to=<t>" -> WAV of that span (unrecorded holes as silence),
+// seekable with HTTP Range, so only the bytes a player asks for are read. The transfer runs
+// from loop(). "to" defaults to the end of the archive, "from" to one minute before "to".
+void handleArchive() {
+    server.enableCORS(true);
+    uint64_t first = 0, last = 0;
+    bool any = sd_ready && archive.extent(first, last);
+    if (!server.hasArg("from") && !server.hasArg("to")) {
+        char json[256];
+        snprintf(json, sizeof(json),
+                 "{\"sd\":%d,\"now\":%llu,\"fs\":%u,\"first\":%llu,\"end\":%llu,\"entries\":%lu,\"recording\":%d,"
+                 "\"busy\":%d,\"read_ms_max\":%lu}",
+                 sd_ready ? 1 : 0, (unsigned long long)sdrec.archiveTime(sampleClock()), (unsigned)record_samplerate,
+                 (unsigned long long)first, (unsigned long long)last, (unsigned long)archive.entries(),
+                 sdrec.isRecording() ? 1 : 0, archive.active() ? 1 : 0, (unsigned long)archive.maxReadMs());
+        server.send(200, "application/json", json);
+        return;
+    }
+    if (!any) {
+        server.send(404, "text/plain", "Archive is empty");
+        return;
+    }
+    if (archive.active()) {
+        server.send(503, "text/plain", "Busy: one archive download at a time");
+        return;
+    }
+
+    static constexpr uint64_t max_span = (UINT32_MAX - kWavHeaderBytes) / sizeof(int16_t); // WAV sizes are 32-bit
+    uint64_t to = server.hasArg("to") ? strtoull(server.arg("to").c_str(), nullptr, 10) : last;
+    uint64_t from = server.hasArg("from") ? strtoull(server.arg("from").c_str(), nullptr, 10)
+                                          : (to > 60 * record_samplerate ? to - 60 * record_samplerate : 0);
+    if (to <= from) {
+        server.send(400, "text/plain", "Empty span");
+        return;
+    }
+    if (to - from > max_span) to = from + max_span;
+
+    // "Range: bytes=a-b", "bytes=a-" or "bytes=-n" on the WAV file (header included)
+    uint64_t total = ArchiveStream::fileBytes(to - from);
+    uint64_t r0 = 0, r1 = total - 1;
+    bool partial = false;
+    String range = server.header("Range");
+    if (range.startsWith("bytes=")) {
+        const char *spec = range.c_str() + 6;
+        char *rest;
+        if (*spec == '-') {
+            uint64_t n = strtoull(spec + 1, nullptr, 10);
+            r0 = (n < total) ? total - n : 0;
+        } else {
+            r0 = strtoull(spec, &rest, 10);
+            if (*rest == '-' && rest[1]) r1 = strtoull(rest + 1, nullptr, 10);
+        }
+        if (r1 >= total) r1 = total - 1;
+        if (r0 > r1) {
+            char cr[48];
+            snprintf(cr, sizeof(cr), "bytes */%llu", (unsigned long long)total);
+            server.sendHeader("Content-Range", cr);
+            server.send(416, "text/plain", "Range not satisfiable");
+            return;
+        }
+        partial = true;
+    }
+    if (!archive.start(server.client(), from, to, partial, r0, r1)) {
+        server.send(500, "text/plain", "Cannot open the archive index");
+    }
+}
+
+// Boot timing and WiFi cache: per-phase breakdown (ms since power-on / since the previous phase)
+// and how WiFi came up. "?static=1|0" reuses the last lease as a static IP from the next boot,
+// "?forget=1" drops the cached AP so the next boot scans.
+void handleBoot() {
+    server.enableCORS(true);
+    if (server.hasArg("static")) wifiBoot.setStaticIp(server.arg("static").toInt() != 0);
+    if (server.hasArg("forget")) wifiBoot.forget();
+
+    char json[768];
+    int len = snprintf(json, sizeof(json), "{\"phases\":");
+    len += boot.json(json + len, sizeof(json) - len);
+    len += snprintf(json + len, sizeof(json) - len, ",\"wifi\":");
+    len += wifiBoot.json(json + len, sizeof(json) - len);
+    snprintf(json + len, sizeof(json) - len, "}");
+    server.send(200, "application/json", json);
+}
+
+// Screen pacing: "?fps=<1-120>" sets the target frame rate, "?reset=1" clears the counters.
+// Replies the achieved rate, render time per frame (avg/max/last, us, including the flush) and
+// frames dropped because a frame overran its slot.
+void handleRender() {
+    server.enableCORS(true);
+    if (server.hasArg("fps")) renderer.setFps(server.arg("fps").toInt());
+    if (server.hasArg("reset")) renderer.resetStats();
+
+    char json[224];
+    snprintf(json, sizeof(json),
+             "{\"target_fps\":%u,\"fps\":%.1f,\"frames\":%lu,\"dropped\":%lu,\"render_us\":%lu,"
+             "\"max_render_us\":%lu,\"last_render_us\":%lu,\"flush_us\":%lu}",
+             renderer.targetFps(), (float)renderer.fps, (unsigned long)renderer.frames,
+             (unsigned long)renderer.dropped, (unsigned long)renderer.avgUs(), (unsigned long)renderer.max_us,
+             (unsigned long)renderer.last_us, (unsigned long)flush_us);
+    server.send(200, "application/json", json);
+}
+
+// Capture filter chain: "?dc=0|1&hp=<Hz, 0 = off>&eq=0|1" (eq=1 reloads /mic_eq.txt)
+void handleFilter() {
+    server.enableCORS(true);
+    if (server.hasArg("dc")) micFilter.dc_enabled = server.arg("dc").toInt() != 0;
+    if (server.hasArg("hp")) micFilter.setHighPass(server.arg("hp").toFloat());
+    if (server.hasArg("eq")) {
+        if (server.arg("eq").toInt()) loadMicEq();
+        else micFilter.clearFir();
+    }
+
+    char json[80];
+    snprintf(json, sizeof(json), "{\"dc\":%d,\"hp\":%.1f,\"eq_taps\":%d}",
+             micFilter.dc_enabled ? 1 : 0, micFilter.highPassHz(), micFilter.firTaps());
+    server.send(200, "application/json", json);
+}
+
+// Reads the tone bank from "/tones.txt" (one "<Hz> [on_dBFS] [off_dBFS]" per line)
+void loadTones() {
+    File file = SD.open("/tones.txt");
+    if (!file) return;
+    while (file.available()) {
+        String line = file.readStringUntil('\n');
+        tones.parseLine(line.c_str());
+    }
+    file.close();
+}
+
+// Reads mic-response correction taps from "/mic_eq.txt" (numbers separated by spaces, commas or newlines)
+void loadMicEq() {
+    File file = SD.open("/mic_eq.txt");
+    if (!file) return;
+    float taps[CaptureFilter::kMaxTaps];
+    int n = 0;
+    while (file.available() && n < CaptureFilter::kMaxTaps) {
+        String tok = file.readStringUntil(',');
+        tok.trim();
+        // Tokens may still hold several whitespace separated values
+        const char *p = tok.c_str();
+        char *end;
+        for (float v = strtof(p, &end); end != p && n < CaptureFilter::kMaxTaps; v = strtof(p, &end)) {
+            taps[n++] = v;
+            p = end;
+        }
+    }
+    file.close();
+    micFilter.setFir(taps, n);
+}
+
 void loadConfig() {
     // Attempt to read WiFi credentials from SD card
-    SD.begin();
+    sd_ready = SD.begin();
+    loadTones();
+    loadMicEq();
     File file = SD.open("/config.txt"); 
     if (file) {
         if (file.available()) {
@@ -182,18 +914,81 @@ void loadConfig() {
 // Completely black out the visualizer area and reset "previous" buffers
 // This is necessary when switching modes to prevent "ghost" pixels
 void clearVisualizerArea() {
-    M5.Display.fillRect(0, LAYOUT_VISUALIZER_TOP, 1280, LAYOUT_VISUALIZER_HEIGHT, BLACK);
+    canvas.fillRect(0, LAYOUT_VISUALIZER_TOP, 1280, LAYOUT_VISUALIZER_HEIGHT, BLACK);
+    comp.mark(0, LAYOUT_VISUALIZER_TOP, 1280, LAYOUT_VISUALIZER_HEIGHT);
     memset(prev_y, 0, sizeof(prev_y));
     memset(prev_h, 0, sizeof(prev_h));
     prev_vu_w[0] = 0; prev_vu_w[1] = 0;
-    memset(prev_spec_y, 0, sizeof(prev_spec_y));
+    for (int i = 0; i < FFT_BARS; i++) prev_spec_y[i] = LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT; // Regrow from the floor
+    pitch_x = 0;
+    pitch_drawn_hop = pitch.hops();
+    wf_y = LAYOUT_VISUALIZER_TOP;
+    waterfall.flush();
+    memset(phos_lit, 1, sizeof(phos_lit)); // Area is black now: repaint every phosphor row
+}
+
+// --- CAPTURE PROCESSING ---
+// Runs once on every completed chunk, before it is drawn or served.
+// Analysis stages that must see every sample (not just drawn frames) live here.
+void processChunk(int16_t *data) {
+    TRACE_SCOPE("dsp");
+    // Clean-up first, written back into the ring, so every consumer below shares it
+    micFilter.process(data, record_length);
+
+    loudness.process(data, record_length);
+    uint16_t tone_onsets = tones.process(data, record_length, millis());
+    pitch.process(data, record_length);
+    if (visualMode == 4) waterfall.process(data, record_length); // Every chunk is a row, drawn or not
+    if (visualMode == 5) phosphor.process(data, record_length, currentScale()); // Every chunk is traced
+
+    // Stream health for /metrics: gaps between chunks (not the playback pause), and whether the
+    // chunk this one overwrites ever reached a /data client
+    static uint32_t last_chunk_us = 0;
+    const uint32_t period_us = record_length * 1000000UL / record_samplerate;
+    uint32_t now_us = micros();
+    if (last_chunk_us && !mic_resumed && now_us - last_chunk_us > 2 * period_us)
+        chunks_dropped.fetch_add((now_us - last_chunk_us) / period_us - 1, std::memory_order_relaxed);
+    last_chunk_us = now_us;
+    if (chunk_seq >= record_number && !(rec_flags[draw_record_idx] & CHUNK_READ) && millis() - last_data_ms < 2000)
+        chunks_unread.fetch_add(1, std::memory_order_relaxed);
+
+    rec_flags[draw_record_idx] = vad.process(data, record_length) ? CHUNK_ACTIVE : 0;
+    if (mic_resumed) { // Samples before this one are from before the pause: say so in /data
+        rec_flags[draw_record_idx] |= CHUNK_GAP;
+        mic_resumed = false;
+    }
+
+    // AGC runs last: the analysis above sees the raw mic, everything downstream the levelled signal.
+    // In manual mode the SF is applied later (display / /data), so report it as the chunk gain.
+    if (agc_enabled) rec_gain[draw_record_idx] = agc.process(data, record_length) >> 8;
+    else rec_gain[draw_record_idx] = scale_factors[scale_idx] << 8;
+    envelope.push(data, record_length); // History pyramid gets exactly what the ring holds
+    sdrec.push(data, record_length, sampleClock()); // memcpy into the SD double buffer, never waits on the card
+    ready_record_idx = draw_record_idx;
+    chunk_seq++;
+    TRACE_INSTANT("chunk", chunk_seq);
+    if (chunk_seq == 1) boot.mark("first_chunk");
+    history.push(chunk_seq);             // Compresses the chunk leaving the raw window (if the tier is on)
+    events.process(data, record_length); // Advances the event clock, checks the level trigger
+    if (tone_onsets & events.cfg.tone_mask) events.trigger(EVT_TONE);
+}
+
+// Tone indicators: one lamp per configured tone at the right end of the status bar
+void drawToneIndicators() {
+    uint16_t mask = tones.activeMask();
+    for (int i = 0; i < tones.size(); i++) {
+        int x = 1280 - 16 - (tones.size() - i) * 22;
+        canvas.fillRoundRect(x, 15, 18, 20, 4, (mask & (1u << i)) ? ORANGE : 0x4208);
+    }
+    comp.mark(1280 - 16 - tones.size() * 22, 15, tones.size() * 22, 20);
+    drawn_tone_mask = mask;
 }
 
 // --- VISUALIZATION ENGINES ---
 
 // 1. WAVEFORM RENDERER
-// Draws the raw audio signal as a vertical bar graph.
-void drawWaveform(int16_t *data) {
+// Draws the triggered scope frame as a vertical bar graph (one min..max bar per column).
+void drawWaveform(const int16_t *mins, const int16_t *maxs) {
     int32_t midY = (LAYOUT_VISUALIZER_TOP + (LAYOUT_VISUALIZER_HEIGHT / 2));
     int32_t bar_width = 1280 / record_length; // Should be exactly 5px
     int shift = 6; // Bit-shift division for scaling raw audio
@@ -204,60 +999,49 @@ void drawWaveform(int16_t *data) {
         
         // 1. Erase the previous frame's bar at this position (Dirty Rect)
         // This is much faster than clearing the whole screen.
-        M5.Display.writeFastVLine(x_pos, prev_y[i], prev_h[i], BLACK); 
-        if(bar_width > 1) M5.Display.fillRect(x_pos, prev_y[i], bar_width, prev_h[i], BLACK); 
+        canvas.writeFastVLine(x_pos, prev_y[i], prev_h[i], BLACK); 
+        if(bar_width > 1) canvas.fillRect(x_pos, prev_y[i], bar_width, prev_h[i], BLACK); 
 
-        // 2. Calculate new bar height based on audio data
-        int32_t y1 = (data[i] >> shift) * scale_factors[scale_idx];
-        int32_t y2;
-        
-        // Use next sample to connect lines, or same sample if at end
-        if (i < record_length - 1) {
-             y2 = (data[i + 1] >> shift) * scale_factors[scale_idx]; 
-        } else {
-             y2 = y1;
-        }
-
-        // Sort y1/y2 so y1 is always top, y2 is bottom (for height calc)
-        if (y1 > y2) { int32_t tmp = y1; y1 = y2; y2 = tmp; } 
+        // 2. Calculate new bar extent from the column's min/max
+        // (each column already includes the next column's first sample, so the trace connects)
+        int32_t y1 = (mins[i] >> shift) * currentScale();
+        int32_t y2 = (maxs[i] >> shift) * currentScale();
         
         int32_t y = midY + y1;
         int32_t h = midY + y2 + 1 - y; 
 
         // 3. Clamp values to stay inside Visualizer Area
-        if (y < LAYOUT_VISUALIZER_TOP) y = LAYOUT_VISUALIZER_TOP; 
+        if (y < LAYOUT_VISUALIZER_TOP) { h -= LAYOUT_VISUALIZER_TOP - y; y = LAYOUT_VISUALIZER_TOP; }
         if ((y + h) > maxY) h = maxY - y;
         if (h < 0) h = 0; 
 
-        // 4. Store current state for next frame's erasure
+        // 4. Mark old + new extent for the compositor (unchanged bars push nothing)
+        if (y != prev_y[i] || h != prev_h[i]) {
+            int32_t top = (y < prev_y[i]) ? y : prev_y[i];
+            int32_t bot = (y + h > prev_y[i] + prev_h[i]) ? y + h : prev_y[i] + prev_h[i];
+            comp.mark(x_pos, top, bar_width, bot - top);
+        }
+
+        // 5. Store current state for next frame's erasure
         prev_y[i] = y;
         prev_h[i] = h; 
         
-        // 5. Draw the new bar (White)
-        if (bar_width > 1) M5.Display.fillRect(x_pos, y, bar_width, h, WHITE);
-        else M5.Display.writeFastVLine(x_pos, y, h, WHITE); 
+        // 6. Draw the new bar (White)
+        if (bar_width > 1) canvas.fillRect(x_pos, y, bar_width, h, WHITE);
+        else canvas.writeFastVLine(x_pos, y, h, WHITE); 
     }
 }
 
 // 2. VU METER RENDERER
 // Draws two horizontal bars. Top = Peak Volume, Bottom = Average Volume.
 void drawVUMeter(int16_t *data) {
-    long sum = 0;
-    int peak = 0;
-    for(int i=0; i<record_length; i++) {
-        int val = abs(data[i]);
-        if(val > peak) peak = val;
-        sum += val;
-    }
-    int avg = sum / record_length;
+    VuLevel vu = vuMeasure(data, record_length);
+    auto mark = [](int x, int y, int w, int h) { comp.mark(x, y, w, h); };
 
     // --- 1. SENSITIVITY ADJUSTMENT ---
-    // Using your requested "/ 10" to prevent hitting the screen edge
-    int w_top = (peak * scale_factors[scale_idx]) / 10; 
-    int w_bot = (avg * scale_factors[scale_idx]) / 5; 
-
-    if (w_top > 1280) w_top = 1280;
-    if (w_bot > 1280) w_bot = 1280;
+    // Full width at peak 12800 / average 6400 (the old "/ 10" and "/ 5") to prevent hitting the screen edge
+    int w_top = vuWidth(vu.peak, currentScale(), 1280, 12800);
+    int w_bot = vuWidth(vu.avg, currentScale(), 1280, 6400);
 
     int midY = LAYOUT_VISUALIZER_TOP + (LAYOUT_VISUALIZER_HEIGHT / 2);
     
@@ -265,93 +1049,333 @@ void drawVUMeter(int16_t *data) {
     int barHeight = 200; 
     int gap = 20;
 
-    // --- DRAW TOP BAR ---
+    // --- DRAW BARS (only the part that changed) ---
     int y1 = midY - gap - barHeight;
-    if (w_top > prev_vu_w[0]) {
-        M5.Display.fillRect(prev_vu_w[0], y1, w_top - prev_vu_w[0], barHeight, WHITE);
-    } else if (w_top < prev_vu_w[0]) {
-        M5.Display.fillRect(w_top, y1, prev_vu_w[0] - w_top, barHeight, BLACK);
-    }
-    prev_vu_w[0] = w_top;
-
-    // --- DRAW BOTTOM BAR ---
     int y2 = midY + gap;
-    if (w_bot > prev_vu_w[1]) {
-        M5.Display.fillRect(prev_vu_w[1], y2, w_bot - prev_vu_w[1], barHeight, WHITE);
-    } else if (w_bot < prev_vu_w[1]) {
-        M5.Display.fillRect(w_bot, y2, prev_vu_w[1] - w_bot, barHeight, BLACK);
-    }
-    prev_vu_w[1] = w_bot;
+    vizDrawHBar(canvas, 0, y1, w_top, barHeight, prev_vu_w[0], WHITE, BLACK, mark);
+    vizDrawHBar(canvas, 0, y2, w_bot, barHeight, prev_vu_w[1], WHITE, BLACK, mark);
 
     // --- LABELS (FIXED CENTERING) ---
-    M5.Display.setTextSize(3);
+    // (Redrawn into the canvas every frame; they only reach the panel when a bar change
+    // above marked their tiles)
+    canvas.setTextSize(3);
     // Use Dark Grey so it's readable against the White bar
-    M5.Display.setTextColor(DARKGREY); 
+    canvas.setTextColor(DARKGREY); 
     
     // "middle_left" anchors the text vertically in the middle
-    M5.Display.setTextDatum(middle_left); 
+    canvas.setTextDatum(middle_left); 
     
     // Draw PEAK (Calculated center: y1 + half height)
-    M5.Display.drawString("PEAK", 20, y1 + (barHeight / 2));
+    canvas.drawString("PEAK", 20, y1 + (barHeight / 2));
     
     // Draw AVG (Calculated center: y2 + half height)
-    M5.Display.drawString("AVG", 20, y2 + (barHeight / 2));
+    canvas.drawString("AVG", 20, y2 + (barHeight / 2));
     
     // Reset Datum and Color for other parts of the app
-    M5.Display.setTextDatum(top_center); 
-    M5.Display.setTextColor(WHITE);
+    canvas.setTextDatum(top_center); 
+    canvas.setTextColor(WHITE);
 }
 
 // 3. SPECTRUM RENDERER
-// Uses FFT to break audio into frequencies and display 64 bars.
+// Fixed-point FFT (viz.h) of the chunk into 64 bars, 72 dB from floor to top.
 void drawSpectrum(int16_t *data) {
-    // 1. Prepare FFT Data (Copy raw audio to real array)
-    for (int i = 0; i < FFT_SAMPLES; i++) {
-        vReal[i] = (double)data[i];
-        vImag[i] = 0; // Imaginary part is 0 for raw audio
+    uint8_t levels[FFT_BARS];
+    spectrum.analyze(data, record_length, currentScale(), levels, FFT_BARS);
+
+    // Render Bars: 20px per bar, only the part of each bar that moved (Dirty Pixel)
+    int barWidth = 1280 / FFT_BARS;
+    int bottomY = LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT;
+    vizDrawBars(canvas, 0, bottomY, LAYOUT_VISUALIZER_HEIGHT, barWidth, 2, levels, FFT_BARS, prev_spec_y, WHITE, BLACK,
+                [](int x, int y, int w, int h) { comp.mark(x, y, w, h); });
+}
+
+// 4. PITCH RENDERER
+// Plots f0 per hop on a log frequency axis (50 Hz bottom, 1600 Hz top), sweeping
+// across the screen like a chart recorder. Brightness follows YIN confidence.
+int32_t pitchToY(float f0) {
+    const float lo = log2f(50.0f), hi = log2f(1600.0f);
+    float t = (log2f(f0) - lo) / (hi - lo);
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    return LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT - 1 - (int32_t)(t * (LAYOUT_VISUALIZER_HEIGHT - 1));
+}
+
+void drawPitch() {
+    static const char *notes[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    const int colW = 2;
+    uint32_t hops = pitch.hops();
+    if (hops - pitch_drawn_hop > 64) pitch_drawn_hop = hops - 64; // Fell behind: skip ahead
+
+    for (; pitch_drawn_hop < hops; pitch_drawn_hop++) {
+        PitchResult r = pitch.result(pitch_drawn_hop);
+
+        // Clear this column and a cursor gap ahead of it, then redraw octave grid (A2..A5)
+        canvas.fillRect(pitch_x, LAYOUT_VISUALIZER_TOP, colW * 4, LAYOUT_VISUALIZER_HEIGHT, BLACK);
+        for (float g = 110.0f; g <= 880.0f; g *= 2) {
+            canvas.writeFastHLine(pitch_x, pitchToY(g), colW * 4, 0x2104);
+        }
+        if (r.f0 > 0) {
+            uint8_t c = 64 + (uint8_t)(r.confidence * 191);
+            canvas.fillRect(pitch_x, pitchToY(r.f0) - 2, colW, 5, canvas.color565(c, c, 0));
+        }
+        comp.mark(pitch_x, LAYOUT_VISUALIZER_TOP, colW * 4, LAYOUT_VISUALIZER_HEIGHT);
+        pitch_x += colW;
+        if (pitch_x >= 1280) pitch_x = 0;
     }
 
-    // 2. Perform FFT (arduinoFFT v2.x syntax)
-    FFT.windowing(FFTWindow::Hamming, FFTDirection::Forward); // Apply windowing to reduce leakage
-    FFT.compute(FFTDirection::Forward);                       // Compute FFT
-    FFT.complexToMagnitude();                                 // Convert to usable magnitude
+    // Numeric readout (top-left of the visualizer)
+    PitchResult r = pitch.latest();
+    canvas.fillRect(10, LAYOUT_VISUALIZER_TOP + 10, 330, 40, BLACK);
+    comp.mark(10, LAYOUT_VISUALIZER_TOP + 10, 330, 40);
+    canvas.setTextSize(3);
+    canvas.setTextDatum(top_left);
+    canvas.setTextColor(WHITE);
+    if (r.f0 > 0) {
+        int midi = (int)lroundf(69 + 12 * log2f(r.f0 / 440.0f));
+        char txt[40];
+        snprintf(txt, sizeof(txt), "%.1f Hz  %s%d  %d%%", r.f0, notes[(midi + 1200) % 12], midi / 12 - 1,
+                 (int)(r.confidence * 100));
+        canvas.drawString(txt, 10, LAYOUT_VISUALIZER_TOP + 10);
+    } else {
+        canvas.drawString("-- Hz", 10, LAYOUT_VISUALIZER_TOP + 10);
+    }
+    canvas.setTextDatum(top_center);
+}
 
-    // 3. Render Bars
-    int barWidth = 1280 / FFT_BARS; // 20px per bar
-    int bottomY = LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT;
-    
-    // Loop through the 64 display bars
-    for (int i = 0; i < FFT_BARS; i++) {
-        // We combine 2 bins per bar (128 usable bins -> 64 bars)
-        // (vReal[i*2] + vReal[i*2+1]) / 2.0 is a simple average
-        double val = (vReal[i*2] + vReal[i*2+1]) / 2.0; 
-        
-        // Scale height
-        int h = (int)(val * scale_factors[scale_idx] * 0.05); 
-        if (h > LAYOUT_VISUALIZER_HEIGHT) h = LAYOUT_VISUALIZER_HEIGHT;
+// Writes every queued spectrogram row into the canvas at the sweep line, low bins on the left.
+// The panel cannot scroll, so nothing moves: rows land at wf_y, which wraps inside the
+// visualizer, and a black gap ahead of it marks "now". Each row is written once, straight into
+// the canvas memory through the palette (1 load per bin), and only those rows are marked dirty.
+void drawWaterfall() {
+    const int binW = 1280 / Waterfall::kBins; // 10 px per bin
+    const int gap = 8;
+    const int bottom = LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT;
+    uint16_t *fb = (uint16_t *)canvas.getBuffer();
+    const uint8_t *row;
+    while ((row = waterfall.peek()) != nullptr) {
+        uint16_t *dst = fb + wf_y * 1280;
+        for (int k = 0; k < Waterfall::kBins; k++) {
+            uint16_t c = palette[row[k]];
+            for (int i = 0; i < binW; i++) *dst++ = c;
+        }
+        waterfall.release(); // Row is in the canvas: the capture side may reuse its slot
+        comp.mark(0, wf_y, 1280, 1);
+        wf_y++;
+        if (wf_y >= bottom) wf_y = LAYOUT_VISUALIZER_TOP;
+
+        // Cursor gap (may wrap to the top)
+        int g1 = (bottom - wf_y < gap) ? bottom - wf_y : gap;
+        memset(fb + wf_y * 1280, 0, g1 * 1280 * sizeof(uint16_t));
+        comp.mark(0, wf_y, 1280, g1);
+        if (g1 < gap) {
+            memset(fb + LAYOUT_VISUALIZER_TOP * 1280, 0, (gap - g1) * 1280 * sizeof(uint16_t));
+            comp.mark(0, LAYOUT_VISUALIZER_TOP, 1280, gap - g1);
+        }
+    }
+}
 
-        int x = i * barWidth;
-        int y = bottomY - h; // Top Y position of the bar
+// Colour-maps the phosphor buffer into the visualizer (5x4 px per cell). Rows that were dark on
+// the last frame and are still dark are skipped, so a quiet input costs almost nothing to push.
+void drawPhosphor() {
+    const int cellW = 1280 / Phosphor::kCols, cellH = LAYOUT_VISUALIZER_HEIGHT / Phosphor::kRows;
+    uint16_t *fb = (uint16_t *)canvas.getBuffer();
+    static uint16_t line[1280];
+    for (int r = 0; r < Phosphor::kRows; r++) {
+        const uint8_t *src = phosphor.row(r);
+        uint8_t any = 0;
+        for (int c = 0; c < Phosphor::kCols; c++) any |= src[c];
+        if (!any && !phos_lit[r]) continue;
+        phos_lit[r] = any != 0;
 
-        // Optimized Drawing (Dirty Pixel)
-        int prev_y = prev_spec_y[i];
-        
-        if (y < prev_y) {
-            // Bar got taller: Draw White from new Top down to old Top
-            M5.Display.fillRect(x, y, barWidth - 2, prev_y - y, WHITE);
-        } else if (y > prev_y) {
-            // Bar got shorter: Draw Black from old Top down to new Top
-            M5.Display.fillRect(x, prev_y, barWidth - 2, y - prev_y, BLACK);
+        uint16_t *dst = line;
+        for (int c = 0; c < Phosphor::kCols; c++) {
+            uint16_t v = palette[src[c]];
+            for (int i = 0; i < cellW; i++) *dst++ = v;
         }
-        
-        prev_spec_y[i] = y; // Save state
+        int y = LAYOUT_VISUALIZER_TOP + r * cellH;
+        for (int i = 0; i < cellH; i++) memcpy(fb + (y + i) * 1280, line, sizeof(line));
+        comp.mark(0, y, 1280, cellH);
+    }
+}
+
+// Stage timing table (us), refreshed twice a second
+void drawProfile() {
+    static unsigned long last = 0;
+    if (last && millis() - last < 500) return;
+    last = millis();
+
+    const int x = 40, y0 = LAYOUT_VISUALIZER_TOP + 40, rowH = 44;
+    canvas.fillRect(x, y0, 1200, rowH * (PROF_STAGES + 1), BLACK);
+    comp.mark(x, y0, 1200, rowH * (PROF_STAGES + 1));
+    canvas.setTextSize(3);
+    canvas.setTextDatum(top_left);
+    canvas.setTextColor(LIGHTGREY);
+    char line[96];
+    snprintf(line, sizeof(line), "%-8s %8s %7s %7s %7s %8s %7s", "STAGE", "N", "P50", "P95", "P99", "MAX", "MEAN");
+    canvas.drawString(line, x, y0);
+    canvas.setTextColor(WHITE);
+    for (int s = 0; s < PROF_STAGES; s++) {
+        const StageHistogram &h = profiler.stage((ProfStage)s);
+        snprintf(line, sizeof(line), "%-8s %8lu %7lu %7lu %7lu %8lu %7lu", profStageNames[s], (unsigned long)h.count(),
+                 (unsigned long)h.percentile(50), (unsigned long)h.percentile(95), (unsigned long)h.percentile(99),
+                 (unsigned long)h.maxUs(), (unsigned long)h.meanUs());
+        canvas.drawString(line, x, y0 + rowH * (s + 1));
+    }
+    canvas.setTextDatum(top_center);
+}
+
+// --- SCREEN FLUSH ---
+// Pushes the dirty tiles of the canvas to the panel (merged into rectangles); once per loop pass
+void flushScreen() {
+    if (!comp.pending()) return;
+    TRACE_SCOPE("flush");
+    unsigned long t = micros();
+    M5.Display.startWrite();
+    comp.flush([](int x, int y, int w, int h) {
+        M5.Display.setClipRect(x, y, w, h); // pushSprite copies only the clipped part of the canvas
+        canvas.pushSprite(&M5.Display, 0, 0);
+    });
+    M5.Display.clearClipRect();
+    M5.Display.endWrite();
+    flush_us = micros() - t;
+}
+
+// Centre toast for 600 ms; the render task keeps it on top of the visualizer and clears the
+// visualizer when it expires (loop() no longer stops for it)
+void showToast(uint16_t color, const char *text) {
+    toast_color = color;
+    snprintf(toast_text, sizeof(toast_text), "%s", text);
+    toast_until = millis() + 600;
+}
+
+// Draws the toast / PLAYING banner into the canvas (after the visualizer, so it stays on top)
+void drawToasts(bool force) {
+    static bool playing_drawn = false;
+    if (player.active()) {
+        if (force || !playing_drawn) {
+            canvas.fillRect(400, 250, 480, 100, RED);
+            canvas.setTextColor(WHITE);
+            canvas.setTextDatum(middle_center);
+            canvas.drawString("PLAYING AUDIO...", 640, 300);
+            canvas.setTextDatum(top_center);
+            comp.mark(400, 250, 480, 100);
+            playing_drawn = true;
+        }
+        return;
+    }
+    playing_drawn = false;
+    if (!toast_until) return;
+    if (millis() > toast_until) {
+        toast_until = 0;
+        clearVisualizerArea(); // Visualizer redraws itself without the toast
+        return;
+    }
+    canvas.fillRect(400, 300, 480, 60, toast_color);
+    canvas.drawString(toast_text, 640, 320);
+    comp.mark(400, 300, 480, 60);
+}
+
+// --- RENDER TASK ---
+// One frame: visualizer for the newest chunk (if one arrived since the last frame), toasts,
+// status bar, tone lamps, then push the dirty tiles. Chunks in between are never drawn.
+void renderFrame() {
+    if (!canvas_ok) return; // No frame to draw into (the waterfall / phosphor write its raw buffer)
+    ProfileScope prof(profiler, PROF_DRAW); // Lock wait and screen flush included
+    TRACE_SCOPE("draw");
+    static uint32_t drawn_seq = 0;
+    renderer.lock();
+
+    uint32_t seq = chunk_seq;
+    bool drew = false;
+    if (seq != drawn_seq && seq > 0) {
+        const int16_t *data = &rec_data[((seq - 1) % record_number) * record_length]; // Newest chunk
+        drawn_seq = seq;
+        drew = true;
+        // CANVAS CLIPPING:
+        // Crucial!
+        // This tells the canvas to IGNORE any drawing attempts
+        // outside the visualizer box.
+        // This prevents the waveform from
+        // accidentally drawing over the status bar or buttons.
+        canvas.setClipRect(0, LAYOUT_VISUALIZER_TOP, 1280, LAYOUT_VISUALIZER_HEIGHT);
+
+        // Execute the selected visualizer
+        switch (visualMode)
+        {
+        case 0:
+            // NORMAL/SINGLE keep the last frame on screen until the trigger fires
+            if (scopeCapture(scope, record_length, scope_min, scope_max)) drawWaveform(scope_min, scope_max);
+            break;
+        case 1: drawVUMeter((int16_t *)data); 
+            break;
+        case 2: drawSpectrum((int16_t *)data); 
+            break;
+        case 3: drawPitch();
+            break;
+        case 4: drawWaterfall();
+            break;
+        case 5: drawPhosphor();
+            break;
+        case 6: drawProfile();
+            break;
+        }
+
+        canvas.clearClipRect(); // Disable clipping
     }
+    drawToasts(drew);
+
+    // --- STATUS BAR UPDATE (Top of Screen) ---
+    // We only update this every 500ms to save CPU and reduce flicker
+    static unsigned long last_stat = 0;
+    if(millis() - last_stat > 500) {  
+         int bat = bat_level;
+         IPAddress ip = WiFi.localIP();
+         
+         // Calculate approx CPU load based on frame budget (40ms target)
+         int load = (max_loop_time * 100) / 40;
+         
+         // Status line (UPDATED WITH SCALE FACTOR), formatted into a fixed buffer: no String per update
+         char scl[8], trig[16] = "";
+         if (agc_enabled) snprintf(scl, sizeof(scl), "AGC");
+         else snprintf(scl, sizeof(scl), "%dx", scale_factors[scale_idx]); // ADDED SCALE HERE
+         if (visualMode == 0) snprintf(trig, sizeof(trig), " | TRIG: %s", triggerModeNames[scope.cfg.mode]);
+         char stat[160];
+         snprintf(stat, sizeof(stat), "IP: %u.%u.%u.%u | BAT: %d%% | %s | SCL: %s%s%s | CPU: %d%% (%lums)",
+                  ip[0], ip[1], ip[2], ip[3], bat, modeNames[visualMode], scl, trig,
+                  sdrec.isRecording() ? " | SD REC" : "", load, (unsigned long)max_loop_time);
+
+         // Redrawn (and pushed) only when the text changed
+         static char last_stat_text[sizeof(stat)] = "";
+         if (strcmp(stat, last_stat_text)) {
+             canvas.setTextSize(3);
+             // Clear only the top status area
+             canvas.fillRect(0,0, 1280, LAYOUT_STATUS_H, 0x18E3);
+             canvas.setCursor(15, 12); 
+             canvas.print(stat);
+             comp.mark(0, 0, 1280, LAYOUT_STATUS_H);
+             memcpy(last_stat_text, stat, sizeof(stat));
+             drawToneIndicators(); // Status bar fill just erased them
+         }
+                          
+         last_stat = millis(); 
+         max_loop_reset.store(true); // Reset max counter for next period (by loop(), which owns it)
+    }
+    if (tones.activeMask() != drawn_tone_mask) {
+         drawToneIndicators();
+    }
+
+    // --- SCREEN FLUSH ---
+    // Everything above drew into the canvas; push what changed in one go. Still locked: touch
+    // handlers draw into the same canvas and tiles.
+    flushScreen();
+    renderer.unlock();
 }
 
 // --- MAIN SETUP ---
 void setup(void) {
     auto cfg = M5.config();
     M5.begin(cfg);
+    profiler.begin();
     
     // Tab5 needs Rotation 3 to be "right side up" in this orientation
     M5.Display.setRotation(3); 
@@ -361,32 +1385,76 @@ void setup(void) {
     // Boot Screen
     M5.Display.fillScreen(BLACK);
     M5.Display.drawString("BOOTING MICTALK SYSTEM...", 640, 300); 
+    boot.mark("display");
 
+    tones.begin(record_samplerate); // Must exist before loadConfig() reads /tones.txt
+    micFilter.begin(record_samplerate); // ...and /mic_eq.txt
     loadConfig(); // Load WiFi settings from SD
+    boot.mark("sd_config");
 
-    // Connect to WiFi
-    WiFi.begin(wifi_ssid.c_str(), wifi_pass.c_str());
-    int dots = 0;
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        M5.Display.print("."); 
-        if(++dots > 20) break; // Timeout after 10s
-    }
+    // Connect to WiFi in the background (cached AP/channel when there is one); loop() polls it
+    // and the status bar shows the IP once it is up
+    wifiBoot.begin(wifi_ssid.c_str(), wifi_pass.c_str(), &boot);
     
-    // Prepare User Interface
-    M5.Display.fillScreen(BLACK);
+    // Prepare User Interface: off-screen frame in PSRAM, everything below draws into it
+    canvas.setPsram(true);
+    canvas.setColorDepth(16);
+    canvas_ok = canvas.createSprite(M5.Display.width(), M5.Display.height()) != nullptr;
+    if (!canvas_ok) { // ~1.8 MB of PSRAM: audio and the web interface still run, the screen does not
+        M5.Display.fillScreen(BLACK);
+        M5.Display.setTextColor(RED);
+        M5.Display.drawString("SCREEN BUFFER ALLOCATION FAILED - WEB INTERFACE ONLY", 640, 300);
+    }
+    canvas.setTextSize(3);
+    canvas.setTextColor(WHITE);
+    canvas.fillScreen(BLACK);
+    comp.begin(canvas.width(), canvas.height()); // Whole frame dirty: the first flush clears the boot text
     setupButtons();
 
     // Start Web Server
     server.on("/", handleRoot);
     server.on("/sv", handleSpectrum);
     server.on("/data", handleGetData);
+    server.on("/loudness", handleLoudness);
+    server.on("/tones", handleTones);
+    server.on("/pitch", handlePitch);
+    server.on("/status", handleStatus);
+    server.on("/agc", handleAgc);
+    server.on("/filter", handleFilter);
+    server.on("/scope", handleScope);
+    server.on("/scopedata", handleScopeData);
+    server.on("/envelope", handleEnvelope);
+    server.on("/rec", handleRec);
+    server.on("/event", handleEvent);
+    server.on("/capture.wav", handleCaptureWav);
+    server.on("/archive", handleArchive);
+    server.on("/boot", handleBoot);
+    server.on("/render", handleRender);
+    server.on("/metrics", handleMetrics);         // Prometheus scrape
+    server.on("/metrics.json", handleMetricsJson); // Stage timing histograms
+    server.on("/metrics/reset", handleMetricsReset);
+    server.on("/trace.json", handleTrace);        // Chrome trace of the hot path
+    const char *collect[] = {"Range"}; // /archive seeking
+    server.collectHeaders(collect, 1);
     server.begin();
+    boot.mark("server");
     
     // Allocate Audio Buffer in PSRAM (Heap Caps Malloc)
     // We use PSRAM because the buffer is large
     rec_data = (typeof(rec_data))heap_caps_malloc(record_size * sizeof(int16_t), MALLOC_CAP_8BIT); 
     memset(rec_data, 0, record_size * sizeof(int16_t)); 
+    loudness.begin(record_samplerate);
+    pitch.begin(record_samplerate);
+    vad.begin();
+    agc.begin(record_samplerate);
+    if (!envelope.begin()) boot.mark("envelope_off"); // Allocation failed: pyramid freed and off, raw ring only
+    if (sd_ready) sdrec.begin(record_samplerate);
+    if (sd_ready) archive.begin(record_samplerate);
+    history.begin(rec_data, record_number, record_length, record_number - 3); // Chunks the mic is not writing to
+    if (sd_ready) events.begin(history, record_samplerate);
+    ringStream.begin(history, record_samplerate);
+    player.begin(history, record_samplerate);
+    boot.mark("buffers");
     
     // Initialize Spectrum previous state to bottom of screen
     for(int i=0; i<FFT_BARS; i++) prev_spec_y[i] = LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT;
@@ -394,65 +1462,67 @@ void setup(void) {
     // Start Hardware Audio
     M5.Speaker.setVolume(255);
     M5.Mic.begin();
+    boot.mark("audio");
+
+    renderer.begin(renderFrame, render_fps); // From here on the screen is drawn by the render task
 }
 
 // --- PLAYBACK ROUTINE ---
-// Stops recording, plays the buffer, then resumes recording.
+// PLAY starts playback of the whole history (pressed again: stops it). The player pauses the mic
+// and runs from loop(), so touch, the status bar and web clients keep working meanwhile.
 void playRecording() {
+    if (player.active()) {
+        player.stop();
+        if (!player.active()) clearVisualizerArea(); // Stopped while draining: only the banner goes (touch holds the lock)
+        return;
+    }
     if (!M5.Speaker.isEnabled()) return;
-    
-    // UI Feedback: Red "Playing" Toast
-    M5.Display.fillRect(400, 250, 480, 100, RED); 
-    M5.Display.setTextColor(WHITE);
-    M5.Display.setTextDatum(middle_center);
-    M5.Display.drawString("PLAYING AUDIO...", 640, 300); 
-    M5.Display.setTextDatum(top_center);
+    player.start(); // The render task shows the red "Playing" toast while it runs
+}
 
-    // Stop Mic to free up resources
-    while (M5.Mic.isRecording()) delay(1);
-    M5.Mic.end();
-    
-    M5.Speaker.begin();
-    
-    // Handle Buffer Wrap-around playback
-    int start_pos = rec_record_idx * record_length; 
-    if (start_pos < record_size) {
-        // Play from current index to end of buffer
-        M5.Speaker.playRaw(&rec_data[start_pos], record_size - start_pos, record_samplerate, false, 1, 0); 
-    }
-    if (start_pos > 0) {
-        // Play from start of buffer to current index
-        M5.Speaker.playRaw(rec_data, start_pos, record_samplerate, false, 1, 0); 
-    }
-    
-    // Wait until audio finishes
-    do { delay(1); M5.update(); } while (M5.Speaker.isPlaying()); 
-    
-    // Restore Mic
-    M5.Speaker.end();
-    M5.Mic.begin();
-    
-    // Clear UI Feedback
-    M5.Display.fillRect(400, 250, 480, 100, BLACK); 
+// Called on the pass the player hands the mic back
+void playbackFinished() {
+    mic_resumed = true;
     
-    // Force clear visualizer to remove any artifacts caused by the pause
+    // Force clear visualizer to remove the toast and any artifacts caused by the pause
+    renderer.lock();
     clearVisualizerArea();
+    renderer.unlock();
 }
 
 // --- MAIN LOOP ---
 void loop(void) {
     // Track loop timing
     loop_start_time = millis();
+    uint32_t loop_t0 = StageProfiler::now();
+    allocStats.tick(); // Allocation rate and largest free block, once a second (/metrics)
     
     // Update hardware buttons/touch
+    uint32_t t0 = StageProfiler::now();
     M5.update();  
+    uint32_t input_cycles = StageProfiler::now() - t0; // Touch handling below adds to it
     
     // Process incoming web requests              
+    t0 = StageProfiler::now();
     server.handleClient();
+    ringStream.pump(sampleClock()); // Continue any /capture.wav download
+    profiler.record(PROF_NET, t0);
+    if (player.pump()) playbackFinished(); // One playback step (queue a buffer / hand the mic back)
+    wifiBoot.poll();                       // Background WiFi bring-up (status bar picks up the IP)
+    static unsigned long last_bat = 0;
+    if (last_bat == 0 || millis() - last_bat > 2000) { // Battery for the status bar (I2C: loop task only)
+        bat_level = M5.Power.getBatteryLevel();
+        last_bat = millis();
+    }
+    t0 = StageProfiler::now();
+    archive.pump();                 // ...and any /archive download
+    profiler.record(PROF_SD, t0);
     
     // --- 1. TOUCH INTERFACE LOGIC ---
+    t0 = StageProfiler::now();
     if (M5.Touch.getCount() > 0) {
         auto t = M5.Touch.getDetail(0);
+        renderer.lock(); // Touch draws into the canvas and changes what the render task reads
         // Handle Button Press
         if (t.wasPressed()) {
             for(int i=0; i<5; i++) {
@@ -461,23 +1531,31 @@ void loop(void) {
                     keys[i].draw(); // Redraw button pressed
 
                     // --- BUTTON ACTIONS ---
-                    if (i == 0 && scale_idx > 0) scale_idx--;
-                    // Scale Down
-                    else if (i == 1 && scale_idx < 5) scale_idx++;
-                    // Scale Up
+                    // Scale ladder: AGC < 1x < 2x < ... < 12x (manual SF overrides AGC)
+                    if (i == 0) {
+                        // Scale Down
+                        if (!agc_enabled) {
+                            if (scale_idx > 0) scale_idx--;
+                            else agc_enabled = true;
+                        }
+                    }
+                    else if (i == 1) {
+                        // Scale Up
+                        if (agc_enabled) { agc_enabled = false; scale_idx = 0; }
+                        else if (scale_idx < 5) scale_idx++;
+                    }
                     else if (i == 2) { 
-                        // MODE CYCLE: Wave -> VU -> Spectrum -> Wave
+                        // MODE CYCLE: Wave -> VU -> Spectrum -> Pitch -> Wave
                         visualMode++;
-                        if (visualMode > 2) visualMode = 0; 
-                        
-                        // Show visual feedback toast
-                        M5.Display.fillRect(400, 300, 480, 60, BLUE);
-                        M5.Display.drawString("MODE: " + String(modeNames[visualMode]), 640, 320); // [cite: 122]
-                        delay(200);
-                        M5.Display.fillRect(400, 300, 480, 60, BLACK);
+                        if (visualMode >= modeCount) visualMode = 0; 
                         
                         // Wipe screen for new mode [cite: 123]
                         clearVisualizerArea();
+
+                        // Show visual feedback toast
+                        char info[32];
+                        snprintf(info, sizeof(info), "MODE: %s", modeNames[visualMode]);
+                        showToast(BLUE, info); // [cite: 122]
                     }
                     else if (i == 3) { 
                         // NOISE FILTER
@@ -485,18 +1563,55 @@ void loop(void) {
                         micCfg.noise_filter_level = (micCfg.noise_filter_level + 8) & 255;
                         M5.Mic.config(micCfg);
                         
-                        M5.Display.fillRect(400, 300, 480, 60, BLUE); 
-                        M5.Display.drawString("NF LEVEL: " + String(micCfg.noise_filter_level), 640, 320);
-                        
-                        delay(200);
-                        
-                        M5.Display.fillRect(400, 300, 480, 60, BLACK);
+                        char info[32];
+                        snprintf(info, sizeof(info), "NF LEVEL: %d", micCfg.noise_filter_level);
+                        showToast(BLUE, info);
                     }
                     else if (i == 4) playRecording();
                 }
             }
         }
         
+        // Tap on the status bar: mark an event (saved to SD with the seconds around it)
+        if (t.wasPressed() && t.y < LAYOUT_STATUS_H && sd_ready) {
+            events.trigger(EVT_KEY);
+            showToast(MAGENTA, "EVENT MARKED");
+        }
+
+        // Tap on the WAVE view, upper half: left third = shorter timebase, right third = longer,
+        // middle = next trigger mode (re-arms SINGLE). Lower half, in quarters: level down,
+        // edge, next holdoff step, level up.
+        if (t.wasPressed() && visualMode == 0 &&
+            t.y >= LAYOUT_VISUALIZER_TOP && t.y < LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT) {
+            if (t.y < LAYOUT_VISUALIZER_TOP + LAYOUT_VISUALIZER_HEIGHT / 2) {
+                if (t.x < 427) {
+                    if (timebase_idx > 0) timebase_idx--;
+                } else if (t.x >= 853) {
+                    if (timebase_idx < scope_timebase_count - 1) timebase_idx++;
+                } else {
+                    scope.cfg.mode = (TriggerMode)((scope.cfg.mode + 1) % 4);
+                }
+            } else if (t.x < 320) {
+                if (scope.cfg.level > -16384) scope.cfg.level -= 512;
+            } else if (t.x < 640) {
+                scope.cfg.edge = (scope.cfg.edge == EDGE_RISING) ? EDGE_FALLING : EDGE_RISING;
+            } else if (t.x < 960) {
+                holdoff_idx = (holdoff_idx + 1) % scope_holdoff_count;
+                scope.cfg.holdoff = scope_holdoffs_ms[holdoff_idx] * record_samplerate / 1000;
+            } else {
+                if (scope.cfg.level < 16384) scope.cfg.level += 512;
+            }
+            scope.cfg.spp = scope_timebases[timebase_idx];
+            scope.arm();
+
+            clearVisualizerArea();
+            char info[48];
+            snprintf(info, sizeof(info), "TRIG: %s %s L:%d H:%dms TB:%dx", triggerModeNames[scope.cfg.mode],
+                     scope.cfg.edge == EDGE_RISING ? "RISE" : "FALL", (int)scope.cfg.level,
+                     (int)scope_holdoffs_ms[holdoff_idx], (int)scope.cfg.spp);
+            showToast(BLUE, info);
+        }
+
         // Handle Button Release
         if (t.wasReleased()) {
              for(int i=0; i<5; i++) {
@@ -507,38 +1622,27 @@ void loop(void) {
                  }
              }
         }
+        renderer.unlock();
     }
+    input_cycles += StageProfiler::now() - t0;
+    profiler.recordCycles(PROF_INPUT, input_cycles);
 
-    // --- 2. AUDIO PROCESSING & VISUALIZATION ---
+    // --- 2. AUDIO PROCESSING ---
     if (M5.Mic.isEnabled()) {
         auto data = &rec_data[rec_record_idx * record_length];
         // Attempt to record a chunk of audio
-        if (M5.Mic.record(data, record_length, record_samplerate)) {
+        // (A frozen /capture.wav keeps the mic off chunks it has not sent yet; a pending playback
+        // waits for the mic to finish its queued buffer, so no new ones while the player is active)
+        t0 = StageProfiler::now();
+        bool got = !player.active() && !ringStream.holds() && M5.Mic.record(data, record_length, record_samplerate);
+        profiler.record(PROF_CAPTURE, t0);
+        if (got) {
             // If successful, data is now updated.
             // Set draw pointer to current.
             data = &rec_data[draw_record_idx * record_length];
-            // HARDWARE CLIPPING:
-            // Crucial!
-            // This tells the display driver to IGNORE any drawing attempts
-            // outside the visualizer box.
-            // This prevents the waveform from
-            // accidentally drawing over the status bar or buttons.
-            M5.Display.setClipRect(0, LAYOUT_VISUALIZER_TOP, 1280, LAYOUT_VISUALIZER_HEIGHT);
-            M5.Display.startWrite(); 
-
-            // Execute the selected visualizer
-            switch (visualMode)
-            {
-            case 0: drawWaveform(data);
-                break;
-            case 1: drawVUMeter(data); 
-                break;
-            case 2: drawSpectrum(data); 
-                break;
-            }
-
-            M5.Display.endWrite();
-            M5.Display.clearClipRect(); // Disable clipping
+            t0 = StageProfiler::now();
+            processChunk(data); // The render task draws it (or a newer one) on its next frame
+            profiler.record(PROF_DSP, t0);
 
             // Advance buffer pointers (Circular Buffer Logic)
             if (++draw_record_idx >= record_number) draw_record_idx = 0;
@@ -546,32 +1650,9 @@ void loop(void) {
         }
     }
     
-    // --- 3. STATUS BAR UPDATE (Top of Screen) ---
-    // We only update this every 500ms to save CPU and reduce flicker
-    static unsigned long last_stat = 0;
-    if(millis() - last_stat > 500) {  
-         int bat = M5.Power.getBatteryLevel();
-         String ip = WiFi.localIP().toString(); 
-         
-         // Calculate approx CPU load based on frame budget (40ms target)
-         int load = (max_loop_time * 100) / 40;
-         M5.Display.setTextSize(3);
-         // Clear only the top status area
-         M5.Display.fillRect(0,0, 1280, LAYOUT_STATUS_H, 0x18E3);
-         M5.Display.setCursor(15, 12); 
-         
-         // Print Status String (UPDATED WITH SCALE FACTOR)
-         M5.Display.print("IP: " + ip + 
-                          " | BAT: " + String(bat) + "%" +
-                          " | " + String(modeNames[visualMode]) + 
-                          " | SCL: " + String(scale_factors[scale_idx]) + "x" + // ADDED SCALE HERE
-                          " | CPU: " + String(load) + "% (" + String(max_loop_time) + "ms)");
-                          
-         last_stat = millis(); 
-         max_loop_time = 0; // Reset max counter for next period
-    }
-    
     // Update Max Loop Time
+    profiler.record(PROF_LOOP, loop_t0);
     unsigned long loop_duration = millis() - loop_start_time;
+    if (max_loop_reset.exchange(false)) max_loop_time = 0;
     if (loop_duration > max_loop_time) max_loop_time = loop_duration;
 }
\ No newline at end of file
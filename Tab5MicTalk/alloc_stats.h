@@ -0,0 +1,118 @@
+/**
+ * @file alloc_stats.h
+ * @brief Heap allocation counter and fragmentation gauges (/metrics).
+ *
+ * The loop and the web handlers format into fixed buffers, so after setup
+ * the sketch itself should not allocate; this catches it when a change
+ * brings a String back onto a hot path. Every allocation bumps a relaxed
+ * atomic counter, and tick() (once a second from loop()) turns it into
+ * allocations per second and samples the largest free internal block and
+ * its low-water mark. A heap that keeps its free total but loses its
+ * largest block over days is fragmenting.
+ *
+ * Where the counter hooks in (malloc level, so String's malloc / realloc
+ * count too):
+ * - MICTALK_WRAP_MALLOC: linked with -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc,
+ *   the __wrap_ functions below count and call the real ones. The sketch's
+ *   platformio.ini sets both (arduino-cli: see the README).
+ * - ESP-IDF built with CONFIG_HEAP_USE_HOOKS: the heap's alloc hook, which
+ *   sees every allocation from any task (WiFi and lwIP included).
+ * - Neither (the Arduino IDE cannot pass linker flags): nothing is counted.
+ *   kHook is "none" and /metrics leaves the allocation series out rather than
+ *   report a rate of 0; the largest free block is still reported.
+ * Even when counted, the steady-state rate is a baseline (the WebServer
+ * parses each request into Strings, the network stack uses the heap), so
+ * watch it for steps, not for zero.
+ *
+ * writeAllocMetrics() adds all of it to a /metrics scrape. Include from the
+ * sketch only (it defines the hook functions).
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <atomic>
+#include "metrics.h"
+
+class AllocStats {
+public:
+#if defined(MICTALK_WRAP_MALLOC)
+    static constexpr const char *kHook = "wrap_malloc";
+    static constexpr bool kCounting = true;
+#elif defined(CONFIG_HEAP_USE_HOOKS)
+    static constexpr const char *kHook = "heap_hooks";
+    static constexpr bool kCounting = true;
+#else
+    static constexpr const char *kHook = "none";
+    static constexpr bool kCounting = false;
+#endif
+
+    void note() { count.fetch_add(1, std::memory_order_relaxed); }
+
+    // Once a second: rate since the last update and the largest free block
+    void tick() {
+        uint32_t now = millis();
+        if (now - last_ms < 1000) return;
+        uint32_t c = count.load(std::memory_order_relaxed);
+        per_s = (c - last_count) * 1000.0f / (now - last_ms);
+        last_count = c;
+        last_ms = now;
+        largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (largest < min_largest) min_largest = largest;
+    }
+
+    uint32_t total() const { return count.load(std::memory_order_relaxed); }
+    float perSecond() const { return per_s; }
+    uint32_t largestFree() const { return largest; }
+    uint32_t minLargestFree() const { return min_largest == UINT32_MAX ? largest : min_largest; }
+
+private:
+    std::atomic<uint32_t> count{0};
+    uint32_t last_count = 0;
+    uint32_t last_ms = 0;
+    float per_s = 0;
+    uint32_t largest = 0;
+    uint32_t min_largest = UINT32_MAX;
+};
+
+static AllocStats allocStats;
+
+inline void writeAllocMetrics(PromWriter &w, const AllocStats &a) {
+    char labels[32];
+    w.family("mictalk_heap_alloc_hook_info", "gauge",
+             "How allocations are counted: wrap_malloc, heap_hooks or none (no allocation series then).");
+    snprintf(labels, sizeof(labels), "hook=\"%s\"", AllocStats::kHook);
+    w.value("mictalk_heap_alloc_hook_info", labels, (uint32_t)1);
+    if (AllocStats::kCounting) {
+        w.counter("mictalk_heap_allocations_total", "Heap allocations (malloc / realloc / calloc) since boot.", a.total());
+        w.gauge("mictalk_heap_allocations_per_second", "Allocation rate over the last second.", a.perSecond());
+    }
+    w.gauge("mictalk_heap_largest_free_block_bytes", "Largest free internal heap block.", a.largestFree());
+    w.gauge("mictalk_heap_min_largest_free_block_bytes", "Lowest largest free internal block since boot (fragmentation).",
+            a.minLargestFree());
+}
+
+#if defined(MICTALK_WRAP_MALLOC)
+// --wrap sends every malloc / realloc / calloc in the image (libraries included) here
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+extern "C" void *__real_calloc(size_t n, size_t size);
+extern "C" void *__wrap_malloc(size_t size) {
+    allocStats.note();
+    return __real_malloc(size);
+}
+extern "C" void *__wrap_realloc(void *ptr, size_t size) {
+    allocStats.note();
+    return __real_realloc(ptr, size);
+}
+extern "C" void *__wrap_calloc(size_t n, size_t size) {
+    allocStats.note();
+    return __real_calloc(n, size);
+}
+#elif defined(CONFIG_HEAP_USE_HOOKS)
+// Called by the heap for every successful allocation / free, from any task (IRAM: may run with the cache off)
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void *, size_t, uint32_t) {
+    allocStats.note();
+}
+extern "C" IRAM_ATTR void esp_heap_trace_free_hook(void *) {}
+#endif
@@ -0,0 +1,137 @@
+/**
+ * @file compositor.h
+ * @brief Dirty-tile tracking for a full-screen off-screen canvas.
+ *
+ * Everything on the Tab5 screen (status bar, visualizers, toasts, buttons) is
+ * drawn into one 1280x720 canvas in PSRAM. Each drawing step marks the
+ * rectangle it touched; the screen is divided into 32x32 tiles and a mark
+ * sets every tile it overlaps. Once per frame flush() merges the dirty tiles
+ * into rectangles (runs along a tile row, then rows with the same run stacked
+ * into one rectangle) and hands each to a push callback, which copies that part
+ * of the canvas to the panel. Untouched tiles cost nothing, whatever was drawn
+ * into the canvas in the meantime.
+ *
+ * The merge never joins tiles that are not dirty, so the pushed area is the
+ * tile-rounded dirty area: an upper bound of 31 px per edge, no more.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+class TileCompositor {
+public:
+    static constexpr int kTile = 32;
+    static constexpr int kMaxCols = 64;  // 2048 px wide: one uint64_t per tile row
+    static constexpr int kMaxRows = 32;  // 1024 px high
+    static constexpr int kBytesPerPixel = 2;
+
+    void begin(int width, int height) {
+        w = width;
+        h = height;
+        cols = min((w + kTile - 1) / kTile, kMaxCols);
+        rows = min((h + kTile - 1) / kTile, kMaxRows);
+        markAll();
+    }
+
+    // Marks the rectangle as changed (clipped to the screen)
+    void mark(int x, int y, int rw, int rh) {
+        if (rw <= 0 || rh <= 0) return;
+        int x1 = max(x, 0), y1 = max(y, 0);
+        int x2 = min(x + rw, w), y2 = min(y + rh, h);
+        if (x1 >= x2 || y1 >= y2) return;
+        int c0 = x1 / kTile, c1 = (x2 - 1) / kTile;
+        int r0 = y1 / kTile, r1 = (y2 - 1) / kTile;
+        uint64_t bits = ((c1 - c0 + 1) >= 64 ? ~0ULL : ((1ULL << (c1 - c0 + 1)) - 1)) << c0;
+        for (int r = r0; r <= r1; r++) dirty[r] |= bits;
+    }
+
+    void markAll() { mark(0, 0, w, h); }
+
+    bool pending() const {
+        for (int r = 0; r < rows; r++) {
+            if (dirty[r]) return true;
+        }
+        return false;
+    }
+
+    // Sends every merged dirty rectangle to push(x, y, w, h) and clears the tiles.
+    // Returns the number of rectangles pushed (0: nothing changed, no frame).
+    template <typename Push>
+    int flush(Push push) {
+        struct Open {
+            int c0, c1, r0; // Tile span and first tile row
+        };
+        Open open[kMaxCols], next[kMaxCols];
+        int n_open = 0;
+        int rects = 0;
+        uint32_t bytes = 0, tiles = 0;
+
+        auto emit = [&](const Open &o, int r_end) {
+            int x = o.c0 * kTile, y = o.r0 * kTile;
+            int rw = min((o.c1 + 1) * kTile, w) - x;
+            int rh = min(r_end * kTile, h) - y;
+            push(x, y, rw, rh);
+            bytes += (uint32_t)rw * rh * kBytesPerPixel;
+            rects++;
+        };
+
+        for (int r = 0; r <= rows; r++) {
+            uint64_t bits = r < rows ? dirty[r] : 0;
+            int n_next = 0;
+            // Runs of dirty tiles along this row
+            for (int c = 0; c < cols; c++) {
+                if (!(bits >> c & 1)) continue;
+                int c0 = c;
+                while (c + 1 < cols && (bits >> (c + 1) & 1)) c++;
+                tiles += c - c0 + 1;
+                // Same span as a rectangle open from the row above: grow it downwards
+                int r0 = r;
+                for (int i = 0; i < n_open; i++) {
+                    if (open[i].c0 == c0 && open[i].c1 == c) {
+                        r0 = open[i].r0;
+                        open[i].c0 = -1; // Taken over
+                        break;
+                    }
+                }
+                next[n_next++] = {c0, c, r0};
+            }
+            // Whatever did not continue ends above this row
+            for (int i = 0; i < n_open; i++) {
+                if (open[i].c0 >= 0) emit(open[i], r);
+            }
+            memcpy(open, next, n_next * sizeof(Open));
+            n_open = n_next;
+            if (r < rows) dirty[r] = 0;
+        }
+
+        if (rects > 0) {
+            frames++;
+            last_bytes = bytes;
+            last_rects = rects;
+            last_tiles = tiles;
+            total_bytes += bytes;
+            if (bytes > peak_bytes) peak_bytes = bytes;
+        }
+        return rects;
+    }
+
+    // --- STATS ---
+    uint32_t frames = 0;       // Flushes that pushed anything
+    uint32_t last_bytes = 0;   // Pushed by the last frame
+    uint32_t last_rects = 0;
+    uint32_t last_tiles = 0;
+    uint32_t peak_bytes = 0;
+    uint64_t total_bytes = 0;
+
+    uint32_t screenBytes() const { return (uint32_t)w * h * kBytesPerPixel; }
+    uint32_t avgBytes() const { return frames ? (uint32_t)(total_bytes / frames) : 0; }
+    void resetStats() {
+        frames = last_bytes = last_rects = last_tiles = peak_bytes = 0;
+        total_bytes = 0;
+    }
+
+private:
+    int w = 0, h = 0;
+    int cols = 0, rows = 0;
+    uint64_t dirty[kMaxRows] = {};
+};
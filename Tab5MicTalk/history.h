@@ -0,0 +1,190 @@
+/**
+ * @file history.h
+ * @brief Chunk-sequence view of the capture history, with an optional IMA ADPCM tier.
+ *
+ * Chunk `seq` (1-based, as chunk_seq) holds sample clock [(seq-1)*len, seq*len).
+ * The newest chunks are read straight from the raw ring (rec_data), which the
+ * display, scope and /data keep using directly. With HISTORY_ADPCM_CHUNKS set,
+ * each chunk is also encoded to 4-bit IMA ADPCM as it reaches the oldest end
+ * of the raw window (before the mic can come round to it), so the history
+ * reaches back HISTORY_ADPCM_CHUNKS further at about a quarter of the RAM.
+ *
+ * Consumers that only need samples (downloads, event capture, playback) go
+ * through run()/read() and never see which tier answered: raw chunks come back
+ * as a pointer into the ring, compressed ones are decoded into the caller's
+ * scratch buffer on read.
+ *
+ * Block layout: first sample (int16), step index (uint8), pad, then one
+ * nibble per following sample. Each chunk decodes on its own.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef HISTORY_ADPCM_CHUNKS
+#define HISTORY_ADPCM_CHUNKS 0 // 0 = no compressed tier: the history is the raw ring only
+#endif
+#ifndef HISTORY_ALLOC
+#define HISTORY_ALLOC(bytes) malloc(bytes)
+#endif
+
+class ChunkHistory {
+public:
+    static constexpr size_t kMaxChunkLen = 256; // Largest chunk (Tab5); sizes callers' scratch buffers
+
+    static constexpr size_t blockBytes(size_t chunk_len) { return 4 + chunk_len / 2; }
+
+    // ring: ring_chunks chunks of chunk_len samples; raw_chunks: newest chunks safe to read raw
+    bool begin(const int16_t *ring_data, size_t ring_chunks, size_t chunk_len, size_t raw_chunks) {
+        ring = ring_data;
+        ring_size = ring_chunks * chunk_len;
+        len = chunk_len;
+        raw = raw_chunks;
+        tier_chunks = HISTORY_ADPCM_CHUNKS;
+        if (len > kMaxChunkLen) return false;
+        if (tier_chunks > 0) {
+            tier = (uint8_t *)HISTORY_ALLOC(tier_chunks * blockBytes(len));
+            if (!tier) tier_chunks = 0; // Fall back to the raw ring alone
+        }
+        return true;
+    }
+
+    // Call once per processed chunk with its sequence number (after chunk_seq++)
+    void push(uint32_t seq) {
+        if (tier_chunks > 0 && seq >= raw) {
+            uint32_t s = seq - raw + 1; // Oldest chunk of the raw window: still intact, not yet reused
+            encode(ring + ((s - 1) * len) % ring_size, block(s));
+        }
+        newest_seq = seq;
+    }
+
+    // --- READING (any task) ---
+
+    uint32_t newest() const { return newest_seq; }
+    uint32_t oldest() const { return oldestFor(newest_seq); }
+    size_t chunks() const { return tier_chunks > 0 ? raw + tier_chunks - 1 : raw; }
+    size_t samples() const { return chunks() * len; }
+    size_t chunkLength() const { return len; }
+    uint64_t oldestClock() const { return (uint64_t)(oldest() - 1) * len; }
+    uint64_t newestClock() const { return (uint64_t)newest_seq * len; }
+    uint64_t rawOldestClock() const { return (uint64_t)(rawOldestFor(newest_seq) - 1) * len; }
+    size_t tierBytes() const { return tier_chunks * blockBytes(len); }
+
+    // Samples from `clock` on: returns a pointer to up to n contiguous samples and shortens n to
+    // what it holds (ring: up to the wrap or the newest sample; compressed: up to the chunk end,
+    // decoded into scratch[kMaxChunkLen]). nullptr (n = 0) once the history no longer reaches.
+    const int16_t *run(uint64_t clock, size_t &n, int16_t *scratch) const {
+        uint32_t nw = newest_seq;
+        uint32_t seq = (uint32_t)(clock / len) + 1;
+        size_t off = (size_t)(clock % len);
+        if (nw == 0 || seq > nw || seq < oldestFor(nw)) {
+            n = 0;
+            return nullptr;
+        }
+        if (seq >= rawOldestFor(nw)) {
+            size_t idx = (size_t)(clock % ring_size);
+            uint64_t avail = (uint64_t)nw * len - clock;
+            if (avail > ring_size - idx) avail = ring_size - idx;
+            if (n > avail) n = (size_t)avail;
+            return ring + idx;
+        }
+        decode(block(seq), scratch);
+        if (n > len - off) n = len - off;
+        return scratch + off;
+    }
+
+    // Copies up to n samples from `clock` into out; returns how many were available
+    size_t read(uint64_t clock, int16_t *out, size_t n) const {
+        int16_t scratch[kMaxChunkLen];
+        size_t done = 0;
+        while (done < n) {
+            size_t k = n - done;
+            const int16_t *p = run(clock + done, k, scratch);
+            if (!p) break;
+            memcpy(out + done, p, k * sizeof(int16_t));
+            done += k;
+        }
+        return done;
+    }
+
+private:
+    const int16_t *ring = nullptr;
+    size_t   ring_size = 0;
+    size_t   len = 0;
+    size_t   raw = 0;
+    size_t   tier_chunks = 0;
+    uint8_t *tier = nullptr;
+    uint8_t  enc_index = 0;            // Encoder step index, carried across chunks
+    volatile uint32_t newest_seq = 0;
+
+    uint32_t rawOldestFor(uint32_t nw) const { return nw > raw ? nw - raw + 1 : 1; }
+    uint32_t oldestFor(uint32_t nw) const { return nw > chunks() ? nw - chunks() + 1 : 1; }
+    uint8_t *block(uint32_t seq) const { return tier + ((seq - 1) % tier_chunks) * blockBytes(len); }
+
+    // --- IMA ADPCM ---
+
+    static const int16_t *steps() {
+        static const int16_t table[89] = {
+            7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+            73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449,
+            494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+            2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+            10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+        return table;
+    }
+
+    static int stepIndexDelta(uint8_t code) {
+        static const int8_t delta[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+        return delta[code & 7];
+    }
+
+    // Applies one 4-bit code to the predictor/index state (shared by encoder and decoder)
+    static void step(uint8_t code, int32_t &pred, int &index) {
+        int32_t s = steps()[index];
+        int32_t diff = s >> 3;
+        if (code & 4) diff += s;
+        if (code & 2) diff += s >> 1;
+        if (code & 1) diff += s >> 2;
+        pred += (code & 8) ? -diff : diff;
+        pred = constrain(pred, -32768, 32767);
+        index = constrain(index + stepIndexDelta(code), 0, 88);
+    }
+
+    void encode(const int16_t *x, uint8_t *out) {
+        int32_t pred = x[0];
+        int index = enc_index;
+        out[0] = (uint8_t)(pred & 0xFF);
+        out[1] = (uint8_t)((pred >> 8) & 0xFF);
+        out[2] = (uint8_t)index;
+        out[3] = 0;
+        uint8_t *p = out + 4;
+        for (size_t i = 1; i < len; i++) {
+            int32_t diff = x[i] - pred;
+            int32_t s = steps()[index];
+            uint8_t code = 0;
+            if (diff < 0) {
+                code = 8;
+                diff = -diff;
+            }
+            if (diff >= s) { code |= 4; diff -= s; }
+            if (diff >= s >> 1) { code |= 2; diff -= s >> 1; }
+            if (diff >= s >> 2) code |= 1;
+            step(code, pred, index);
+            if (i & 1) *p = code;
+            else *p++ |= code << 4;
+        }
+        enc_index = (uint8_t)index;
+    }
+
+    void decode(const uint8_t *in, int16_t *out) const {
+        int32_t pred = (int16_t)(in[0] | (in[1] << 8));
+        int index = in[2] > 88 ? 88 : in[2];
+        out[0] = (int16_t)pred;
+        const uint8_t *p = in + 4;
+        for (size_t i = 1; i < len; i++) {
+            uint8_t code = (i & 1) ? (*p & 0x0F) : (*p++ >> 4);
+            step(code, pred, index);
+            out[i] = (int16_t)pred;
+        }
+    }
+};
@@ -0,0 +1,250 @@
+/**
+ * @file loudness.h
+ * @brief Streaming EBU R128 / ITU-R BS.1770-4 loudness and true-peak meter.
+ *
+ * Feed it every captured chunk with process(). It K-weights the signal
+ * (high-shelf + RLB high-pass), sums it into 100 ms blocks and derives:
+ * - Momentary loudness (last 4 blocks = 400 ms)
+ * - Short-term loudness (last 30 blocks = 3 s)
+ * - Gated integrated loudness (-70 LUFS absolute gate, -10 LU relative gate)
+ * - True peak via 4x oversampling (dBTP)
+ *
+ * Memory is constant no matter how long we measure: the integrated value
+ * is kept as a histogram of 400 ms block loudness (0.1 LU bins) instead of
+ * a list of blocks.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+class LoudnessMeter {
+public:
+    static constexpr float kFloorLufs   = -99.9f; // Reported when there is nothing to measure
+    static constexpr int   kShortBlocks = 30;     // 3 s of 100 ms blocks
+    static constexpr int   kMomBlocks   = 4;      // 400 ms of 100 ms blocks
+    static constexpr int   kHistMin     = -70;    // Absolute gate (LUFS)
+    static constexpr int   kHistMax     = 5;      // Top of the histogram (LUFS)
+    static constexpr int   kHistBins    = (kHistMax - kHistMin) * 10; // 0.1 LU bins
+    static constexpr int   kTpPhases    = 4;      // 4x oversampling
+    static constexpr int   kTpTaps      = 12;     // Taps per polyphase branch
+
+    void begin(float samplerate) {
+        designKWeighting(samplerate);
+        designTruePeak();
+        block_len = (uint32_t)(samplerate * 0.1f + 0.5f);
+        reset();
+    }
+
+    // Clears every measurement (filter state, blocks, integrated, true peak)
+    void reset() {
+        memset(z1, 0, sizeof(z1));
+        memset(z2, 0, sizeof(z2));
+        memset(blocks, 0, sizeof(blocks));
+        memset(block_tp, 0, sizeof(block_tp));
+        memset(hist, 0, sizeof(hist));
+        memset(tp_hist, 0, sizeof(tp_hist));
+        block_sum = 0;
+        block_count = 0;
+        block_peak = 0;
+        block_head = 0;
+        blocks_filled = 0;
+        tp_max = 0;
+    }
+
+    void process(const int16_t *x, size_t n) {
+        const float norm = 1.0f / 32768.0f;
+        for (size_t i = 0; i < n; i++) {
+            float s = x[i] * norm;
+
+            // --- K-WEIGHTING (two transposed direct form II biquads) ---
+            float y = s;
+            for (int st = 0; st < 2; st++) {
+                float out = b[st][0] * y + z1[st];
+                z1[st] = b[st][1] * y - a[st][0] * out + z2[st];
+                z2[st] = b[st][2] * y - a[st][1] * out;
+                y = out;
+            }
+            block_sum += y * y;
+
+            // --- TRUE PEAK (polyphase 4x interpolator) ---
+            memmove(&tp_hist[1], &tp_hist[0], (kTpTaps - 1) * sizeof(float));
+            tp_hist[0] = s;
+            for (int p = 0; p < kTpPhases; p++) {
+                const float *h = tp_coef[p];
+                float acc = 0;
+                for (int k = 0; k < kTpTaps; k++) acc += h[k] * tp_hist[k];
+                acc = fabsf(acc);
+                if (acc > block_peak) block_peak = acc;
+            }
+
+            if (++block_count >= block_len) closeBlock();
+        }
+    }
+
+    float momentary() const { return windowLoudness(kMomBlocks); }
+    float shortTerm() const { return windowLoudness(kShortBlocks); }
+
+    // Gated integrated loudness over everything since the last reset()
+    float integrated() const {
+        uint32_t count = 0;
+        double energy = 0;
+        for (int i = 0; i < kHistBins; i++) {
+            if (!hist[i]) continue;
+            count += hist[i];
+            energy += hist[i] * binEnergy(i);
+        }
+        if (!count) return kFloorLufs;
+
+        // Relative gate: 10 LU below the loudness of all blocks above the absolute gate
+        float gate = energyToLufs(energy / count) - 10.0f;
+        int first = (int)ceilf((gate - kHistMin) * 10.0f - 0.5f);
+        if (first < 0) first = 0;
+
+        count = 0;
+        energy = 0;
+        for (int i = first; i < kHistBins; i++) {
+            if (!hist[i]) continue;
+            count += hist[i];
+            energy += hist[i] * binEnergy(i);
+        }
+        if (!count) return kFloorLufs;
+        return energyToLufs(energy / count);
+    }
+
+    // Highest true peak since reset() and over the momentary window (dBTP)
+    float truePeak() const { return ampToDb(tp_max); }
+    float truePeakMomentary() const {
+        float peak = 0;
+        for (int i = 0; i < kMomBlocks; i++) {
+            if (block_tp[i] > peak) peak = block_tp[i];
+        }
+        return ampToDb(peak);
+    }
+
+private:
+    // K-weighting coefficients: b[stage][0..2], a[stage][1..2] (a0 normalised)
+    float b[2][3];
+    float a[2][2];
+    float z1[2], z2[2];
+
+    // 100 ms block accumulators (ring of mean-square energies)
+    uint32_t block_len = 1700;
+    uint32_t block_count = 0;
+    float    block_sum = 0;
+    float    block_peak = 0;
+    float    blocks[kShortBlocks];
+    float    block_tp[kMomBlocks];
+    int      block_head = 0;
+    int      blocks_filled = 0;
+
+    // Integrated loudness histogram (count of 400 ms windows per 0.1 LU bin)
+    uint32_t hist[kHistBins];
+
+    // True-peak interpolator
+    float tp_coef[kTpPhases][kTpTaps];
+    float tp_hist[kTpTaps];
+    float tp_max = 0;
+
+    static float energyToLufs(double e) {
+        if (e <= 0) return kFloorLufs;
+        float l = -0.691f + 10.0f * log10f((float)e);
+        return (l < kFloorLufs) ? kFloorLufs : l;
+    }
+
+    static double binEnergy(int bin) {
+        float center = kHistMin + (bin + 0.5f) * 0.1f;
+        return pow(10.0, (center + 0.691) / 10.0);
+    }
+
+    static float ampToDb(float v) {
+        if (v <= 0) return kFloorLufs;
+        float db = 20.0f * log10f(v);
+        return (db < kFloorLufs) ? kFloorLufs : db;
+    }
+
+    float windowLoudness(int n) const {
+        if (blocks_filled == 0) return kFloorLufs;
+        if (n > blocks_filled) n = blocks_filled;
+        double sum = 0;
+        int idx = block_head;
+        for (int i = 0; i < n; i++) {
+            idx = (idx == 0) ? kShortBlocks - 1 : idx - 1;
+            sum += blocks[idx];
+        }
+        return energyToLufs(sum / n);
+    }
+
+    void closeBlock() {
+        blocks[block_head] = block_sum / block_len;
+        if (++block_head >= kShortBlocks) block_head = 0;
+        if (blocks_filled < kShortBlocks) blocks_filled++;
+
+        memmove(&block_tp[1], &block_tp[0], (kMomBlocks - 1) * sizeof(float));
+        block_tp[0] = block_peak;
+        if (block_peak > tp_max) tp_max = block_peak;
+
+        block_sum = 0;
+        block_count = 0;
+        block_peak = 0;
+
+        // Every 100 ms step closes one 400 ms gating window (75% overlap)
+        if (blocks_filled >= kMomBlocks) {
+            float l = momentary();
+            if (l > kHistMin) {
+                int bin = (int)((l - kHistMin) * 10.0f);
+                if (bin >= kHistBins) bin = kHistBins - 1;
+                hist[bin]++;
+            }
+        }
+    }
+
+    // Derives the BS.1770 pre-filter for any sample rate (the standard only
+    // lists 48 kHz coefficients), using the analog prototypes from libebur128.
+    void designKWeighting(float fs) {
+        // Stage 1: high shelf (+4 dB above ~1.5 kHz)
+        double f0 = 1681.974450955533;
+        double G  = 3.999843853973347;
+        double Q  = 0.7071752369554196;
+        double K  = tan(M_PI * f0 / fs);
+        double Vh = pow(10.0, G / 20.0);
+        double Vb = pow(Vh, 0.4996667741545416);
+        double a0 = 1.0 + K / Q + K * K;
+        b[0][0] = (Vh + Vb * K / Q + K * K) / a0;
+        b[0][1] = 2.0 * (K * K - Vh) / a0;
+        b[0][2] = (Vh - Vb * K / Q + K * K) / a0;
+        a[0][0] = 2.0 * (K * K - 1.0) / a0;
+        a[0][1] = (1.0 - K / Q + K * K) / a0;
+
+        // Stage 2: RLB high-pass (~38 Hz)
+        f0 = 38.13547087602444;
+        Q  = 0.5003270373238773;
+        K  = tan(M_PI * f0 / fs);
+        a0 = 1.0 + K / Q + K * K;
+        b[1][0] = 1.0;
+        b[1][1] = -2.0;
+        b[1][2] = 1.0;
+        a[1][0] = 2.0 * (K * K - 1.0) / a0;
+        a[1][1] = (1.0 - K / Q + K * K) / a0;
+    }
+
+    // Hann-windowed sinc interpolator split into 4 polyphase branches
+    void designTruePeak() {
+        const int len = kTpPhases * kTpTaps;
+        const float mid = (len - 1) * 0.5f;
+        for (int p = 0; p < kTpPhases; p++) {
+            float sum = 0;
+            for (int k = 0; k < kTpTaps; k++) {
+                float t = (k * kTpPhases + p) - mid;
+                float x = t / kTpPhases;
+                float sinc = (fabsf(x) < 1e-6f) ? 1.0f : sinf(M_PI * x) / (M_PI * x);
+                float win = 0.5f - 0.5f * cosf(2.0f * M_PI * (k * kTpPhases + p + 0.5f) / len);
+                tp_coef[p][k] = sinc * win;
+                sum += tp_coef[p][k];
+            }
+            // Unity DC gain per branch so a held full-scale sample reads 0 dBTP
+            for (int k = 0; k < kTpTaps; k++) tp_coef[p][k] /= sum;
+        }
+    }
+};
@@ -0,0 +1,51 @@
+/**
+ * @file palette.h
+ * @brief 256-entry RGB565 colour map for intensity displays (waterfall, phosphor).
+ *
+ * Built once from a handful of control colours (black - blue - magenta -
+ * orange - yellow - white, an "inferno"-like ramp that stays readable on the
+ * panel) by linear interpolation, so mapping a level to a colour is a single
+ * table load per pixel.
+ *
+ * Entries are stored byte-swapped, the order LovyanGFX/M5GFX 16-bit sprites
+ * keep in memory, so they can be written straight into a canvas buffer.
+ * color() returns the normal RGB565 value for the drawing API.
+ */
+#pragma once
+
+#include <stdint.h>
+
+class Palette565 {
+public:
+    Palette565() {
+        struct Stop {
+            uint8_t at, r, g, b;
+        };
+        static const Stop stops[] = {
+            {0, 0, 0, 0},       {48, 20, 10, 90},   {96, 120, 20, 140},
+            {160, 230, 80, 40}, {216, 250, 200, 40}, {255, 255, 255, 240},
+        };
+        const int n = sizeof(stops) / sizeof(stops[0]);
+        for (int s = 0; s + 1 < n; s++) {
+            const Stop &a = stops[s], &b = stops[s + 1];
+            for (int i = a.at; i <= b.at; i++) {
+                int t = (b.at > a.at) ? (i - a.at) * 256 / (b.at - a.at) : 0;
+                uint8_t r = a.r + ((b.r - a.r) * t >> 8);
+                uint8_t g = a.g + ((b.g - a.g) * t >> 8);
+                uint8_t bl = a.b + ((b.b - a.b) * t >> 8);
+                uint16_t c = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (bl >> 3);
+                lut[i] = (uint16_t)((c >> 8) | (c << 8));
+            }
+        }
+    }
+
+    // Canvas-order (byte-swapped) colour for level v
+    uint16_t operator[](uint8_t v) const { return lut[v]; }
+    const uint16_t *table() const { return lut; }
+
+    // Plain RGB565, for fillRect() and friends
+    uint16_t color(uint8_t v) const { return (uint16_t)((lut[v] >> 8) | (lut[v] << 8)); }
+
+private:
+    uint16_t lut[256];
+};
@@ -0,0 +1,83 @@
+/**
+ * @file phosphor.h
+ * @brief Digital-phosphor waveform: hit counts with exponential decay.
+ *
+ * The WAVE view shows one frame; a glitch that lasts a few samples between
+ * two drawn frames never appears. Here every captured chunk is drawn into an
+ * 8-bit intensity buffer instead (capture side, in processChunk()), and the
+ * whole buffer fades a little per chunk, like the persistence of a CRT. Rare
+ * events stay visible as faint traces, frequent ones glow. The render task
+ * only colour-maps the buffer, so the frame rate does not change what is
+ * accumulated.
+ *
+ * The beam behaves like an analog scope sweep: kCols samples per sweep, then
+ * it waits for the next rising edge through 0 (auto-restarting if none comes
+ * within one sweep), so periodic signals overlay.
+ *
+ * The renderer reads while capture writes; a torn frame is one frame of
+ * slightly wrong brightness, which is not worth a lock on the capture path.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+class Phosphor {
+public:
+    static constexpr int kCols = 256; // Samples per sweep (one per column)
+    static constexpr int kRows = 137; // Amplitude resolution (x4 px on screen)
+
+    uint8_t hit = 48;     // Added per pass of the beam, saturating
+    uint8_t decay = 240;  // Kept per chunk, /256 (~0.25 s to 1/e at 17 kHz / 256)
+    int16_t hyst = 64;    // Edge must come from below -hyst
+
+    // Capture side: decay, then trace every sample of the chunk (gain: display scale factor)
+    void process(const int16_t *x, size_t n, int gain) {
+        fade();
+        for (size_t i = 0; i < n; i++) {
+            int32_t v = (int32_t)x[i] * gain;
+            if (col < 0) { // Waiting for the trigger
+                if (armed && v >= 0) col = 0;
+                else if (v < -hyst) armed = true;
+                if (col < 0 && ++waited >= kCols) col = 0; // Auto: free run, armed or not (DC / clipped low)
+                if (col < 0) continue;
+                prev_row = rowFor(v);
+            }
+            int r = rowFor(v);
+            int r0 = r < prev_row ? r : prev_row, r1 = r < prev_row ? prev_row : r;
+            for (int y = r0; y <= r1; y++) { // Vertical span joins consecutive samples
+                uint8_t &p = buf[y][col];
+                p = p > 255 - hit ? 255 : p + hit;
+            }
+            prev_row = r;
+            if (++col >= kCols) {
+                col = -1;
+                armed = false;
+                waited = 0;
+            }
+        }
+    }
+
+    const uint8_t *row(int r) const { return buf[r]; }
+    void clear() { memset(buf, 0, sizeof(buf)); }
+
+private:
+    uint8_t buf[kRows][kCols] = {};
+    int col = -1;
+    bool armed = false;
+    int waited = 0;
+    int prev_row = kRows / 2;
+
+    static int rowFor(int32_t v) {
+        int r = (kRows - 1) / 2 - (int)(v * (kRows / 2) / 32768);
+        return r < 0 ? 0 : r >= kRows ? kRows - 1 : r;
+    }
+
+    // Exponential decay over the whole buffer: one multiply and shift per byte, no branches,
+    // contiguous uint8_t, so the compiler can vectorise it
+    void fade() {
+        uint8_t *p = &buf[0][0];
+        const uint16_t d = decay;
+        for (int i = 0; i < kRows * kCols; i++) p[i] = (uint8_t)((p[i] * d) >> 8);
+    }
+};
@@ -0,0 +1,174 @@
+/**
+ * @file pitch.h
+ * @brief Real-time fundamental frequency (f0) tracker using YIN.
+ *
+ * Every kHop samples the tracker analyses the last kWindow + kTauMax samples:
+ * 1. Difference function d(tau) = E(0) + E(tau) - 2 r(tau). The cross term
+ *    r(tau) is computed for all lags at once with one packed complex FFT,
+ *    a spectrum multiply and one inverse FFT (O(N log N) instead of O(W*tau)).
+ * 2. Cumulative mean normalized difference d'(tau).
+ * 3. First dip below kThreshold, refined by parabolic interpolation.
+ *
+ * Results (f0 in Hz, 0 when unvoiced, and a 0..1 confidence) are kept in a
+ * short ring so network clients can fetch every hop since their last poll.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "fft.h"
+
+struct PitchResult {
+    float f0;         // Hz, 0 = unvoiced / no pitch
+    float confidence; // 1 - d'(tau) at the chosen lag
+};
+
+class PitchTracker {
+public:
+    static constexpr int   kWindow    = 512;  // Integration window W
+    static constexpr int   kTauMax    = 320;  // Longest lag (lowest f0 = fs / kTauMax)
+    static constexpr int   kHop       = 256;  // Samples between estimates
+    static constexpr int   kFFT       = 1024; // >= kWindow + kTauMax, so no circular wrap
+    static constexpr int   kSpan      = kWindow + kTauMax;
+    static constexpr int   kResults   = 64;   // History kept for /pitch clients
+    static constexpr float kThreshold = 0.15f;
+    static constexpr float kMaxF0     = 1500.0f;
+
+    void begin(float samplerate) {
+        fs = samplerate;
+        tau_min = (int)(fs / kMaxF0);
+        if (tau_min < 2) tau_min = 2;
+        memset(hist, 0, sizeof(hist));
+        memset(results, 0, sizeof(results));
+        fill = 0;
+        hop_fill = 0;
+        hop_count = 0;
+    }
+
+    // Feeds samples; returns true if at least one new estimate was produced
+    bool process(const int16_t *x, size_t n) {
+        bool produced = false;
+        while (n > 0) {
+            // Slide the analysis span left by whatever room we need
+            size_t take = kHop - hop_fill;
+            if (take > n) take = n;
+            if (fill + take > (size_t)kSpan) {
+                size_t drop = fill + take - kSpan;
+                memmove(hist, hist + drop, (fill - drop) * sizeof(int16_t));
+                fill -= drop;
+            }
+            memcpy(hist + fill, x, take * sizeof(int16_t));
+            fill += take;
+            hop_fill += take;
+            x += take;
+            n -= take;
+
+            if (hop_fill >= (size_t)kHop) {
+                hop_fill = 0;
+                if (fill >= (size_t)kSpan) {
+                    results[hop_count % kResults] = analyse();
+                    hop_count++;
+                    produced = true;
+                }
+            }
+        }
+        return produced;
+    }
+
+    uint32_t hops() const { return hop_count; }
+    PitchResult latest() const {
+        if (!hop_count) return PitchResult{0, 0};
+        return results[(hop_count - 1) % kResults];
+    }
+    // Result of hop number h (valid while hops() - h <= kResults)
+    PitchResult result(uint32_t h) const { return results[h % kResults]; }
+
+private:
+    float    fs = 17000;
+    int      tau_min = 11;
+    int16_t  hist[kSpan];
+    size_t   fill = 0;
+    size_t   hop_fill = 0;
+    uint32_t hop_count = 0;
+    PitchResult results[kResults];
+
+    float re[kFFT];
+    float im[kFFT];
+    float energy[kSpan + 1]; // Prefix sums of x^2
+    float cmnd[kTauMax + 1];
+    ComplexFFT<kFFT> fft;
+
+    PitchResult analyse() {
+        const float norm = 1.0f / 32768.0f;
+
+        // --- PACK: re = window a[j], im = full span b[j] (both real) ---
+        energy[0] = 0;
+        for (int j = 0; j < kSpan; j++) {
+            float v = hist[j] * norm;
+            re[j] = (j < kWindow) ? v : 0.0f;
+            im[j] = v;
+            energy[j + 1] = energy[j] + v * v;
+        }
+        for (int j = kSpan; j < kFFT; j++) re[j] = im[j] = 0.0f;
+
+        fft.forward(re, im);
+
+        // --- UNPACK & MULTIPLY: P = conj(A) * B, which is Hermitian ---
+        for (int k = 0; k <= kFFT / 2; k++) {
+            int m = (kFFT - k) & (kFFT - 1);
+            float zr = re[k], zi = im[k], cr = re[m], ci = -im[m];
+            float ar = 0.5f * (zr + cr), ai = 0.5f * (zi + ci);   // A_k
+            float br = 0.5f * (zi - ci), bi = -0.5f * (zr - cr);  // B_k = (Z - conj Z')/(2i)
+            float pr = ar * br + ai * bi;
+            float pi = ar * bi - ai * br;
+            re[k] = pr; im[k] = pi;
+            re[m] = pr; im[m] = -pi;
+        }
+
+        fft.inverse(re, im); // re[tau] = sum a[j] b[j + tau]
+
+        // --- DIFFERENCE + CMND ---
+        const float e0 = energy[kWindow];
+        if (e0 < 1e-7f) return PitchResult{0, 0}; // Silence: nothing to track
+
+        float running = 0;
+        cmnd[0] = 1.0f;
+        for (int tau = 1; tau <= kTauMax; tau++) {
+            float et = energy[tau + kWindow] - energy[tau];
+            float d = e0 + et - 2.0f * re[tau];
+            if (d < 0) d = 0;
+            running += d;
+            cmnd[tau] = (running > 0) ? d * tau / running : 1.0f;
+        }
+
+        // --- ABSOLUTE THRESHOLD (first dip), else global minimum ---
+        int best = -1;
+        for (int tau = tau_min; tau < kTauMax; tau++) {
+            if (cmnd[tau] < kThreshold) {
+                while (tau + 1 < kTauMax && cmnd[tau + 1] < cmnd[tau]) tau++;
+                best = tau;
+                break;
+            }
+        }
+        bool voiced = (best >= 0);
+        if (!voiced) {
+            best = tau_min;
+            for (int tau = tau_min + 1; tau < kTauMax; tau++) {
+                if (cmnd[tau] < cmnd[best]) best = tau;
+            }
+        }
+
+        // --- PARABOLIC INTERPOLATION ---
+        float tau_f = best;
+        if (best > 1 && best < kTauMax) {
+            float s0 = cmnd[best - 1], s1 = cmnd[best], s2 = cmnd[best + 1];
+            float den = s0 + s2 - 2.0f * s1;
+            if (fabsf(den) > 1e-9f) tau_f += 0.5f * (s0 - s2) / den;
+        }
+
+        float conf = 1.0f - cmnd[best];
+        if (conf < 0) conf = 0;
+        return PitchResult{voiced ? fs / tau_f : 0.0f, conf};
+    }
+};
@@ -0,0 +1,139 @@
+/**
+ * @file ring_stream.h
+ * @brief Streams a span of the capture history to an HTTP client as a WAV file.
+ *
+ * Raw chunks go out straight from rec_data (no copy), compressed ones are
+ * decoded a chunk at a time (history.h): the request handler writes the HTTP
+ * and WAV headers and hands the connection over, then loop() calls pump() to
+ * push a few KB per pass, so capture, the display and other clients keep
+ * running while the download is in progress.
+ *
+ * The span is sent oldest first. Since the mic keeps recording, the oldest
+ * samples are the ones at risk:
+ * - Normal: the span is limited to the history minus kMarginS, and anything
+ *   that still drops out of it first is sent as silence (counted).
+ * - Freeze: the full history may be requested; until each part is sent, the
+ *   mic is not allowed to push it out (see holds()), which pauses capture
+ *   only if the client is slower than real time.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "wav.h"
+#include "history.h"
+
+class RingStream {
+public:
+    static constexpr float    kMarginS     = 0.5f;
+    static constexpr size_t   kPumpBytes   = 8192;  // Per loop() pass
+    static constexpr uint32_t kTimeoutMs   = 5000;  // No progress for this long: give up
+
+    void begin(const ChunkHistory &h, uint32_t samplerate) {
+        hist = &h;
+        fs = samplerate;
+    }
+
+    bool active() const { return running; }
+    size_t maxSamples(bool freeze) const {
+        size_t history = hist->samples();
+        size_t margin = (size_t)(kMarginS * fs);
+        return freeze ? history : (history > margin ? history - margin : 0);
+    }
+
+    // Sends the headers and takes over the connection for samples [from, to)
+    bool start(WiFiClient c, uint64_t from, uint64_t to, bool freeze_ring, const char *filename) {
+        if (running || to <= from) return false;
+        client = c;
+        start_clock = from;
+        total = (to - from) * sizeof(int16_t);
+        sent = 0;
+        frozen = freeze_ring;
+
+        char head[256];
+        int len = snprintf(head, sizeof(head),
+                           "HTTP/1.1 200 OK\r\nContent-Type: audio/wav\r\nContent-Length: %lu\r\n"
+                           "Content-Disposition: attachment; filename=\"%s\"\r\n"
+                           "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n",
+                           (unsigned long)(kWavHeaderBytes + total), filename);
+        uint8_t wav[kWavHeaderBytes];
+        makeWavHeader(wav, (uint32_t)total, fs);
+        client.write((const uint8_t *)head, len);
+        client.write(wav, sizeof(wav));
+
+        running = true;
+        last_progress = millis();
+        transfers++;
+        return true;
+    }
+
+    // Called every loop() pass with the current sample clock
+    void pump(uint64_t now) {
+        if (!running) return;
+        if (!client.connected() || millis() - last_progress > kTimeoutMs) {
+            finish();
+            return;
+        }
+
+        size_t budget = kPumpBytes;
+        while (budget > 0 && sent < total) {
+            uint64_t clock = start_clock + sent / sizeof(int16_t);
+            size_t n = (size_t)((total - sent < budget) ? total - sent : budget);
+            size_t w;
+
+            size_t samples = (n + 1) / sizeof(int16_t) + 1;
+            const int16_t *run = hist->run(clock, samples, scratch);
+            if (!run) {
+                // Dropped out of the history first: silence keeps the file length and timeline
+                static const uint8_t zeros[512] = {0};
+                uint64_t oldest = hist->oldestClock();
+                uint64_t lost = (oldest > clock ? oldest - clock : 1) * sizeof(int16_t) - (sent & 1);
+                if (n > lost) n = (size_t)lost;
+                if (n > sizeof(zeros)) n = sizeof(zeros);
+                w = client.write(zeros, n);
+                overrun_bytes += w;
+            } else {
+                // Contiguous run: raw straight from rec_data, or one decoded chunk
+                size_t bytes = samples * sizeof(int16_t) - (size_t)(sent & 1);
+                if (n > bytes) n = bytes;
+                w = client.write((const uint8_t *)run + (sent & 1), n);
+            }
+            if (w == 0) break; // Socket buffer full: try again next pass
+            sent += w;
+            budget -= (w < budget) ? w : budget;
+            last_progress = millis();
+        }
+        if (sent >= total) finish();
+    }
+
+    // Freeze mode: true while recording the next chunk would push unsent samples out of the history
+    bool holds() const {
+        if (!running || !frozen) return false;
+        uint64_t clock = start_clock + sent / sizeof(int16_t);
+        return clock < hist->oldestClock() + hist->chunkLength();
+    }
+
+    uint32_t transferCount() const { return transfers; }
+    uint32_t overrunBytes() const { return overrun_bytes; }
+
+private:
+    const ChunkHistory *hist = nullptr;
+    uint32_t fs = 17000;
+    int16_t  scratch[ChunkHistory::kMaxChunkLen]; // Decoded chunk being sent
+
+    WiFiClient client;
+    bool     running = false;
+    bool     frozen = false;
+    uint64_t start_clock = 0;
+    uint64_t total = 0;     // Data bytes to send
+    uint64_t sent = 0;
+    uint32_t last_progress = 0;
+    uint32_t transfers = 0;
+    uint32_t overrun_bytes = 0;
+
+    void finish() {
+        client.stop();
+        client = WiFiClient();
+        running = false;
+    }
+};
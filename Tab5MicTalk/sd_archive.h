@@ -0,0 +1,258 @@
+/**
+ * @file sd_archive.h
+ * @brief Time index over the SD recorder's segments, and the /archive reader.
+ *
+ * Next to the REC_xxxxx.wav segments the recorder keeps an index file: one
+ * 16-byte ArchiveEntry per block written, giving the archive time of the
+ * block's first sample, the segment it went to and its byte offset there.
+ * Entries are appended in time order, so finding any instant is a binary
+ * search over the file (O(log n) small reads), however many hours it covers.
+ *
+ * Archive time is the sample clock carried on across reboots: the recorder
+ * starts each boot where the last indexed block ended, so the index stays
+ * sorted. Periods with nothing recorded are simply holes between entries.
+ *
+ * ArchiveStream serves a time span as one virtual WAV file (holes read as
+ * silence) and honours HTTP Range requests on it, so a player can seek hours
+ * back without anything but the requested bytes being read. Like RingStream,
+ * the handler only sends the headers; loop() calls pump() to move one large
+ * block read per pass.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+#include <WiFi.h>
+#include "wav.h"
+
+#ifndef ARCHIVE_READ_BYTES
+#define ARCHIVE_READ_BYTES 8192 // One SD read per loop() pass
+#endif
+#ifndef ARCHIVE_ALLOC
+#define ARCHIVE_ALLOC(bytes) malloc(bytes)
+#endif
+
+struct ArchiveEntry {
+    uint64_t t;       // Archive time of the first sample
+    uint32_t off;     // Byte offset of that sample in the segment file
+    uint16_t seg;     // Segment number (REC_<seg>.wav)
+    uint16_t samples; // Samples written contiguously from there
+};
+static_assert(sizeof(ArchiveEntry) == 16, "index entries are 16 bytes on the card");
+
+static inline void archiveIndexPath(char *out, size_t len, const char *dir) { snprintf(out, len, "%s/index.bin", dir); }
+static inline void archiveSegmentPath(char *out, size_t len, const char *dir, uint32_t seg) {
+    snprintf(out, len, "%s/REC_%05lu.wav", dir, (unsigned long)seg);
+}
+
+class ArchiveStream {
+public:
+    static constexpr uint32_t kTimeoutMs = 5000; // No progress for this long: give up
+
+    bool begin(uint32_t samplerate, const char *directory = "/rec") {
+        fs = samplerate;
+        strncpy(dir, directory, sizeof(dir) - 1);
+        buf = (uint8_t *)ARCHIVE_ALLOC(ARCHIVE_READ_BYTES);
+        return buf != nullptr;
+    }
+
+    bool active() const { return running; }
+
+    // First and one-past-last archive time in the index (false if it is empty)
+    bool extent(uint64_t &first, uint64_t &end) {
+        if (!openIndex()) return false;
+        ArchiveEntry a, b;
+        bool ok = count > 0 && readEntry(0, a) && readEntry(count - 1, b);
+        if (ok) {
+            first = a.t;
+            end = b.t + b.samples;
+        }
+        if (!running) index.close();
+        return ok;
+    }
+    uint32_t entries() const { return count; }
+
+    // Sends the headers for samples [from, to) as a WAV file, or for bytes [r0, r1] of it
+    // (HTTP Range, r1 inclusive). The caller has checked the range against fileBytes().
+    bool start(WiFiClient c, uint64_t from, uint64_t to, bool partial, uint64_t r0, uint64_t r1) {
+        if (running || to <= from || !buf || !openIndex()) return false;
+        client = c;
+        t_from = from;
+        data_bytes = (to - from) * sizeof(int16_t);
+        pos = partial ? r0 : 0;
+        end = partial ? r1 + 1 : kWavHeaderBytes + data_bytes;
+        buf_len = buf_pos = 0;
+        have_entry = false;
+
+        char head[320];
+        int len;
+        if (partial) {
+            len = snprintf(head, sizeof(head),
+                           "HTTP/1.1 206 Partial Content\r\nContent-Type: audio/wav\r\nContent-Length: %llu\r\n"
+                           "Content-Range: bytes %llu-%llu/%llu\r\n",
+                           (unsigned long long)(end - pos), (unsigned long long)r0, (unsigned long long)r1,
+                           (unsigned long long)(kWavHeaderBytes + data_bytes));
+        } else {
+            len = snprintf(head, sizeof(head),
+                           "HTTP/1.1 200 OK\r\nContent-Type: audio/wav\r\nContent-Length: %llu\r\n",
+                           (unsigned long long)(end - pos));
+        }
+        len += snprintf(head + len, sizeof(head) - len,
+                        "Content-Disposition: inline; filename=\"archive_%llu.wav\"\r\nAccept-Ranges: bytes\r\n"
+                        "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n",
+                        (unsigned long long)from);
+        client.write((const uint8_t *)head, len);
+
+        running = true;
+        last_progress = millis();
+        transfers++;
+        return true;
+    }
+
+    static uint64_t fileBytes(uint64_t samples) { return kWavHeaderBytes + samples * sizeof(int16_t); }
+
+    // Called every loop() pass: sends what is left of the last read, or reads the next block
+    void pump() {
+        if (!running) return;
+        if (!client.connected() || millis() - last_progress > kTimeoutMs) {
+            finish();
+            return;
+        }
+        if (buf_pos >= buf_len) {
+            if (pos >= end) {
+                finish();
+                return;
+            }
+            fill();
+        }
+        size_t w = client.write(buf + buf_pos, buf_len - buf_pos);
+        if (w > 0) {
+            buf_pos += w;
+            last_progress = millis();
+        }
+    }
+
+    uint32_t transferCount() const { return transfers; }
+    uint32_t maxReadMs() const { return max_read_us / 1000; }
+
+private:
+    char     dir[16] = "/rec";
+    uint32_t fs = 17000;
+    uint8_t *buf = nullptr;
+
+    File     index;
+    uint32_t count = 0;  // Entries in the index when it was opened
+    File     seg_file;
+    uint16_t seg_open = 0;
+
+    WiFiClient client;
+    bool     running = false;
+    uint64_t t_from = 0;
+    uint64_t data_bytes = 0;
+    uint64_t pos = 0;     // Next byte of the virtual file to read
+    uint64_t end = 0;     // One past the last byte to send
+    size_t   buf_len = 0, buf_pos = 0;
+    uint32_t last_progress = 0;
+    uint32_t transfers = 0;
+    uint32_t max_read_us = 0;
+
+    // Entry covering the current read position, and where the next one starts
+    bool         have_entry = false;
+    ArchiveEntry cur;
+    uint64_t     next_t = 0;
+
+    bool openIndex() {
+        if (index) return true;
+        char p[32];
+        archiveIndexPath(p, sizeof(p), dir);
+        index = SD.open(p, FILE_READ);
+        if (!index) return false;
+        count = index.size() / sizeof(ArchiveEntry); // Only whole, flushed entries
+        return true;
+    }
+
+    bool readEntry(uint32_t i, ArchiveEntry &e) {
+        return index.seek((uint64_t)i * sizeof(ArchiveEntry)) &&
+               index.read((uint8_t *)&e, sizeof(e)) == sizeof(e);
+    }
+
+    // Binary search for the last entry starting at or before t. Leaves cur/next_t describing it;
+    // cur.samples == 0 marks the hole before the first entry.
+    void locate(uint64_t t) {
+        ArchiveEntry e;
+        uint32_t lo = 0, hi = count; // Answer is lo - 1 once lo == hi
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (readEntry(mid, e) && e.t <= t) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == 0 || !readEntry(lo - 1, cur)) cur = {t, 0, 0, 0};
+        next_t = (lo < count && readEntry(lo, e)) ? e.t : UINT64_MAX;
+        have_entry = true;
+    }
+
+    // Reads the next block of the virtual file into buf: header, samples, silence in the holes
+    void fill() {
+        uint32_t t0 = micros();
+        size_t cap = ARCHIVE_READ_BYTES;
+        if (end - pos < cap) cap = (size_t)(end - pos);
+        buf_len = buf_pos = 0;
+
+        if (pos < kWavHeaderBytes) {
+            uint8_t hdr[kWavHeaderBytes];
+            makeWavHeader(hdr, (uint32_t)data_bytes, fs);
+            size_t n = kWavHeaderBytes - (size_t)pos;
+            if (n > cap) n = cap;
+            memcpy(buf, hdr + pos, n);
+            buf_len = n;
+        }
+
+        while (buf_len < cap) {
+            uint64_t d = pos + buf_len - kWavHeaderBytes;
+            uint64_t t = t_from + d / sizeof(int16_t);
+            if (!have_entry || t < cur.t || t >= next_t) locate(t);
+
+            size_t room = cap - buf_len;
+            if (t < cur.t + cur.samples) {
+                // Inside a recorded block: one read up to its end
+                uint64_t avail = (cur.t + cur.samples - t) * sizeof(int16_t) - (d & 1);
+                size_t n = (avail < room) ? (size_t)avail : room;
+                size_t got = 0;
+                if (openSegment(cur.seg) &&
+                    seg_file.seek(cur.off + (t - cur.t) * sizeof(int16_t) + (d & 1))) {
+                    got = seg_file.read(buf + buf_len, n);
+                }
+                if (got < n) memset(buf + buf_len + got, 0, n - got); // Segment missing or cut short
+                buf_len += n;
+            } else {
+                // Hole until the next entry (or the end of the request)
+                uint64_t gap = (next_t == UINT64_MAX) ? room : (next_t - t) * sizeof(int16_t) - (d & 1);
+                size_t n = (gap < room) ? (size_t)gap : room;
+                memset(buf + buf_len, 0, n);
+                buf_len += n;
+            }
+        }
+        pos += buf_len;
+
+        uint32_t us = micros() - t0;
+        if (us > max_read_us) max_read_us = us;
+    }
+
+    bool openSegment(uint16_t seg) {
+        if (seg_file && seg_open == seg) return true;
+        if (seg_file) seg_file.close();
+        char p[32];
+        archiveSegmentPath(p, sizeof(p), dir, seg);
+        seg_file = SD.open(p, FILE_READ);
+        seg_open = seg;
+        return (bool)seg_file;
+    }
+
+    void finish() {
+        client.stop();
+        client = WiFiClient();
+        if (seg_file) seg_file.close();
+        if (index) index.close();
+        running = false;
+    }
+};
@@ -0,0 +1,351 @@
+/**
+ * @file sd_recorder.h
+ * @brief Continuous WAV recording to SD from a background task.
+ *
+ * The capture side only ever memcpy()s each processed chunk into one of two
+ * large RAM buffers; a full buffer is handed to a writer task through a
+ * queue and capture carries on in the other one. Capture never waits on the
+ * card: if the writer still holds the other buffer when it is needed, the
+ * samples are counted as dropped from the file, never from the ring.
+ *
+ * FAT cluster allocation is what makes SD writes stall, so segments are
+ * preallocated: the writer extends the *next* file to its full size while it
+ * is idle (from boot on, so the first segment of a recording is ready too),
+ * and writes into it in place ("r+") when the current one is full. An unused
+ * preallocation is kept for the next start, and after a reboot it is
+ * recognised (full size, no WAV header yet) and reused.
+ * The WAV header is patched with the real length every few seconds and on
+ * close; players ignore the unused preallocated tail after the data chunk.
+ *
+ * Every block written is also appended to the archive index (sd_archive.h)
+ * with its time on the sample clock, batched and flushed only after the audio
+ * it points at, so a reader never finds an entry ahead of its data.
+ *
+ * Reported: write latency per block, and headroom (how much of one buffer's
+ * duration was left when its write finished; near 0 means drops are close).
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+#include "wav.h"
+#include "sd_archive.h"
+#include "trace.h"
+
+#ifndef SDREC_BUFFER_BYTES
+#define SDREC_BUFFER_BYTES 16384 // Per buffer (x2): ~0.5 s at 17 kHz
+#endif
+#ifndef SDREC_SEGMENT_SECONDS
+#define SDREC_SEGMENT_SECONDS 300 // 5 minute segments (~10 MB at 17 kHz)
+#endif
+#ifndef SDREC_ALLOC
+#define SDREC_ALLOC(bytes) malloc(bytes)
+#endif
+
+class SdRecorder {
+public:
+    static constexpr size_t   kBufSamples = SDREC_BUFFER_BYTES / sizeof(int16_t);
+    static constexpr uint32_t kSyncBlocks = 16; // Patch header + flush every N blocks
+    static_assert(kBufSamples <= UINT16_MAX, "a block must fit ArchiveEntry::samples");
+
+    // Allocates the buffers and starts the writer task. dir must exist or be creatable.
+    bool begin(uint32_t samplerate, const char *directory = "/rec") {
+        fs = samplerate;
+        strncpy(dir, directory, sizeof(dir) - 1);
+        for (int i = 0; i < 2; i++) {
+            buf[i] = (int16_t *)SDREC_ALLOC(kBufSamples * sizeof(int16_t));
+            if (!buf[i]) return false;
+            busy[i] = false;
+        }
+        findArchiveBase();
+        queue = xQueueCreate(4, sizeof(Msg));
+        if (!queue) return false;
+        return xTaskCreatePinnedToCore(taskEntry, "sdrec", 6144, this, 2, &task, 0) == pdPASS;
+    }
+
+    // --- CAPTURE SIDE (loop) ---
+
+    bool start() {
+        if (!queue || recording) return false;
+        active = 0;
+        fill = 0;
+        Msg m = {MSG_START, 0, 0, 0, 0};
+        if (xQueueSend(queue, &m, 0) != pdTRUE) return false;
+        recording = true;
+        return true;
+    }
+
+    void stop() {
+        if (!recording) return;
+        recording = false;
+        if (fill > 0 && !busy[active]) submit();
+        else if (fill > 0) dropped += fill; // Writer still holds this buffer: the tail is lost, say so
+        fill = 0;
+        Msg m = {MSG_STOP, 0, 0, 0, 0};
+        xQueueSend(queue, &m, pdMS_TO_TICKS(100)); // Only place that may wait: a user action, not capture
+    }
+
+    // Copies samples into the active buffer. Never blocks. clock: sample clock of x[0].
+    void push(const int16_t *x, size_t n, uint64_t clock) {
+        if (!recording) return;
+        while (n > 0) {
+            if (busy[active]) { // Writer is behind: lose these from the file, not from capture
+                dropped += n;
+                return;
+            }
+            if (fill == 0) buf_t[active] = archive_base + clock;
+            size_t take = kBufSamples - fill;
+            if (take > n) take = n;
+            memcpy(buf[active] + fill, x, take * sizeof(int16_t));
+            fill += take;
+            clock += take;
+            x += take;
+            n -= take;
+            if (fill == kBufSamples) submit();
+        }
+    }
+
+    // --- STATUS ---
+
+    bool isRecording() const { return recording; }
+    uint64_t archiveTime(uint64_t clock) const { return archive_base + clock; } // Sample clock -> archive time
+    const char *currentFile() const { return path; }
+    uint32_t segment() const { return seg_index; }
+    float segmentSeconds() const { return (float)seg_samples / fs; }
+    uint32_t blocksWritten() const { return blocks; }
+    uint64_t bytesWritten() const { return bytes; }
+    uint32_t droppedSamples() const { return dropped; }
+    float maxWriteMs() const { return max_write_us / 1000.0f; }
+    float avgWriteMs() const { return blocks ? (float)(total_write_us / blocks) / 1000.0f : 0; }
+    float minHeadroomMs() const { return min_headroom_us / 1000.0f; }
+    float bufferMs() const { return kBufSamples * 1000.0f / fs; }
+    void resetStats() {
+        max_write_us = 0;
+        total_write_us = 0;
+        min_headroom_us = (int32_t)(kBufSamples * 1000000ULL / fs);
+        dropped = 0;
+    }
+
+private:
+    enum MsgType : uint8_t { MSG_START, MSG_DATA, MSG_STOP };
+    struct Msg {
+        MsgType  type;
+        uint8_t  buf;
+        uint32_t samples;
+        uint32_t handed_us; // When capture handed the buffer over
+        uint64_t t;         // Archive time of the first sample
+    };
+
+    uint32_t fs = 17000;
+    char dir[16] = "/rec";
+
+    // Capture side
+    int16_t *buf[2] = {nullptr, nullptr};
+    uint64_t buf_t[2] = {0, 0};
+    uint64_t archive_base = 0; // Archive time at this boot's sample clock 0
+    volatile bool busy[2] = {false, false}; // Owned by the writer until written
+    uint8_t  active = 0;
+    size_t   fill = 0;
+    volatile bool recording = false;
+    QueueHandle_t queue = nullptr;
+    TaskHandle_t  task = nullptr;
+
+    // Writer side
+    File     file;
+    char     path[32] = "";
+    char     next_path[32] = "";
+    bool     next_ready = false;
+    uint32_t next_index = 1;
+    uint32_t seg_index = 0;
+    volatile uint32_t seg_samples = 0;
+    File     index;
+    ArchiveEntry pending[kSyncBlocks * 2]; // Index entries not on the card yet (a block may split at rotation)
+    uint32_t pending_n = 0;
+
+    // Stats (written by the task, read by loop; 32-bit stores are atomic here)
+    volatile uint32_t blocks = 0;
+    volatile uint64_t bytes = 0;
+    volatile uint32_t dropped = 0;
+    volatile uint32_t max_write_us = 0;
+    volatile uint64_t total_write_us = 0;
+    volatile int32_t  min_headroom_us = INT32_MAX;
+
+    uint32_t segCapacity() const { return SDREC_SEGMENT_SECONDS * fs; } // Samples per segment
+
+    void submit() {
+        busy[active] = true;
+        Msg m = {MSG_DATA, active, (uint32_t)fill, (uint32_t)micros(), buf_t[active]};
+        if (xQueueSend(queue, &m, 0) != pdTRUE) {
+            busy[active] = false;
+            dropped += fill;
+        }
+        active ^= 1;
+        fill = 0;
+    }
+
+    static void taskEntry(void *arg) { static_cast<SdRecorder *>(arg)->run(); }
+
+    void run() {
+        Msg m;
+        findNextIndex();
+        for (;;) {
+            // While idle, get the next segment ready so neither start nor rotation allocates
+            // (retried every 50 ms while recording, every second otherwise, e.g. with the card full)
+            TickType_t wait = next_ready ? portMAX_DELAY : pdMS_TO_TICKS(file ? 50 : 1000);
+            if (xQueueReceive(queue, &m, wait) != pdTRUE) {
+                prepareNext();
+                continue;
+            }
+            switch (m.type) {
+            case MSG_START:
+                resetStats();
+                if (!next_ready) findNextIndex();
+                openIndex();
+                openSegment();
+                break;
+            case MSG_DATA:
+                writeBlock(buf[m.buf], m.samples, m.t, m.handed_us);
+                busy[m.buf] = false;
+                break;
+            case MSG_STOP:
+                closeSegment();
+                if (index) index.close();
+                break; // An unused preallocation stays ready for the next start
+            }
+        }
+    }
+
+    void makePath(char *out, uint32_t index) { archiveSegmentPath(out, 32, dir, index); }
+
+    // Carries archive time on from the end of the last indexed block, so the index stays sorted across boots
+    void findArchiveBase() {
+        char p[32];
+        archiveIndexPath(p, sizeof(p), dir);
+        File f = SD.open(p, FILE_READ);
+        if (!f) return;
+        size_t n = f.size() / sizeof(ArchiveEntry);
+        ArchiveEntry e;
+        if (n > 0 && f.seek((n - 1) * sizeof(ArchiveEntry)) && f.read((uint8_t *)&e, sizeof(e)) == sizeof(e)) {
+            archive_base = e.t + e.samples;
+        }
+        f.close();
+    }
+
+    void openIndex() {
+        char p[32];
+        archiveIndexPath(p, sizeof(p), dir);
+        index = SD.open(p, FILE_APPEND);
+        pending_n = 0;
+    }
+
+    // Called before the block is written, so every pending entry points at audio already written
+    void addIndex(uint64_t t, uint32_t off, uint32_t samples) {
+        if (seg_index > UINT16_MAX) return; // ArchiveEntry::seg would wrap: later segments stay out of the index
+        if (pending_n == sizeof(pending) / sizeof(pending[0])) { // Full between syncs: audio first, then the index
+            if (file) file.flush();
+            flushIndex();
+        }
+        pending[pending_n++] = {t, off, (uint16_t)seg_index, (uint16_t)samples};
+    }
+
+    // Call only once the audio the entries point at has been flushed
+    void flushIndex() {
+        if (index && pending_n > 0) {
+            index.write((const uint8_t *)pending, pending_n * sizeof(ArchiveEntry));
+            index.flush();
+        }
+        pending_n = 0;
+    }
+
+    void findNextIndex() {
+        if (!SD.exists(dir)) SD.mkdir(dir);
+        char p[32];
+        for (makePath(p, next_index); SD.exists(p); makePath(p, ++next_index)) {}
+        next_ready = false;
+        if (next_index > 1) { // Last one a preallocation never written to (full size, no "RIFF")?
+            makePath(p, next_index - 1);
+            File f = SD.open(p, FILE_READ);
+            char riff[4] = {0};
+            if (f && f.size() == kWavHeaderBytes + segCapacity() * sizeof(int16_t) && f.read((uint8_t *)riff, 4) == 4 &&
+                memcmp(riff, "RIFF", 4) != 0) {
+                strcpy(next_path, p);
+                next_index--;
+                next_ready = true;
+            }
+            if (f) f.close();
+        }
+    }
+
+    // Creates the next segment at full size (allocates all its clusters now, not mid-recording)
+    void prepareNext() {
+        if (next_ready) return;
+        makePath(next_path, next_index);
+        File f = SD.open(next_path, FILE_WRITE);
+        if (!f) return;
+        bool ok = f.seek(kWavHeaderBytes + segCapacity() * sizeof(int16_t) - 1) && f.write((uint8_t)0) == 1;
+        f.close();
+        if (ok) next_ready = true;
+        else SD.remove(next_path); // Card full or failing: no truncated "preallocation", retry later
+    }
+
+    void openSegment() {
+        prepareNext();
+        if (!next_ready) return;
+        strcpy(path, next_path);
+        seg_index = next_index++;
+        next_ready = false;
+        file = SD.open(path, "r+"); // Overwrite in place, keep the preallocated length
+        if (!file) return;
+        uint8_t hdr[kWavHeaderBytes];
+        makeWavHeader(hdr, 0, fs);
+        file.write(hdr, sizeof(hdr));
+        seg_samples = 0;
+    }
+
+    void patchHeader() {
+        uint8_t hdr[kWavHeaderBytes];
+        makeWavHeader(hdr, seg_samples * sizeof(int16_t), fs);
+        size_t pos = file.position();
+        file.seek(0);
+        file.write(hdr, sizeof(hdr));
+        file.seek(pos);
+        file.flush();
+        flushIndex(); // After the audio, never ahead of it
+    }
+
+    void closeSegment() {
+        if (!file) return;
+        patchHeader();
+        file.close();
+    }
+
+    void writeBlock(const int16_t *x, uint32_t n, uint64_t t, uint32_t handed_us) {
+        TRACE_SCOPE("sd_write");
+        uint32_t t0 = micros();
+        while (n > 0 && file) {
+            uint32_t room = segCapacity() - seg_samples;
+            uint32_t take = (n < room) ? n : room;
+            addIndex(t, kWavHeaderBytes + seg_samples * sizeof(int16_t), take);
+            t += take;
+            file.write((const uint8_t *)x, take * sizeof(int16_t));
+            seg_samples += take;
+            bytes += take * sizeof(int16_t);
+            x += take;
+            n -= take;
+            if (seg_samples >= segCapacity()) { // Rotate into the preallocated next segment
+                closeSegment();
+                openSegment();
+            }
+        }
+        if (n > 0) dropped += n; // No file (card removed / full)
+
+        uint32_t t1 = micros();
+        uint32_t write_us = t1 - t0;
+        blocks++;
+        total_write_us += write_us;
+        if (write_us > max_write_us) max_write_us = write_us;
+        int32_t headroom = (int32_t)(kBufSamples * 1000000ULL / fs) - (int32_t)(t1 - handed_us);
+        if (headroom < min_headroom_us) min_headroom_us = headroom;
+        if (file && blocks % kSyncBlocks == 0) patchHeader();
+    }
+};
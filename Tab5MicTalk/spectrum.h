@@ -294,7 +294,11 @@ const char spectrum_html[] PROGMEM = R"rawliteral(
             pollInterval = setInterval(() => {
                 fetch(url)
                     .then(r => r.json())
-                    .then(json => computeFFT(json.data))
+                    .then(json => {
+                        // Silent chunks arrive as a data-less heartbeat: just let the bars fall
+                        if (json.data) computeFFT(json.data);
+                        else statusLight.className = "status-light connected";
+                    })
                     .catch(e => {
                         console.error(e);
                         statusLight.className = "status-light error";
@@ -0,0 +1,144 @@
+/**
+ * @file tones.h
+ * @brief Goertzel tone-detector bank for watching a few known frequencies.
+ *
+ * Each detector is a single-bin DFT (Goertzel filter) evaluated over every
+ * captured chunk. For K tones and an N-sample chunk this costs about K*N
+ * multiply-adds, so 16 tones over a 256-sample chunk is still cheaper than
+ * one 256-point FFT, and the frequencies do not have to sit on FFT bins.
+ *
+ * Detection uses two thresholds (on/off) plus a chunk count on each side so
+ * a tone hovering near the threshold does not chatter.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ToneDetector {
+    float    freq;      // Target frequency (Hz)
+    float    on_db;     // Level (dBFS) that must be exceeded to switch on
+    float    off_db;    // Level (dBFS) it must drop below to switch off
+    float    level_db;  // Last measured level (dBFS)
+    bool     active;    // Current detection state
+    uint8_t  run;       // Consecutive chunks past the opposite threshold
+    uint32_t event_ms;  // millis() of the last on/off transition
+    uint32_t hits;      // Number of detections since boot
+};
+
+class ToneBank {
+public:
+    static constexpr int   kMaxTones  = 16;
+    static constexpr int   kOnChunks  = 2;       // Chunks above on_db before reporting
+    static constexpr int   kOffChunks = 3;       // Chunks below off_db before releasing
+    static constexpr float kFloorDb   = -120.0f;
+
+    void begin(float samplerate) {
+        fs = samplerate;
+        clear();
+    }
+
+    void clear() {
+        count = 0;
+        active_mask = 0;
+    }
+
+    // Adds a detector. Returns false if the bank is full or the frequency is out of range.
+    bool add(float freq, float on_db = -40.0f, float off_db = -46.0f) {
+        if (count >= kMaxTones || freq <= 0 || freq >= fs * 0.5f) return false;
+        if (off_db > on_db) off_db = on_db;
+
+        ToneDetector &t = tones[count];
+        memset(&t, 0, sizeof(t));
+        t.freq = freq;
+        t.on_db = on_db;
+        t.off_db = off_db;
+        t.level_db = kFloorDb;
+        coeff[count] = 2.0f * cosf(2.0f * (float)M_PI * freq / fs);
+        count++;
+        return true;
+    }
+
+    // Parses one config line: "<freq> [on_db] [off_db]". Blank lines and '#' comments are ignored.
+    bool parseLine(const char *line) {
+        while (*line == ' ' || *line == '\t') line++;
+        if (*line == '\0' || *line == '#' || *line == '\r' || *line == '\n') return false;
+
+        char *end;
+        float freq = strtof(line, &end);
+        if (end == line) return false;
+        float on = -40.0f, off;
+        char *next;
+        float v = strtof(end, &next);
+        if (next != end) { on = v; end = next; }
+        off = on - 6.0f;
+        v = strtof(end, &next);
+        if (next != end) off = v;
+        return add(freq, on, off);
+    }
+
+    // Runs every detector over one chunk. Returns a bitmask of tones that just switched on.
+    uint16_t process(const int16_t *x, size_t n, uint32_t now_ms) {
+        if (!count || !n) return 0;
+
+        float s1[kMaxTones] = {0};
+        float s2[kMaxTones] = {0};
+
+        // One pass over the samples; the inner loop over tones is branch-free and vectorizes
+        for (size_t i = 0; i < n; i++) {
+            float in = x[i];
+            for (int k = 0; k < count; k++) {
+                float s0 = in + coeff[k] * s1[k] - s2[k];
+                s2[k] = s1[k];
+                s1[k] = s0;
+            }
+        }
+
+        // A full-scale sine gives |X| = 32768 * n / 2
+        const float ref = 2.0f / (32768.0f * n);
+        uint16_t onsets = 0;
+
+        for (int k = 0; k < count; k++) {
+            ToneDetector &t = tones[k];
+            float power = s1[k] * s1[k] + s2[k] * s2[k] - coeff[k] * s1[k] * s2[k];
+            float amp = (power > 0) ? sqrtf(power) * ref : 0;
+            t.level_db = (amp > 0) ? 20.0f * log10f(amp) : kFloorDb;
+            if (t.level_db < kFloorDb) t.level_db = kFloorDb;
+
+            // --- HYSTERESIS ---
+            bool crossing = t.active ? (t.level_db < t.off_db) : (t.level_db >= t.on_db);
+            t.run = crossing ? t.run + 1 : 0;
+
+            if (!t.active && t.run >= kOnChunks) {
+                t.active = true;
+                t.run = 0;
+                t.event_ms = now_ms;
+                t.hits++;
+                onsets |= (1u << k);
+            } else if (t.active && t.run >= kOffChunks) {
+                t.active = false;
+                t.run = 0;
+                t.event_ms = now_ms;
+            }
+        }
+
+        active_mask = 0;
+        for (int k = 0; k < count; k++) {
+            if (tones[k].active) active_mask |= (1u << k);
+        }
+        return onsets;
+    }
+
+    int size() const { return count; }
+    uint16_t activeMask() const { return active_mask; }
+    const ToneDetector &tone(int i) const { return tones[i]; }
+
+private:
+    float        fs = 17000;
+    int          count = 0;
+    uint16_t     active_mask = 0;
+    float        coeff[kMaxTones];
+    ToneDetector tones[kMaxTones];
+};
@@ -0,0 +1,151 @@
+/**
+ * @file trigger.h
+ * @brief Oscilloscope-style trigger and timebase over the capture ring.
+ *
+ * Instead of drawing whatever chunk just arrived, the scope searches the
+ * recorded history (newest first) for an edge crossing the trigger level and
+ * places it at a fixed screen position, so periodic signals stand still.
+ *
+ * - Edge: rising or falling, with a little hysteresis against noise.
+ * - Holdoff: minimum time between two triggers that get displayed.
+ * - Modes: OFF (free run), AUTO (free run if nothing triggers), NORMAL (keep
+ *   the last triggered frame), SINGLE (freeze after one trigger until re-armed).
+ * - Timebase: samples per column. Each column keeps the min and max of its
+ *   samples, so long spans decimate without losing short spikes.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum TriggerMode : uint8_t { TRIG_OFF, TRIG_AUTO, TRIG_NORMAL, TRIG_SINGLE };
+enum TriggerEdge : uint8_t { EDGE_RISING, EDGE_FALLING };
+
+static const char *const triggerModeNames[] = {"OFF", "AUTO", "NORM", "SINGLE"};
+
+struct TriggerConfig {
+    TriggerMode mode    = TRIG_AUTO;
+    TriggerEdge edge    = EDGE_RISING;
+    int16_t     level   = 0;    // Trigger level (raw sample units)
+    int16_t     hyst    = 64;   // Signal must come from beyond level -/+ hyst
+    uint32_t    holdoff = 0;    // Samples after a trigger during which new ones are ignored
+    uint16_t    spp     = 1;    // Timebase: samples per column
+};
+
+class ScopeTrigger {
+public:
+    static constexpr int kPreDivisor = 4; // Trigger sits 1/4 of the way across the screen
+
+    TriggerConfig cfg;
+
+    void arm() { single_done = false; }
+    bool triggered() const { return last_triggered; }
+    bool waiting() const { return cfg.mode == TRIG_SINGLE && single_done; }
+
+    /**
+     * @param ring       Circular sample buffer of ring_len samples.
+     * @param newest     Ring position one past the newest complete sample.
+     * @param clock      Absolute sample count at `newest` (used for holdoff).
+     * @param history    Number of valid samples behind `newest`.
+     * @param cols       Columns to produce; mins/maxs must hold cols entries.
+     * @return true if mins/maxs hold a new frame, false to keep the previous one.
+     */
+    bool capture(const int16_t *ring, size_t ring_len, size_t newest, uint32_t clock,
+                 size_t history, int cols, int16_t *mins, int16_t *maxs) {
+        if (cols <= 0) return false;
+        if (waiting()) return false;
+
+        size_t spp = cfg.spp ? cfg.spp : 1;
+        size_t span = (size_t)cols * spp + 1; // +1: last column connects to the next sample
+        if (span > history) {
+            spp = (history - 1) / cols;
+            if (spp == 0) return false;
+            span = (size_t)cols * spp + 1;
+        }
+        size_t pre = span / kPreDivisor;
+
+        // Newest possible trigger is where the rest of the screen still fits in the history
+        size_t back = span - pre;          // Samples from trigger to newest
+        size_t limit = history - pre;      // Oldest possible trigger (samples behind newest)
+        size_t max_search = 4 * span;      // Bound the work per frame
+        if (limit > back + max_search) limit = back + max_search;
+
+        last_triggered = false;
+        size_t found = 0;
+        if (cfg.mode != TRIG_OFF) {
+            for (size_t d = back; d < limit; d++) {
+                // Holdoff: anything older than last_trig + holdoff is not allowed either
+                uint32_t t_abs = clock - (uint32_t)d;
+                if (have_trig && (int32_t)(t_abs - last_trig - cfg.holdoff) < 0) break;
+                if (isEdge(ring, ring_len, newest, d)) {
+                    found = d;
+                    last_triggered = true;
+                    break;
+                }
+            }
+        }
+
+        if (last_triggered) {
+            last_trig = clock - (uint32_t)found;
+            have_trig = true;
+            if (cfg.mode == TRIG_SINGLE) single_done = true;
+            decimate(ring, ring_len, newest, found + pre, cols, spp, mins, maxs);
+            return true;
+        }
+
+        if (cfg.mode == TRIG_OFF || cfg.mode == TRIG_AUTO) {
+            decimate(ring, ring_len, newest, span, cols, spp, mins, maxs);
+            return true;
+        }
+        return false; // NORMAL / SINGLE without a trigger: keep the old frame
+    }
+
+    // Min/max per column starting `back` samples behind newest
+    static void decimate(const int16_t *ring, size_t ring_len, size_t newest, size_t back,
+                         int cols, size_t spp, int16_t *mins, int16_t *maxs) {
+        size_t pos = (newest + ring_len - back % ring_len) % ring_len;
+        for (int c = 0; c < cols; c++) {
+            int16_t lo = ring[pos], hi = lo;
+            // Include the first sample of the next column so the trace is continuous
+            size_t p = pos;
+            for (size_t k = 0; k < spp; k++) {
+                if (++p >= ring_len) p = 0;
+                int16_t v = ring[p];
+                if (v < lo) lo = v;
+                if (v > hi) hi = v;
+            }
+            mins[c] = lo;
+            maxs[c] = hi;
+            pos += spp;
+            if (pos >= ring_len) pos -= ring_len;
+        }
+    }
+
+private:
+    uint32_t last_trig = 0;
+    bool have_trig = false;
+    bool single_done = false;
+    bool last_triggered = false;
+
+    static int16_t at(const int16_t *ring, size_t ring_len, size_t newest, size_t d) {
+        return ring[(newest + ring_len - d) % ring_len];
+    }
+
+    // Edge between the samples d+1 and d behind newest, with hysteresis over the 4 before it
+    bool isEdge(const int16_t *ring, size_t ring_len, size_t newest, size_t d) const {
+        int16_t cur = at(ring, ring_len, newest, d);
+        int16_t prev = at(ring, ring_len, newest, d + 1);
+        if (cfg.edge == EDGE_RISING) {
+            if (!(prev < cfg.level && cur >= cfg.level)) return false;
+            for (size_t k = 1; k <= 4; k++) {
+                if (at(ring, ring_len, newest, d + k) < cfg.level - cfg.hyst) return true;
+            }
+        } else {
+            if (!(prev > cfg.level && cur <= cfg.level)) return false;
+            for (size_t k = 1; k <= 4; k++) {
+                if (at(ring, ring_len, newest, d + k) > cfg.level + cfg.hyst) return true;
+            }
+        }
+        return false;
+    }
+};
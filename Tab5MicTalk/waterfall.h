@@ -0,0 +1,91 @@
+/**
+ * @file waterfall.h
+ * @brief Spectrogram rows for the WATERFALL view, one per captured chunk.
+ *
+ * The capture side runs process() on every chunk while the view is shown:
+ * Hann window, 256-point FFT, magnitude in dBFS mapped to a 0-255 level per
+ * bin. The rows go into a small single-producer / single-consumer queue that
+ * the render task drains, however many chunks arrived since its last frame,
+ * so every chunk becomes a row even at a low frame rate. The render task
+ * peek()s a row, draws it and only then release()s the slot, so a full queue
+ * never has the producer writing the row being read; head / tail are
+ * acquire / release atomics, as the two sides run on different cores.
+ *
+ * Drawing is the sketch's job: each row is written once, into the canvas at
+ * a sweeping line (see drawWaterfall() in the sketch), never redrawn.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "fft.h"
+#include "trace.h"
+
+class Waterfall {
+public:
+    static constexpr int kFFT = 256;
+    static constexpr int kBins = kFFT / 2;  // DC .. fs/2 - one bin
+    static constexpr int kQueue = 32;       // Rows buffered for the render task (~0.5 s at 17 kHz / 256)
+
+    float floor_db = -90.0f; // Level 0
+    float top_db = -10.0f;   // Level 255
+
+    Waterfall() {
+        for (int i = 0; i < kFFT; i++) window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / kFFT);
+    }
+
+    // Capture side: one row from the first kFFT samples of the chunk (zero-padded if shorter)
+    void process(const int16_t *x, size_t n) {
+        if (n > (size_t)kFFT) n = kFFT;
+        for (size_t i = 0; i < n; i++) {
+            re[i] = x[i] * window[i];
+            im[i] = 0;
+        }
+        for (int i = n; i < kFFT; i++) re[i] = im[i] = 0;
+        TRACE_BEGIN("fft");
+        fft.forward(re, im);
+        TRACE_END("fft");
+
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= kQueue) { // Render task is behind: this row is lost
+            dropped++;
+            return;
+        }
+        uint8_t *row = rows[h % kQueue];
+        // Full-scale sine with a Hann window: |X| = 32768 * N / 4
+        const float ref_db = 20.0f * log10f(32768.0f * kFFT / 4);
+        const float scale = 255.0f / (top_db - floor_db);
+        for (int k = 0; k < kBins; k++) {
+            float p = re[k] * re[k] + im[k] * im[k] + 1e-3f;
+            float db = 10.0f * log10f(p) - ref_db;
+            float v = (db - floor_db) * scale;
+            row[k] = v <= 0 ? 0 : v >= 255 ? 255 : (uint8_t)v;
+        }
+        head.store(h + 1, std::memory_order_release); // Publishes the row
+    }
+
+    // Render side: oldest queued row, or nullptr. Stays valid (the producer skips its slot)
+    // until release().
+    const uint8_t *peek() const {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return nullptr;
+        return rows[t % kQueue];
+    }
+
+    // Render side: the peeked row is drawn, its slot may be refilled
+    void release() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Forget queued rows (after the view was cleared; renderer lock held)
+    void flush() { tail.store(head.load(std::memory_order_acquire), std::memory_order_release); }
+
+    volatile uint32_t dropped = 0;
+
+private:
+    ComplexFFT<kFFT> fft;
+    float window[kFFT];
+    float re[kFFT], im[kFFT];
+    uint8_t rows[kQueue][kBins];
+    std::atomic<uint32_t> head{0}, tail{0};
+};
@@ -0,0 +1,124 @@
+/**
+ * @file agc.h
+ * @brief Fixed-point automatic gain control with peak limiter.
+ *
+ * Per sample, all integer math:
+ * 1. Peak envelope follower (attack / release time constants).
+ * 2. Every kBlock samples the envelope is turned into a target gain
+ *    (target level / envelope, capped at max gain). This is the only division.
+ * 3. The applied gain slides towards that target: quickly when it has to come
+ *    down (attack), slowly when it may go up (release). While the envelope sits
+ *    below the gate level the gain is held, so room noise is not pumped up
+ *    between words.
+ * 4. Anything still above the limit is clamped and the gain is pulled down
+ *    to match, so the output never wraps.
+ *
+ * Gains are Q16 (65536 = 1.0x), the envelope is Q8 and the smoothing
+ * coefficients are Q24 so even 1 s time constants at 17 kHz keep their
+ * precision. The mean gain of each chunk is returned so it can be reported
+ * to clients, who divide by it to get the raw signal back.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+struct AgcConfig {
+    float target_dbfs = -18.0f; // Desired peak envelope level
+    float attack_ms   = 5.0f;   // Gain reduction speed
+    float release_ms  = 800.0f; // Gain recovery speed
+    float max_gain_db = 30.0f;  // Upper gain limit
+    float limit_dbfs  = -1.0f;  // Hard output ceiling
+    float gate_dbfs   = -55.0f; // Envelope below this holds the gain
+};
+
+class AutoGain {
+public:
+    static constexpr int     kBlock = 16;   // Samples per target-gain update
+    static constexpr int32_t kUnity = 65536; // Q16 gain of 1.0x
+    static constexpr float   kMaxGainDb = 48.0f; // Chunk gains are reported in Q8 uint16 (< 256x, 48.2 dB)
+
+    void begin(float samplerate, const AgcConfig &c = AgcConfig()) {
+        fs = samplerate;
+        configure(c);
+        env = 0;
+        gain = kUnity;
+        target = kUnity;
+    }
+
+    // max_gain_db is clamped to kMaxGainDb, target / limit to 0 dBFS; config() returns the values in effect
+    void configure(const AgcConfig &c) {
+        cfg = c;
+        if (cfg.max_gain_db > kMaxGainDb) cfg.max_gain_db = kMaxGainDb;
+        if (cfg.target_dbfs > 0) cfg.target_dbfs = 0;
+        if (cfg.limit_dbfs > 0) cfg.limit_dbfs = 0;
+        env_att  = coef(0.5f);            // Envelope: ~instant attack...
+        env_rel  = coef(cfg.release_ms * 0.25f);
+        gain_att = coef(cfg.attack_ms);   // ...gain follows at the configured speeds
+        gain_rel = coef(cfg.release_ms);
+        target_lvl = (int64_t)(dbToLinear(cfg.target_dbfs) * 32767.0f * 256.0f); // Q8
+        limit      = (int32_t)(dbToLinear(cfg.limit_dbfs) * 32767.0f);
+        if (limit > 32767) limit = 32767;
+        if (limit < 1) limit = 1;
+        gate       = (int32_t)(dbToLinear(cfg.gate_dbfs) * 32767.0f * 256.0f); // Q8
+        max_gain   = (int32_t)(dbToLinear(cfg.max_gain_db) * kUnity);
+    }
+
+    const AgcConfig &config() const { return cfg; }
+
+    // Applies the AGC in place. Returns the mean gain over the chunk (Q16).
+    int32_t process(int16_t *x, size_t n) {
+        int64_t gain_sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            int32_t s = x[i];
+            int32_t a = (s < 0) ? -s : s;
+
+            // --- ENVELOPE (Q8) ---
+            int32_t k = ((a << 8) > env) ? env_att : env_rel;
+            env += (int32_t)(((int64_t)((a << 8) - env) * k) >> 24);
+
+            // --- TARGET GAIN (once per block, held while gated) ---
+            if ((i & (kBlock - 1)) == 0 && env > gate) {
+                int64_t t = (target_lvl << 16) / (env + 1);
+                target = (t > max_gain) ? max_gain : (int32_t)t;
+            }
+
+            // --- GAIN SMOOTHING ---
+            int32_t g = (target < gain) ? gain_att : gain_rel;
+            gain += (int32_t)(((int64_t)(target - gain) * g) >> 24);
+
+            // --- APPLY + LIMIT ---
+            int32_t y = (int32_t)(((int64_t)s * gain) >> 16);
+            if (y > limit || y < -limit) {
+                gain = (int32_t)(((int64_t)limit << 16) / (a ? a : 1)); // Pull the gain down to the ceiling
+                y = (y > 0) ? limit : -limit;
+            }
+            x[i] = (int16_t)((y > 32767) ? 32767 : (y < -32768 ? -32768 : y)); // Never wrap, whatever the limit
+            gain_sum += gain;
+        }
+        return n ? (int32_t)(gain_sum / (int64_t)n) : gain;
+    }
+
+    int32_t currentGain() const { return gain; }
+
+private:
+    AgcConfig cfg;
+    float   fs = 17000;
+    int64_t target_lvl = 0;
+    int32_t env = 0;
+    int32_t gain = kUnity;
+    int32_t target = kUnity;
+    int32_t env_att = 0, env_rel = 0, gain_att = 0, gain_rel = 0;
+    int32_t limit = 29204, gate = 0, max_gain = kUnity;
+
+    // One-pole smoothing coefficient (Q24) for a time constant in ms
+    int32_t coef(float ms) const {
+        const int32_t one = 1 << 24;
+        if (ms <= 0) return one;
+        float c = 1.0f - expf(-1000.0f / (ms * fs));
+        int32_t q = (int32_t)(c * one + 0.5f);
+        return (q < 1) ? 1 : (q > one ? one : q);
+    }
+
+    static float dbToLinear(float db) { return powf(10.0f, db / 20.0f); }
+};
@@ -0,0 +1,140 @@
+/**
+ * @file capture_filter.h
+ * @brief Capture-side clean-up chain: DC blocker -> high-pass -> FIR mic EQ.
+ *
+ * Runs in place on each chunk as soon as it is recorded, so the display,
+ * the FFTs, the meters and the web clients all see the same centred signal
+ * without each of them removing the offset again.
+ *
+ * - DC blocker: y = x - x1 + R*y1 with a ~5 Hz corner.
+ * - High-pass: 2nd order Butterworth (0 Hz = off) for rumble / handling noise.
+ * - FIR EQ: optional mic-response correction (e.g. measured against a
+ *   reference mic), up to kMaxTaps taps, loaded from the SD card.
+ *
+ * Cost is bounded: at most (kMaxTaps + 8) multiply-adds per sample. The FIR
+ * runs over a contiguous block with a forward dot-product inner loop, which
+ * the compiler can unroll / vectorize.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+class CaptureFilter {
+public:
+    static constexpr int kMaxTaps  = 64;
+    static constexpr int kMaxBlock = 256; // Largest chunk processed in one pass
+
+    bool dc_enabled = true;
+
+    void begin(float samplerate, float hp_hz = 60.0f) {
+        fs = samplerate;
+        dc_r = 1.0f - (2.0f * (float)M_PI * 5.0f / fs);
+        setHighPass(hp_hz);
+        clearFir();
+        reset();
+    }
+
+    void reset() {
+        dc_x1 = dc_y1 = 0;
+        hp_z1 = hp_z2 = 0;
+        memset(hist, 0, sizeof(hist));
+    }
+
+    // 0 disables the high-pass
+    void setHighPass(float hz) {
+        hp_hz = (hz > 0 && hz < fs * 0.45f) ? hz : 0;
+        if (!hp_hz) return;
+        // RBJ cookbook high-pass, Q = 1/sqrt(2)
+        float w0 = 2.0f * (float)M_PI * hp_hz / fs;
+        float alpha = sinf(w0) / (2.0f * 0.70710678f);
+        float c = cosf(w0);
+        float a0 = 1.0f + alpha;
+        hp_b0 = (1.0f + c) / 2.0f / a0;
+        hp_b1 = -(1.0f + c) / a0;
+        hp_b2 = hp_b0;
+        hp_a1 = -2.0f * c / a0;
+        hp_a2 = (1.0f - alpha) / a0;
+    }
+
+    // Installs FIR taps (h[0] applies to the newest sample). Returns false if too long.
+    bool setFir(const float *h, int n) {
+        if (n <= 0 || n > kMaxTaps) return false;
+        for (int k = 0; k < n; k++) fir_rev[k] = h[n - 1 - k]; // Reversed for a forward dot product
+        taps = n;
+        memset(hist, 0, sizeof(hist));
+        return true;
+    }
+
+    void clearFir() { taps = 0; }
+
+    float highPassHz() const { return hp_hz; }
+    int firTaps() const { return taps; }
+
+    void process(int16_t *x, size_t n) {
+        while (n > 0) {
+            size_t len = (n > (size_t)kMaxBlock) ? kMaxBlock : n;
+            processBlock(x, len);
+            x += len;
+            n -= len;
+        }
+    }
+
+private:
+    float fs = 17000;
+
+    float dc_r = 0.998f;
+    float dc_x1 = 0, dc_y1 = 0;
+
+    float hp_hz = 0;
+    float hp_b0 = 1, hp_b1 = 0, hp_b2 = 0, hp_a1 = 0, hp_a2 = 0;
+    float hp_z1 = 0, hp_z2 = 0;
+
+    int   taps = 0;
+    float fir_rev[kMaxTaps];
+    float hist[kMaxTaps - 1 + kMaxBlock]; // Last (taps - 1) inputs followed by the current block
+
+    void processBlock(int16_t *x, size_t n) {
+        float *blk = &hist[kMaxTaps - 1];
+
+        // --- DC BLOCKER + HIGH-PASS (recursive, per sample) ---
+        for (size_t i = 0; i < n; i++) {
+            float v = x[i];
+            if (dc_enabled) {
+                float y = v - dc_x1 + dc_r * dc_y1;
+                dc_x1 = v;
+                dc_y1 = y;
+                v = y;
+            }
+            if (hp_hz) {
+                float y = hp_b0 * v + hp_z1;
+                hp_z1 = hp_b1 * v - hp_a1 * y + hp_z2;
+                hp_z2 = hp_b2 * v - hp_a2 * y;
+                v = y;
+            }
+            blk[i] = v;
+        }
+
+        // --- FIR EQ (block dot products) ---
+        if (taps > 0) {
+            const float *base = blk - (taps - 1);
+            for (size_t i = 0; i < n; i++) {
+                const float *w = base + i;
+                float acc = 0;
+                for (int k = 0; k < taps; k++) acc += fir_rev[k] * w[k];
+                x[i] = saturate(acc);
+            }
+            // Keep the newest (taps - 1) inputs in front of the next block
+            memmove(blk - (taps - 1), blk + n - (taps - 1), (taps - 1) * sizeof(float));
+        } else {
+            for (size_t i = 0; i < n; i++) x[i] = saturate(blk[i]);
+        }
+    }
+
+    static int16_t saturate(float v) {
+        if (v > 32767.0f) return 32767;
+        if (v < -32768.0f) return -32768;
+        return (int16_t)lrintf(v);
+    }
+};
@@ -0,0 +1,178 @@
+/**
+ * @file envelope.h
+ * @brief Multi-resolution min/max/RMS pyramid for long, zoomable history.
+ *
+ * Three levels of bins (16x, 256x and 4096x reductions) are kept in rings
+ * next to rec_data and extended incrementally as each chunk lands:
+ * samples fold into a 16x bin, every 16 of those into a 256x bin, and so on,
+ * so the cost is a few integer operations per sample.
+ *
+ * A view of any time range at any width picks the coarsest level that still
+ * has at least one bin per pixel, so each pixel folds at most ~16 bins and a
+ * render is O(width) regardless of how much time it spans. If that level no
+ * longer reaches back to the start of the range, covering() moves up to the
+ * finest one that does (coarser levels reach further back).
+ *
+ * Ring sizes (and thus how far back each level reaches) are compile-time
+ * settings: define ENVELOPE_L1_BINS / ENVELOPE_L2_BINS / ENVELOPE_L3_BINS
+ * and ENVELOPE_ALLOC before including this file to move them e.g. to PSRAM.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ENVELOPE_L1_BINS
+#define ENVELOPE_L1_BINS 4096  // 16x:   ~3.9 s at 17 kHz
+#endif
+#ifndef ENVELOPE_L2_BINS
+#define ENVELOPE_L2_BINS 1024  // 256x:  ~15 s
+#endif
+#ifndef ENVELOPE_L3_BINS
+#define ENVELOPE_L3_BINS 1024  // 4096x: ~4 min
+#endif
+#ifndef ENVELOPE_ALLOC
+#define ENVELOPE_ALLOC(bytes) malloc(bytes)
+#endif
+
+struct EnvBin {
+    int16_t  mn;
+    int16_t  mx;
+    uint32_t ms; // Mean square (raw units^2)
+};
+
+class EnvelopePyramid {
+public:
+    static constexpr int kLevels = 3;
+    static constexpr int kFanout = 16; // Each level reduces the one below by 16
+
+    // Samples per bin at a level: 16, 256, 4096
+    static uint32_t factor(int level) { return (uint32_t)kFanout << (4 * level); }
+
+    // All levels or none: on an allocation failure the levels already allocated are freed and
+    // the pyramid stays off (push() only counts samples, span() finds nothing)
+    bool begin() {
+        const size_t sizes[kLevels] = {ENVELOPE_L1_BINS, ENVELOPE_L2_BINS, ENVELOPE_L3_BINS};
+        for (int l = 0; l < kLevels; l++) {
+            bins[l] = (EnvBin *)ENVELOPE_ALLOC(sizes[l] * sizeof(EnvBin));
+            if (!bins[l]) {
+                for (int k = 0; k < l; k++) {
+                    free(bins[k]);
+                    bins[k] = nullptr;
+                    cap[k] = 0;
+                }
+                return false;
+            }
+            cap[l] = sizes[l];
+            count[l] = 0;
+            resetAcc(acc[l]);
+        }
+        total = 0;
+        return true;
+    }
+
+    // Appends samples (in arrival order) and folds finished bins upwards
+    void push(const int16_t *x, size_t n) {
+        if (!bins[0]) { // Off: keep the sample clock for the raw ring readers
+            total += n;
+            return;
+        }
+        Acc &a = acc[0];
+        for (size_t i = 0; i < n; i++) {
+            int32_t v = x[i];
+            if (v < a.mn) a.mn = v;
+            if (v > a.mx) a.mx = v;
+            a.sum += (uint64_t)(v * v);
+            if (++a.n == (uint32_t)kFanout) {
+                EnvBin b = {(int16_t)a.mn, (int16_t)a.mx, (uint32_t)(a.sum / kFanout)};
+                resetAcc(a);
+                emit(0, b);
+            }
+        }
+        total += n;
+    }
+
+    uint64_t samples() const { return total; }
+    bool enabled() const { return bins[0] != nullptr; }
+
+    // Coarsest level whose bins are no wider than spp, -1 if raw samples are needed
+    static int levelFor(uint64_t spp) {
+        int level = -1;
+        for (int l = 0; l < kLevels && factor(l) <= spp; l++) level = l;
+        return level;
+    }
+
+    // Finest level from `level` up whose reach still includes sample s0 (the coarsest if none does)
+    int covering(int level, uint64_t s0) const {
+        while (level < kLevels - 1 && oldest(level) > s0) level++;
+        return level;
+    }
+
+    // First sample still covered by a level
+    uint64_t oldest(int level) const {
+        uint64_t c = count[level];
+        return ((c > cap[level]) ? c - cap[level] : 0) * factor(level);
+    }
+
+    // Folds every stored bin overlapping [s0, s1). Returns false if none is stored.
+    bool span(int level, uint64_t s0, uint64_t s1, EnvBin &out) const {
+        uint32_t f = factor(level);
+        uint64_t c = count[level];
+        uint64_t first = (c > cap[level]) ? c - cap[level] : 0;
+        uint64_t b0 = s0 / f;
+        uint64_t b1 = (s1 + f - 1) / f;
+        if (b0 < first) b0 = first;
+        if (b1 > c) b1 = c;
+        if (b0 >= b1) return false;
+
+        int16_t mn = INT16_MAX, mx = INT16_MIN;
+        uint64_t ms = 0;
+        for (uint64_t b = b0; b < b1; b++) {
+            const EnvBin &e = bins[level][b % cap[level]];
+            if (e.mn < mn) mn = e.mn;
+            if (e.mx > mx) mx = e.mx;
+            ms += e.ms;
+        }
+        out.mn = mn;
+        out.mx = mx;
+        out.ms = (uint32_t)(ms / (b1 - b0));
+        return true;
+    }
+
+private:
+    struct Acc {
+        int32_t  mn, mx;
+        uint64_t sum;
+        uint32_t n;
+    };
+
+    EnvBin  *bins[kLevels] = {nullptr, nullptr, nullptr};
+    size_t   cap[kLevels] = {0, 0, 0};
+    uint64_t count[kLevels] = {0, 0, 0}; // Bins ever written per level
+    Acc      acc[kLevels];
+    uint64_t total = 0;
+
+    static void resetAcc(Acc &a) {
+        a.mn = INT16_MAX;
+        a.mx = INT16_MIN;
+        a.sum = 0;
+        a.n = 0;
+    }
+
+    void emit(int level, const EnvBin &b) {
+        bins[level][count[level] % cap[level]] = b;
+        count[level]++;
+        if (level + 1 >= kLevels) return;
+
+        Acc &a = acc[level + 1];
+        if (b.mn < a.mn) a.mn = b.mn;
+        if (b.mx > a.mx) a.mx = b.mx;
+        a.sum += b.ms;
+        if (++a.n == (uint32_t)kFanout) {
+            EnvBin up = {(int16_t)a.mn, (int16_t)a.mx, (uint32_t)(a.sum / kFanout)};
+            resetAcc(a);
+            emit(level + 1, up);
+        }
+    }
+};
@@ -0,0 +1,224 @@
+/**
+ * @file event_recorder.h
+ * @brief Pre-trigger event capture: N seconds before + M seconds after a trigger, to SD.
+ *
+ * A trigger only timestamps the sample clock and drops a small message in a
+ * queue, so it costs nothing on the capture path and works the same whether
+ * it comes from the level detector, a tone onset, a key or an HTTP call.
+ *
+ * A writer task then streams the event straight out of the capture history
+ * (history.h: the raw ring, plus the compressed tier when it is enabled): the
+ * pre-trigger part is already there, the post-trigger part is written as it
+ * lands. The only deadline is the history itself - the oldest pre-trigger
+ * samples must reach the card before they drop out of it - so pre-trigger time
+ * is capped at the history minus a safety margin and the task runs above the
+ * other SD writer. Anything lost first is written as silence (keeping the
+ * timeline) and counted in lostSamples().
+ *
+ * Triggers that arrive while an event is still being written extend it
+ * (up to kMaxEventSeconds) instead of starting a second, overlapping file.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+#include "wav.h"
+#include "history.h"
+#include "trace.h"
+
+enum EventCause : uint8_t { EVT_LEVEL, EVT_TONE, EVT_KEY, EVT_HTTP };
+
+static const char *const eventCauseNames[] = {"level", "tone", "key", "http"};
+
+struct EventConfig {
+    float    pre_s      = 2.0f;   // Seconds before the trigger (capped by the history)
+    float    post_s     = 5.0f;   // Seconds after the trigger
+    float    level_dbfs = 0.0f;   // Chunk peak above this triggers (0 = level trigger off)
+    uint16_t tone_mask  = 0;      // Tone detector onsets that trigger (bit per tone)
+};
+
+class EventRecorder {
+public:
+    static constexpr float    kMarginS         = 0.5f;  // Pre-trigger never reaches closer than this to the overwrite point
+    static constexpr float    kMaxEventSeconds = 60.0f;
+    static constexpr uint32_t kBlockSamples    = 4096;  // Largest single write
+
+    EventConfig cfg;
+
+    // h: capture history, read on the sample clock; pushed before process() sees each chunk
+    bool begin(const ChunkHistory &h, uint32_t samplerate, const char *directory = "/events") {
+        hist = &h;
+        history = h.samples();
+        fs = samplerate;
+        strncpy(dir, directory, sizeof(dir) - 1);
+        queue = xQueueCreate(8, sizeof(Trigger));
+        if (!queue) return false;
+        return xTaskCreatePinnedToCore(taskEntry, "events", 6144, this, 3, &task, 0) == pdPASS;
+    }
+
+    // --- CAPTURE SIDE (loop) ---
+
+    // Call once per processed chunk, after it is final and pushed to the history
+    void process(const int16_t *x, size_t n) {
+        avail += n;
+        if (cfg.level_dbfs < 0) {
+            int32_t peak = 0;
+            for (size_t i = 0; i < n; i++) {
+                int32_t a = x[i] < 0 ? -x[i] : x[i];
+                if (a > peak) peak = a;
+            }
+            bool over = peak > levelThreshold();
+            if (over && !level_over) trigger(EVT_LEVEL); // Rising edge only, not every loud chunk
+            level_over = over;
+        }
+    }
+
+    // Timestamps a trigger at the newest sample. Never blocks; returns false if the queue is full.
+    bool trigger(EventCause cause) {
+        if (!queue) return false;
+        Trigger t = {clock(), cause};
+        if (xQueueSend(queue, &t, 0) != pdTRUE) {
+            missed++;
+            return false;
+        }
+        return true;
+    }
+
+    // --- STATUS ---
+
+    uint64_t samples() const { return clock(); }
+    bool isWriting() const { return writing; }
+    const char *lastFile() const { return path; }
+    uint32_t events() const { return count; }
+    uint32_t missedTriggers() const { return missed; }
+    uint32_t lostSamples() const { return lost; }
+    float maxLagMs() const { return max_lag * 1000.0f / fs; }       // Writer's worst distance behind capture
+    float minHeadroomMs() const { return ((float)history - max_lag) * 1000.0f / fs; } // Before the history drops it
+    float maxPreSeconds() const { return (float)history / fs - kMarginS; }
+
+private:
+    struct Trigger {
+        uint64_t clock;
+        EventCause cause;
+    };
+
+    const ChunkHistory *hist = nullptr;
+    size_t   history = 0;                        // Samples the history reaches back
+    int16_t  scratch[ChunkHistory::kMaxChunkLen]; // Decoded chunk (compressed tier)
+    uint32_t fs = 17000;
+    char     dir[16] = "/events";
+
+    QueueHandle_t queue = nullptr;
+    TaskHandle_t  task = nullptr;
+    volatile uint64_t avail = 0; // Sample clock of the newest processed sample + 1
+    bool level_over = false;
+
+    // Writer side / stats
+    File     file;
+    char     path[40] = "";
+    uint32_t next_index = 1;
+    volatile bool     writing = false;
+    volatile uint32_t count = 0;
+    volatile uint32_t missed = 0;
+    volatile uint32_t lost = 0;
+    volatile uint32_t max_lag = 0;
+
+    // 64-bit reads are not atomic here: re-read until both halves agree
+    uint64_t clock() const {
+        uint64_t c;
+        do { c = avail; } while (c != avail);
+        return c;
+    }
+
+    int32_t levelThreshold() const { return (int32_t)(powf(10.0f, cfg.level_dbfs / 20.0f) * 32767.0f); }
+
+    static void taskEntry(void *arg) { static_cast<EventRecorder *>(arg)->run(); }
+
+    void run() {
+        Trigger t;
+        for (;;) {
+            if (xQueueReceive(queue, &t, portMAX_DELAY) == pdTRUE) writeEvent(t);
+        }
+    }
+
+    void writeEvent(const Trigger &t) {
+        uint64_t pre = (uint64_t)(constrain(cfg.pre_s, 0.0f, maxPreSeconds()) * fs);
+        uint64_t post = (uint64_t)(cfg.post_s * fs);
+        uint64_t max_len = (uint64_t)(kMaxEventSeconds * fs);
+        uint64_t start = (t.clock > pre) ? t.clock - pre : 0;
+        uint64_t end = t.clock + post;
+
+        if (!SD.exists(dir)) SD.mkdir(dir);
+        do {
+            snprintf(path, sizeof(path), "%s/EVT_%05lu_%s.wav", dir, (unsigned long)next_index++,
+                     eventCauseNames[t.cause]);
+        } while (SD.exists(path));
+        file = SD.open(path, FILE_WRITE);
+        if (!file) return;
+        writing = true;
+        count++;
+
+        uint8_t hdr[kWavHeaderBytes];
+        makeWavHeader(hdr, 0, fs);
+        file.write(hdr, sizeof(hdr));
+
+        uint64_t pos = start;
+        while (pos < end) {
+            // Later triggers inside this event extend it rather than opening another file
+            Trigger more;
+            while (xQueuePeek(queue, &more, 0) == pdTRUE && more.clock <= end) {
+                xQueueReceive(queue, &more, 0);
+                uint64_t e = more.clock + post;
+                end = (e - start > max_len) ? start + max_len : (e > end ? e : end);
+            }
+
+            uint64_t now = clock();
+            if (pos >= now) { // Caught up with capture: wait for the next chunk
+                vTaskDelay(pdMS_TO_TICKS(10));
+                continue;
+            }
+            uint64_t lag = now - pos;
+            if (lag > max_lag) max_lag = (uint32_t)lag;
+
+            // Dropped out of the history: keep the timeline with silence
+            uint64_t oldest = hist->oldestClock();
+            if (pos < oldest) {
+                uint64_t gap = oldest - pos;
+                if (gap > end - pos) gap = end - pos;
+                writeSilence(gap);
+                lost += (uint32_t)gap;
+                pos += gap;
+                continue;
+            }
+
+            // Straight from the ring (or one decoded chunk), at most one contiguous block per write
+            uint64_t stop = (now < end) ? now : end;
+            size_t n = (size_t)(stop - pos);
+            if (n > kBlockSamples) n = kBlockSamples;
+            const int16_t *run = hist->run(pos, n, scratch);
+            if (!run) { // Raced with the history moving on: the check above writes silence
+                vTaskDelay(1);
+                continue;
+            }
+            TRACE_BEGIN("event_write");
+            file.write((const uint8_t *)run, n * sizeof(int16_t));
+            TRACE_END("event_write");
+            pos += n;
+        }
+
+        makeWavHeader(hdr, (uint32_t)((end - start) * sizeof(int16_t)), fs);
+        file.seek(0);
+        file.write(hdr, sizeof(hdr));
+        file.close();
+        writing = false;
+    }
+
+    void writeSilence(uint64_t n) {
+        static const int16_t zeros[256] = {0};
+        while (n > 0) {
+            size_t k = (n > 256) ? 256 : (size_t)n;
+            file.write((const uint8_t *)zeros, k * sizeof(int16_t));
+            n -= k;
+        }
+    }
+};
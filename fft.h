@@ -0,0 +1,74 @@
+/**
+ * @file fft.h
+ * @brief Small in-place radix-2 complex FFT (float) with precomputed twiddles.
+ *
+ * Used by the analysis stages that need more than one FFT per chunk, where
+ * arduinoFFT's double precision would be too slow (and on the Cardputer,
+ * where arduinoFFT is not a dependency at all).
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+template <int N>
+class ComplexFFT {
+    static_assert((N & (N - 1)) == 0, "FFT size must be a power of 2");
+
+public:
+    ComplexFFT() {
+        for (int i = 0; i < N / 2; i++) {
+            cos_t[i] = cosf(2.0f * (float)M_PI * i / N);
+            sin_t[i] = sinf(2.0f * (float)M_PI * i / N);
+        }
+    }
+
+    // Forward transform, X[k] = sum x[n] e^(-2*pi*i*k*n/N)
+    void forward(float *re, float *im) const {
+        bitReverse(re, im);
+        for (int len = 2; len <= N; len <<= 1) {
+            int half = len >> 1;
+            int step = N / len;
+            for (int i = 0; i < N; i += len) {
+                for (int j = 0; j < half; j++) {
+                    float wr = cos_t[j * step];
+                    float wi = -sin_t[j * step];
+                    int a = i + j, b = a + half;
+                    float tr = re[b] * wr - im[b] * wi;
+                    float ti = re[b] * wi + im[b] * wr;
+                    re[b] = re[a] - tr;
+                    im[b] = im[a] - ti;
+                    re[a] += tr;
+                    im[a] += ti;
+                }
+            }
+        }
+    }
+
+    // Inverse transform (scaled by 1/N) via the conjugate trick
+    void inverse(float *re, float *im) const {
+        for (int i = 0; i < N; i++) im[i] = -im[i];
+        forward(re, im);
+        const float scale = 1.0f / N;
+        for (int i = 0; i < N; i++) {
+            re[i] *= scale;
+            im[i] *= -scale;
+        }
+    }
+
+private:
+    float cos_t[N / 2];
+    float sin_t[N / 2];
+
+    static void bitReverse(float *re, float *im) {
+        for (int i = 1, j = 0; i < N; i++) {
+            int bit = N >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if (i < j) {
+                float t = re[i]; re[i] = re[j]; re[j] = t;
+                t = im[i]; im[i] = im[j]; im[j] = t;
+            }
+        }
+    }
+};
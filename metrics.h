@@ -0,0 +1,238 @@
+/**
+ * @file metrics.h
+ * @brief Prometheus text exposition: HTTP counters per endpoint and per client.
+ *
+ * MetricsServer is a drop-in WebServer: on() wraps every handler to count the
+ * request and time it, and send()/sendContent() add the reply size to the
+ * endpoint being served (found by the wrapper, not by a URI lookup). The last
+ * few client addresses are kept in a fixed table with their request count,
+ * total and worst latency; a client is "active" if it asked for anything in the
+ * last 10 s. Counters are relaxed atomics, and nothing here allocates after
+ * setup; send() with a char buffer writes it without the String copy the
+ * stock WebServer makes.
+ *
+ * PromWriter formats name{labels} value lines into a caller's static buffer,
+ * so a scrape costs one snprintf per line and one sendContent().
+ *
+ * Bytes streamed by /capture.wav and /archive go straight to the socket from
+ * loop(), so only their headers are counted here.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <atomic>
+#include "profiler.h"
+#include "trace.h"
+
+class PromWriter {
+public:
+    PromWriter(char *buf, size_t size) : out(buf), cap(size) { out[0] = 0; }
+
+    // "# HELP" / "# TYPE" header for a metric family
+    void family(const char *name, const char *type, const char *help) {
+        put("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+    // name{labels} value (labels may be "" or e.g. "path=\"/data\"")
+    void value(const char *name, const char *labels, double v) {
+        if (labels && *labels) put("%s{%s} %.9g\n", name, labels, v);
+        else put("%s %.9g\n", name, v);
+    }
+    void value(const char *name, const char *labels, uint32_t v) {
+        if (labels && *labels) put("%s{%s} %lu\n", name, labels, (unsigned long)v);
+        else put("%s %lu\n", name, (unsigned long)v);
+    }
+    // Single-sample family
+    void gauge(const char *name, const char *help, double v) {
+        family(name, "gauge", help);
+        value(name, "", v);
+    }
+    void counter(const char *name, const char *help, uint32_t v) {
+        family(name, "counter", help);
+        value(name, "", v);
+    }
+
+    const char *text() const { return out; }
+    size_t length() const { return len; }
+    bool truncated() const { return full; }
+
+private:
+    char *out;
+    size_t cap, len = 0;
+    bool full = false;
+
+    template <typename... A>
+    void put(const char *fmt, A... args) {
+        if (full) return;
+        int n = snprintf(out + len, cap - len, fmt, args...);
+        if (n < 0 || (size_t)n >= cap - len) { // Drop the partial line, keep the output valid
+            out[len] = 0;
+            full = true;
+            return;
+        }
+        len += n;
+    }
+};
+
+class MetricsServer : public WebServer {
+public:
+    static constexpr int kMaxEndpoints = 40;
+    static constexpr int kMaxClients = 8;
+    static constexpr uint32_t kActiveMs = 10000;
+
+    using WebServer::WebServer;
+
+    // Same as WebServer::on(), plus request / byte / latency accounting
+    void on(const char *uri, THandlerFunction fn) {
+        int ep = n_ep < kMaxEndpoints ? n_ep++ : -1;
+        if (ep >= 0) paths[ep] = uri;
+        WebServer::on(uri, [this, ep, fn, uri]() {
+            current = ep;
+            TRACE_BEGIN(uri); // Literal: the pointer stays valid
+            uint32_t t = micros();
+            fn();
+            uint32_t us = micros() - t;
+            TRACE_END(uri);
+            if (ep >= 0) eps[ep].requests.fetch_add(1, std::memory_order_relaxed);
+            noteClient(us);
+            current = -1;
+        });
+    }
+
+    // Reply size accounting (the forms the sketches use). A buffer reply goes out as headers plus
+    // one sendContent() straight from the caller's buffer: WebServer::send() would copy it into a String.
+    void send(int code, const char *type, const char *content) {
+        size_t n = strlen(content);
+        if (!n) { // Headers only (the caller streams the body)
+            WebServer::send(code, type, "");
+            return;
+        }
+        addBytes(n);
+        setContentLength(n);
+        WebServer::send(code, type, "");
+        WebServer::sendContent(content, n);
+    }
+    void send(int code, const char *type, const String &content) {
+        addBytes(content.length());
+        WebServer::send(code, type, content);
+    }
+    void sendContent(const char *content, size_t size) {
+        addBytes(size);
+        WebServer::sendContent(content, size);
+    }
+    void sendContent(const char *content) {
+        addBytes(strlen(content));
+        WebServer::sendContent(content);
+    }
+    void sendContent(const String &content) {
+        addBytes(content.length());
+        WebServer::sendContent(content);
+    }
+
+    int activeClients() const {
+        int n = 0;
+        for (const auto &c : clients) {
+            if (c.ip && millis() - c.last_ms < kActiveMs) n++;
+        }
+        return n;
+    }
+
+    // Request / byte counters per endpoint and latency per client
+    void writeMetrics(PromWriter &w) const {
+        char labels[64];
+        w.family("mictalk_http_requests_total", "counter", "Requests served, per endpoint.");
+        for (int i = 0; i < n_ep; i++) {
+            snprintf(labels, sizeof(labels), "path=\"%s\"", paths[i]);
+            w.value("mictalk_http_requests_total", labels, eps[i].requests.load(std::memory_order_relaxed));
+        }
+        w.family("mictalk_http_response_bytes_total", "counter", "Reply bytes written by the web server, per endpoint.");
+        for (int i = 0; i < n_ep; i++) {
+            snprintf(labels, sizeof(labels), "path=\"%s\"", paths[i]);
+            w.value("mictalk_http_response_bytes_total", labels, eps[i].bytes.load(std::memory_order_relaxed));
+        }
+        w.gauge("mictalk_http_active_clients", "Clients with a request in the last 10 s.", activeClients());
+
+        w.family("mictalk_http_client_latency_seconds", "summary", "Handler time per recent client address (_count: requests).");
+        forClients(w, labels, sizeof(labels), [](const Client &c) { return c.total_us / 1e6; },
+                   "mictalk_http_client_latency_seconds_sum");
+        forClients(w, labels, sizeof(labels), [](const Client &c) { return (double)c.requests; },
+                   "mictalk_http_client_latency_seconds_count");
+        w.family("mictalk_http_client_latency_max_seconds", "gauge", "Slowest reply per recent client.");
+        forClients(w, labels, sizeof(labels), [](const Client &c) { return c.max_us / 1e6; },
+                   "mictalk_http_client_latency_max_seconds");
+    }
+
+private:
+    struct Endpoint {
+        std::atomic<uint32_t> requests{0};
+        std::atomic<uint32_t> bytes{0};
+    };
+    struct Client {
+        uint32_t ip = 0;
+        uint32_t last_ms = 0;
+        uint32_t requests = 0;
+        uint64_t total_us = 0;
+        uint32_t max_us = 0;
+    };
+
+    const char *paths[kMaxEndpoints] = {};
+    Endpoint eps[kMaxEndpoints];
+    int n_ep = 0;
+    int current = -1; // Endpoint whose handler is running
+    Client clients[kMaxClients];
+
+    void addBytes(size_t n) {
+        if (current >= 0) eps[current].bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Finds (or takes over the stalest slot for) the requesting address
+    void noteClient(uint32_t us) {
+        uint32_t ip = (uint32_t)client().remoteIP();
+        Client *slot = &clients[0];
+        for (auto &c : clients) {
+            if (c.ip == ip) {
+                slot = &c;
+                break;
+            }
+            if (millis() - c.last_ms > millis() - slot->last_ms || !c.ip) slot = &c;
+        }
+        if (slot->ip != ip) *slot = Client();
+        slot->ip = ip;
+        slot->last_ms = millis();
+        slot->requests++;
+        slot->total_us += us;
+        if (us > slot->max_us) slot->max_us = us;
+    }
+
+    template <typename F>
+    void forClients(PromWriter &w, char *labels, size_t size, F get, const char *name) const {
+        for (const auto &c : clients) {
+            if (!c.ip) continue;
+            snprintf(labels, size, "client=\"%u.%u.%u.%u\"", (unsigned)(c.ip & 0xFF), (unsigned)(c.ip >> 8 & 0xFF),
+                     (unsigned)(c.ip >> 16 & 0xFF), (unsigned)(c.ip >> 24));
+            w.value(name, labels, get(c));
+        }
+    }
+};
+
+// Stage timings (profiler.h) as a Prometheus summary, in seconds
+inline void writeStageMetrics(PromWriter &w, const StageProfiler &prof) {
+    static const uint8_t qs[] = {50, 95, 99};
+    char labels[48];
+    w.family("mictalk_stage_seconds", "summary", "Loop stage duration (p50/p95/p99 from fixed buckets).");
+    for (int s = 0; s < PROF_STAGES; s++) {
+        const StageHistogram &h = prof.stage((ProfStage)s);
+        for (uint8_t q : qs) {
+            snprintf(labels, sizeof(labels), "stage=\"%s\",quantile=\"0.%02u\"", profStageNames[s], q);
+            w.value("mictalk_stage_seconds", labels, h.percentile(q) / 1e6);
+        }
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", profStageNames[s]);
+        w.value("mictalk_stage_seconds_sum", labels, h.totalUs() / 1e6);
+        w.value("mictalk_stage_seconds_count", labels, h.count());
+    }
+    w.family("mictalk_stage_max_seconds", "gauge", "Longest loop stage since the last reset.");
+    for (int s = 0; s < PROF_STAGES; s++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", profStageNames[s]);
+        w.value("mictalk_stage_max_seconds", labels, prof.stage((ProfStage)s).maxUs() / 1e6);
+    }
+}
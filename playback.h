@@ -0,0 +1,140 @@
+/**
+ * @file playback.h
+ * @brief Non-blocking playback of the capture history, stepped from loop().
+ *
+ * Mic and speaker share the I2S port in M5Unified on both devices, so capture
+ * still has to pause while the speaker runs. Everything else no longer does:
+ * instead of waiting in place, playback is a small state machine and each
+ * loop() pass does one bounded step - see whether the mic has drained, queue
+ * the next buffer, notice the end - so the display, keys/touch, web clients
+ * and the SD writers keep running throughout.
+ *
+ * The history is read through ChunkHistory, oldest first: raw chunks are
+ * queued straight from the ring, compressed ones are decoded into rotating
+ * buffers (one playing, one queued on the channel, one being filled).
+ *
+ * The sample clock does not advance while the mic is off; gapMs() reports how
+ * long the last pause was so the capture side can tag the first chunk after it.
+ */
+#pragma once
+
+#include <M5Unified.h>
+#include "history.h"
+
+class HistoryPlayer {
+public:
+    enum State : uint8_t { IDLE, DRAINING, PLAYING, FINISHING };
+
+    static constexpr size_t kBufChunks = 8; // Per decode buffer (x3)
+
+    void begin(const ChunkHistory &h, uint32_t samplerate, uint8_t speaker_channel = 0) {
+        hist = &h;
+        fs = samplerate;
+        channel = speaker_channel;
+    }
+
+    // Asks for playback; the mic is released on a later pass, once it has finished its buffer.
+    // The sketch must stop calling Mic.record() while active(), or the mic never drains.
+    bool start() {
+        if (state != IDLE || hist->newest() == 0) return false;
+        state = DRAINING;
+        paused_ms = millis();
+        return true;
+    }
+
+    // Cuts playback short (the mic comes back on the next pass). Still draining: the mic was
+    // never stopped, so this is straight back to IDLE (no restart, no gap).
+    void stop() {
+        if (state == DRAINING) {
+            state = IDLE;
+        } else if (state == PLAYING) {
+            M5.Speaker.stop(channel);
+            state = FINISHING;
+        }
+    }
+
+    // One step per loop() pass. Returns true on the pass the mic is running again.
+    bool pump() {
+        switch (state) {
+        case IDLE:
+            return false;
+
+        case DRAINING:
+            if (M5.Mic.isRecording()) return false;
+            M5.Mic.end();
+            M5.Speaker.begin();
+            len = kBufChunks * hist->chunkLength();
+            buf = (int16_t *)malloc(3 * len * sizeof(int16_t)); // Only while playing
+            raw_start = hist->rawOldestClock();
+            clock = buf ? hist->oldestClock() : raw_start; // No room to decode: raw part only
+            end = hist->newestClock();
+            start_clock = clock;
+            k = 0;
+            state = PLAYING;
+            return false;
+
+        case PLAYING:
+            if (clock >= end) {
+                state = FINISHING;
+                return false;
+            }
+            if (M5.Speaker.isPlaying(channel) > 1) return false; // Channel queue full
+            queueNext();
+            return false;
+
+        case FINISHING:
+            if (M5.Speaker.isPlaying()) return false;
+            M5.Speaker.end();
+            M5.Mic.begin();
+            free(buf);
+            buf = nullptr;
+            gap_ms = millis() - paused_ms;
+            gaps++;
+            state = IDLE;
+            return true;
+        }
+        return false;
+    }
+
+    bool active() const { return state != IDLE; }
+    State currentState() const { return state; }
+    float progress() const { return end > start_clock ? (float)(clock - start_clock) / (end - start_clock) : 0; }
+    float seconds() const { return (float)(end - start_clock) / fs; }
+    uint32_t gapMs() const { return gap_ms; }   // Length of the last capture pause
+    uint32_t gapCount() const { return gaps; }
+
+private:
+    const ChunkHistory *hist = nullptr;
+    uint32_t fs = 17000;
+    uint8_t  channel = 0;
+
+    State    state = IDLE;
+    int16_t *buf = nullptr;
+    size_t   len = 0;       // Samples per decode buffer
+    int      k = 0;         // Next decode buffer
+    uint64_t start_clock = 0, clock = 0, end = 0, raw_start = 0;
+    uint32_t paused_ms = 0;
+    uint32_t gap_ms = 0;
+    uint32_t gaps = 0;
+
+    void queueNext() {
+        size_t n = (size_t)(end - clock);
+        const int16_t *p;
+        if (clock >= raw_start) {
+            p = hist->run(clock, n, buf); // Raw: straight from the ring, nothing moves while the mic is off
+        } else {
+            int16_t *dst = buf + k * len;
+            if (n > raw_start - clock) n = (size_t)(raw_start - clock);
+            if (n > len) n = len;
+            n = hist->read(clock, dst, n);
+            p = dst;
+            k = (k + 1) % 3;
+        }
+        if (!p || n == 0) {
+            clock = end;
+            return;
+        }
+        M5.Speaker.playRaw(p, n, fs, false, 1, channel);
+        clock += n;
+    }
+};
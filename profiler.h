@@ -0,0 +1,143 @@
+/**
+ * @file profiler.h
+ * @brief Per-stage timing with fixed-bucket histograms (no heap).
+ *
+ * max_loop_time only says how long the worst loop pass took, in whole
+ * milliseconds, since it was last reset. This times each stage of a pass
+ * (capture, DSP, draw, network, UI input, SD, and the whole loop) with the
+ * CPU cycle counter and files every sample into a histogram, so the
+ * distribution is kept: p50 / p95 / p99 / max per stage, read at any time.
+ *
+ * Buckets are exact below 8 us, then 4 per power of two up to ~8 s (at most
+ * 19% wide), so a percentile is the upper edge of its bucket. Everything is
+ * in static arrays: recording is a few integer ops and one increment.
+ *
+ * Each stage is recorded from one task (draw from the render task, the rest
+ * from loop()), so the counters need no lock. reset() may be called from
+ * anywhere: it only flags the stages, and each one is cleared by its own task
+ * on its next record().
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+enum ProfStage : uint8_t { PROF_CAPTURE, PROF_DSP, PROF_DRAW, PROF_NET, PROF_INPUT, PROF_SD, PROF_LOOP, PROF_STAGES };
+
+static const char *const profStageNames[PROF_STAGES] = {"capture", "dsp", "draw", "net", "input", "sd", "loop"};
+
+class StageHistogram {
+public:
+    static constexpr int kLinear = 8;  // 0..7 us, one bucket each
+    static constexpr int kSub = 4;     // Buckets per power of two above that
+    static constexpr int kBuckets = kLinear + kSub * 20; // Up to 2^23 us (~8 s)
+
+    void add(uint32_t us) {
+        counts[bucketFor(us)]++;
+        n++;
+        total_us += us;
+        if (us > max_us) max_us = us;
+    }
+
+    // Smallest bucket edge at or above p percent of the samples (0 with no samples)
+    uint32_t percentile(uint8_t p) const {
+        if (!n) return 0;
+        uint32_t want = (uint32_t)(((uint64_t)n * p + 99) / 100), seen = 0;
+        for (int b = 0; b < kBuckets; b++) {
+            seen += counts[b];
+            if (seen >= want) {
+                uint32_t edge = bucketUpper(b);
+                return edge < max_us ? edge : max_us;
+            }
+        }
+        return max_us;
+    }
+
+    uint32_t count() const { return n; }
+    uint32_t maxUs() const { return max_us; }
+    uint32_t meanUs() const { return n ? (uint32_t)(total_us / n) : 0; }
+    uint64_t totalUs() const { return total_us; }
+    void reset() {
+        memset(counts, 0, sizeof(counts));
+        n = max_us = 0;
+        total_us = 0;
+    }
+
+    static int bucketFor(uint32_t us) {
+        if (us < kLinear) return us;
+        int e = 31 - __builtin_clz(us); // >= 3
+        int b = kLinear + (e - 3) * kSub + ((us >> (e - 2)) & (kSub - 1));
+        return b < kBuckets ? b : kBuckets - 1;
+    }
+    static uint32_t bucketUpper(int b) {
+        if (b < kLinear) return b;
+        int e = (b - kLinear) / kSub + 3, sub = (b - kLinear) % kSub;
+        return ((uint32_t)(kSub + sub + 1) << (e - 2)) - 1;
+    }
+
+private:
+    uint32_t counts[kBuckets] = {};
+    uint32_t n = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+};
+
+class StageProfiler {
+public:
+    void begin() { mhz = getCpuFrequencyMhz(); }
+
+    static uint32_t now() { return ESP.getCycleCount(); }
+
+    // Files the time since t0 (a now() taken on the same core) under the stage
+    void record(ProfStage s, uint32_t t0) { recordCycles(s, now() - t0); }
+
+    // For stages timed in pieces: adds up the cycles, then files them as one sample
+    void recordCycles(ProfStage s, uint32_t cycles) {
+        uint32_t bit = 1u << s;
+        if (reset_mask.load(std::memory_order_relaxed) & bit) { // Pending reset: the owner does it
+            hist[s].reset();
+            reset_mask.fetch_and(~bit, std::memory_order_relaxed);
+        }
+        hist[s].add(cycles / mhz);
+    }
+
+    const StageHistogram &stage(ProfStage s) const { return hist[s]; }
+    void reset() {
+        reset_mask.store((1u << PROF_STAGES) - 1);
+        since = millis();
+    }
+    uint32_t sinceMs() const { return since; } // millis() of the last reset
+
+    // {"unit":"us","window_ms":..,"stages":{"capture":{"n":..,"p50":..,"p95":..,"p99":..,"max":..,"mean":..},...}}
+    // Returns the length written (truncated to len - 1 if the buffer is short)
+    size_t json(char *out, size_t len) const {
+        size_t n = snprintf(out, len, "{\"unit\":\"us\",\"window_ms\":%lu,\"stages\":{", (unsigned long)(millis() - since));
+        for (int s = 0; s < PROF_STAGES && n < len; s++) {
+            const StageHistogram &h = hist[s];
+            n += snprintf(out + n, len - n, "%s\"%s\":{\"n\":%lu,\"p50\":%lu,\"p95\":%lu,\"p99\":%lu,\"max\":%lu,\"mean\":%lu}",
+                          s ? "," : "", profStageNames[s], (unsigned long)h.count(), (unsigned long)h.percentile(50),
+                          (unsigned long)h.percentile(95), (unsigned long)h.percentile(99), (unsigned long)h.maxUs(),
+                          (unsigned long)h.meanUs());
+        }
+        if (n < len) n += snprintf(out + n, len - n, "}}");
+        return n < len ? n : len - 1;
+    }
+
+private:
+    StageHistogram hist[PROF_STAGES];
+    uint32_t mhz = 240;
+    uint32_t since = 0;
+    std::atomic<uint32_t> reset_mask{0}; // Stages to clear on their next record()
+};
+
+// Times the enclosing block: { ProfileScope p(profiler, PROF_NET); server.handleClient(); }
+class ProfileScope {
+public:
+    ProfileScope(StageProfiler &prof, ProfStage stage) : p(prof), s(stage), t0(StageProfiler::now()) {}
+    ~ProfileScope() { p.record(s, t0); }
+
+private:
+    StageProfiler &p;
+    ProfStage s;
+    uint32_t t0;
+};
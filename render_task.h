@@ -0,0 +1,97 @@
+/**
+ * @file render_task.h
+ * @brief Screen rendering on its own task, paced to a target frame rate.
+ *
+ * Capture used to draw after every chunk (~70 Hz), so a slow frame held up
+ * the next mic read. Now loop() only captures, processes and serves; a
+ * separate task wakes at the target rate and calls the sketch's draw function,
+ * which renders whatever chunk is newest at that moment. Chunks that arrive
+ * between two frames are simply never drawn. When a frame overruns its slot
+ * the task does not try to catch up: the missed slots are counted as dropped
+ * and pacing restarts from now.
+ *
+ * UI state is shared between loop() (keys, touch, web handlers) and the draw
+ * function, so both sides hold lock() while they touch it. loop() only takes
+ * it for short state changes (a key press, a touch), never per chunk, so the
+ * capture path does not wait on the screen.
+ */
+#pragma once
+
+#include <Arduino.h>
+
+class RenderTask {
+public:
+    using DrawFn = void (*)();
+
+    static constexpr uint16_t kMinFps = 1;
+    static constexpr uint16_t kMaxFps = 120;
+
+    // Starts the task (core 0, below the SD writer; loop() runs on core 1)
+    bool begin(DrawFn fn, uint16_t fps, uint32_t stack = 8192, UBaseType_t priority = 1, BaseType_t core = 0) {
+        draw = fn;
+        setFps(fps);
+        mutex = xSemaphoreCreateMutex();
+        if (!mutex) return false;
+        return xTaskCreatePinnedToCore(taskEntry, "render", stack, this, priority, &task, core) == pdPASS;
+    }
+
+    void setFps(uint16_t fps) { target = constrain(fps, kMinFps, kMaxFps); }
+    uint16_t targetFps() const { return target; }
+
+    void lock() { xSemaphoreTake(mutex, portMAX_DELAY); }
+    void unlock() { xSemaphoreGive(mutex); }
+
+    // --- STATS (written by the task, read by loop; 32-bit stores are atomic here) ---
+    volatile uint32_t frames = 0;        // Frames rendered
+    volatile uint32_t dropped = 0;       // Frame slots missed because a frame ran long
+    volatile uint32_t last_us = 0;       // Render time of the last frame
+    volatile uint32_t max_us = 0;
+    volatile uint64_t total_us = 0;
+    volatile float    fps = 0;           // Achieved, over the last second
+
+    uint32_t avgUs() const { return frames ? (uint32_t)(total_us / frames) : 0; }
+    void resetStats() {
+        frames = dropped = last_us = max_us = 0;
+        total_us = 0;
+    }
+
+private:
+    DrawFn draw = nullptr;
+    volatile uint16_t target = 30;
+    SemaphoreHandle_t mutex = nullptr;
+    TaskHandle_t task = nullptr;
+
+    static void taskEntry(void *arg) { static_cast<RenderTask *>(arg)->run(); }
+
+    void run() {
+        TickType_t wake = xTaskGetTickCount();
+        uint32_t second_start = millis(), second_frames = 0;
+        for (;;) {
+            TickType_t period = pdMS_TO_TICKS(1000 / target);
+            if (period == 0) period = 1;
+            vTaskDelayUntil(&wake, period);
+
+            uint32_t t = micros();
+            draw();
+            uint32_t us = micros() - t;
+            last_us = us;
+            if (us > max_us) max_us = us;
+            total_us += us;
+            frames++;
+
+            // Ran past the next slot(s): skip them rather than render back-to-back
+            TickType_t now = xTaskGetTickCount();
+            if (now - wake >= period) {
+                dropped += (now - wake) / period;
+                wake = now;
+            }
+
+            second_frames++;
+            if (millis() - second_start >= 1000) {
+                fps = second_frames * 1000.0f / (millis() - second_start);
+                second_frames = 0;
+                second_start = millis();
+            }
+        }
+    }
+};
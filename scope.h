@@ -0,0 +1,370 @@
+const char scope_html[] PROGMEM = R"rawliteral(
+<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>M5 Scope</title>
+    <style>
+        :root {
+            /* DARK THEME (Default) */
+            --bg-color: #111;
+            --panel-bg: #1a1a1a;
+            --text-color: #eee;
+            --accent-color: #333;
+            --border-color: #444;
+
+            --grid-color: #2a2a2a;
+            --trace-color: #00e676;
+            --trig-color: #ffab00;
+            --rms-color: rgba(0, 230, 118, 0.35);
+
+            --font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif;
+        }
+
+        [data-theme="light"] {
+            --bg-color: #f4f4f4;
+            --panel-bg: #ffffff;
+            --text-color: #333;
+            --accent-color: #ddd;
+            --border-color: #ccc;
+            --grid-color: #e0e0e0;
+            --trace-color: #1565c0;
+            --trig-color: #e65100;
+            --rms-color: rgba(21, 101, 192, 0.3);
+        }
+
+        [data-theme="green"] {
+            --bg-color: #000;
+            --panel-bg: #051405;
+            --text-color: #4caf50;
+            --accent-color: #1b5e20;
+            --border-color: #2e7d32;
+            --grid-color: #0c260c;
+            --trace-color: #00ff00;
+            --trig-color: #ccff90;
+            --rms-color: rgba(0, 255, 0, 0.3);
+        }
+
+        body {
+            background-color: var(--bg-color);
+            color: var(--text-color);
+            font-family: var(--font-family);
+            margin: 0;
+            display: flex;
+            flex-direction: column;
+            height: 100vh;
+            overflow: hidden;
+        }
+
+        .toolbar {
+            background-color: var(--panel-bg);
+            padding: 8px 15px;
+            border-bottom: 1px solid var(--border-color);
+            display: flex;
+            gap: 15px;
+            flex-wrap: wrap;
+            align-items: center;
+            justify-content: center;
+        }
+
+        .control-group { display: flex; align-items: center; gap: 6px; }
+
+        label {
+            font-size: 0.7rem;
+            font-weight: 700;
+            text-transform: uppercase;
+            opacity: 0.7;
+        }
+
+        select, input[type="text"], input[type="number"] {
+            background: var(--bg-color);
+            color: var(--text-color);
+            border: 1px solid var(--border-color);
+            padding: 4px 8px;
+            border-radius: 4px;
+            font-family: inherit;
+            font-size: 0.8rem;
+            outline: none;
+        }
+        input[type="number"] { width: 70px; }
+
+        button {
+            background: var(--accent-color);
+            color: var(--text-color);
+            border: 1px solid var(--border-color);
+            padding: 4px 12px;
+            border-radius: 4px;
+            cursor: pointer;
+            font-weight: bold;
+            font-size: 0.75rem;
+        }
+        button:hover { filter: brightness(1.2); }
+
+        .status-light {
+            width: 8px;
+            height: 8px;
+            border-radius: 50%;
+            background-color: #444;
+            margin-left: 5px;
+        }
+        .status-light.connected { background-color: #00e676; box-shadow: 0 0 8px #00e676; }
+        .status-light.waiting { background-color: #ffab00; box-shadow: 0 0 8px #ffab00; }
+        .status-light.error { background-color: #ff1744; box-shadow: 0 0 8px #ff1744; }
+
+        .stage { flex-grow: 1; position: relative; width: 100%; height: 0; background: var(--bg-color); }
+        canvas { display: block; width: 100%; height: 100%; }
+
+        .overlay {
+            position: absolute;
+            top: 5px;
+            right: 10px;
+            font-family: monospace;
+            font-size: 0.75rem;
+            opacity: 0.6;
+            pointer-events: none;
+        }
+    </style>
+</head>
+<body>
+
+    <div class="toolbar">
+        <div class="control-group">
+            <label>IP</label>
+            <input type="text" id="ipAddress" placeholder="192.168.1.X" style="width: 100px;">
+            <button onclick="toggleConnection()" id="connectBtn">LINK</button>
+            <div class="status-light" id="statusIndicator"></div>
+        </div>
+
+        <div class="control-group">
+            <label>Trigger</label>
+            <select id="trigMode" onchange="onTriggerChange()">
+                <option value="0">Off</option>
+                <option value="1" selected>Auto</option>
+                <option value="2">Normal</option>
+                <option value="3">Single</option>
+            </select>
+            <select id="trigEdge">
+                <option value="0">Rising</option>
+                <option value="1">Falling</option>
+            </select>
+            <button onclick="armSingle()">ARM</button>
+        </div>
+
+        <div class="control-group">
+            <label>Level</label>
+            <input type="number" id="trigLevel" value="0" step="256">
+            <label>Holdoff ms</label>
+            <input type="number" id="holdoff" value="0" min="0" step="5">
+        </div>
+
+        <div class="control-group">
+            <label>Timebase</label>
+            <select id="timebase">
+                <option value="1" selected>1x</option>
+                <option value="2">2x</option>
+                <option value="4">4x</option>
+                <option value="8">8x</option>
+                <option value="16">16x</option>
+                <option value="32">32x</option>
+                <option value="64">64x</option>
+                <option value="h10">History 10 s</option>
+                <option value="h60">History 1 min</option>
+                <option value="h240">History 4 min</option>
+            </select>
+        </div>
+
+        <div class="control-group">
+            <label>Theme</label>
+            <select id="themeSelector">
+                <option value="dark">Dark</option>
+                <option value="light">Light</option>
+                <option value="green">Green</option>
+            </select>
+        </div>
+    </div>
+
+    <div class="stage" id="stage">
+        <canvas id="scopeCanvas"></canvas>
+        <div class="overlay"><span id="trigState">--</span> // <span id="span">0</span> ms/screen</div>
+    </div>
+
+    <script>
+        const canvas = document.getElementById('scopeCanvas');
+        const ctx = canvas.getContext('2d', { alpha: false });
+        const ipInput = document.getElementById('ipAddress');
+        const connectBtn = document.getElementById('connectBtn');
+        const statusLight = document.getElementById('statusIndicator');
+        const themeSelector = document.getElementById('themeSelector');
+
+        const COLS = 512; // Columns requested per frame (device decimates min/max per column)
+
+        let isConnected = false;
+        let pollTimer = null;
+        let baseUrl = '';
+        let frame = null; // Last frame received: {min, max, pre, spp, fs, trig}
+        let armPending = false;
+
+        const isLocal = window.location.protocol === 'file:';
+        if (!isLocal) {
+            ipInput.value = window.location.hostname;
+            window.onload = connect;
+        } else {
+            ipInput.value = "192.168.1.57";
+        }
+
+        themeSelector.addEventListener('change', (e) => {
+            document.documentElement.setAttribute('data-theme', e.target.value);
+            draw();
+        });
+        window.addEventListener('resize', () => { resizeCanvas(); draw(); });
+
+        function resizeCanvas() {
+            const stage = document.getElementById('stage');
+            const dpr = window.devicePixelRatio || 1;
+            canvas.width = stage.clientWidth * dpr;
+            canvas.height = stage.clientHeight * dpr;
+            ctx.setTransform(dpr, 0, 0, dpr, 0, 0);
+        }
+        resizeCanvas();
+
+        // --- CONNECTION ---
+        function toggleConnection() {
+            if (isConnected) disconnect(); else connect();
+        }
+
+        function connect() {
+            let ip = ipInput.value.trim();
+            if (!ip) ip = window.location.hostname;
+            baseUrl = (ip === window.location.hostname && !isLocal) ? '' : `http://${ip}`;
+            connectBtn.innerText = "STOP";
+            isConnected = true;
+            poll();
+        }
+
+        function disconnect() {
+            clearTimeout(pollTimer);
+            isConnected = false;
+            connectBtn.innerText = "LINK";
+            statusLight.className = "status-light";
+        }
+
+        function onTriggerChange() { armPending = true; }
+        function armSingle() { armPending = true; }
+
+        // One request at a time: the next poll is scheduled when the previous one answers
+        function poll() {
+            if (!isConnected) return;
+            const tb = document.getElementById('timebase').value;
+            if (tb.startsWith('h')) { pollHistory(parseInt(tb.substring(1))); return; }
+            const q = new URLSearchParams({
+                cols: COLS,
+                mode: document.getElementById('trigMode').value,
+                edge: document.getElementById('trigEdge').value,
+                level: document.getElementById('trigLevel').value || 0,
+                holdoff: document.getElementById('holdoff').value || 0,
+                tb: tb
+            });
+            if (armPending) { q.set('arm', 1); armPending = false; }
+
+            fetch(baseUrl + '/scopedata?' + q.toString())
+                .then(r => r.json())
+                .then(json => {
+                    if (json.min) {
+                        frame = json;
+                        statusLight.className = "status-light connected";
+                    } else {
+                        statusLight.className = "status-light waiting"; // NORMAL/SINGLE: holding the last frame
+                    }
+                    document.getElementById('trigState').innerText =
+                        json.min ? (json.trig ? 'TRIG\'D' : 'AUTO') : 'WAIT';
+                    draw();
+                })
+                .catch(e => {
+                    console.error(e);
+                    statusLight.className = "status-light error";
+                })
+                .finally(() => { pollTimer = setTimeout(poll, 50); });
+        }
+
+        // History views come from the device's min/max/RMS pyramid (/envelope): the same
+        // small reply whether it covers 10 seconds or minutes, no raw samples transferred
+        function pollHistory(seconds) {
+            fetch(baseUrl + `/envelope?last=${seconds}&width=${COLS}`)
+                .then(r => r.json())
+                .then(json => {
+                    frame = {
+                        min: json.px.map(p => p ? p[0] : 0),
+                        max: json.px.map(p => p ? p[1] : 0),
+                        rms: json.px.map(p => p ? p[2] : 0),
+                        spp: (json.to - json.from) / json.px.length,
+                        fs: json.fs,
+                        pre: -1
+                    };
+                    statusLight.className = "status-light connected";
+                    document.getElementById('trigState').innerText = 'HISTORY';
+                    draw();
+                })
+                .catch(e => {
+                    console.error(e);
+                    statusLight.className = "status-light error";
+                })
+                .finally(() => { pollTimer = setTimeout(poll, 250); });
+        }
+
+        // --- RENDER ---
+        function draw() {
+            const styles = getComputedStyle(document.documentElement);
+            const w = canvas.clientWidth, h = canvas.clientHeight;
+            ctx.fillStyle = styles.getPropertyValue('--bg-color');
+            ctx.fillRect(0, 0, w, h);
+
+            // 10 x 8 graticule
+            ctx.strokeStyle = styles.getPropertyValue('--grid-color');
+            ctx.lineWidth = 1;
+            ctx.beginPath();
+            for (let i = 1; i < 10; i++) { ctx.moveTo(i * w / 10, 0); ctx.lineTo(i * w / 10, h); }
+            for (let i = 1; i < 8; i++) { ctx.moveTo(0, i * h / 8); ctx.lineTo(w, i * h / 8); }
+            ctx.stroke();
+
+            if (!frame) return;
+            const n = frame.min.length;
+            const toY = v => h / 2 - (v / 32768) * (h / 2);
+
+            // Trigger marker (position and level), not in history views
+            if (frame.pre >= 0) {
+                const tx = frame.pre / n * w;
+                const level = parseFloat(document.getElementById('trigLevel').value) || 0;
+                ctx.strokeStyle = styles.getPropertyValue('--trig-color');
+                ctx.setLineDash([4, 4]);
+                ctx.beginPath();
+                ctx.moveTo(tx, 0); ctx.lineTo(tx, h);
+                ctx.moveTo(0, toY(level)); ctx.lineTo(w, toY(level));
+                ctx.stroke();
+                ctx.setLineDash([]);
+            }
+
+            // Min/max columns, at least 1px tall so a flat line stays visible
+            ctx.fillStyle = styles.getPropertyValue('--trace-color');
+            const cw = w / n;
+            for (let i = 0; i < n; i++) {
+                const y1 = toY(frame.max[i]), y2 = toY(frame.min[i]);
+                ctx.fillRect(i * cw, y1, Math.max(cw, 1), Math.max(y2 - y1, 1));
+            }
+
+            // RMS band on top of the min/max envelope (history views)
+            if (frame.rms) {
+                ctx.fillStyle = styles.getPropertyValue('--rms-color');
+                for (let i = 0; i < n; i++) {
+                    const y1 = toY(frame.rms[i]), y2 = toY(-frame.rms[i]);
+                    ctx.fillRect(i * cw, y1, Math.max(cw, 1), y2 - y1);
+                }
+            }
+
+            document.getElementById('span').innerText = (n * frame.spp * 1000 / frame.fs).toFixed(1);
+        }
+        draw();
+    </script>
+</body>
+</html>
+)rawliteral";
@@ -0,0 +1,161 @@
+/**
+ * @file trace.h
+ * @brief Chrome trace_event recorder for the hot path (compiled out by default).
+ *
+ * Define MICTALK_TRACE 1 before including the headers (the sketches have the
+ * switch near the top) and the TRACE_* macros below record into a fixed RAM
+ * ring; with 0 they expand to nothing and no ring is allocated.
+ *
+ * An event is 12 bytes: a microsecond stamp, a name (a string literal, only
+ * the pointer is stored), phase (begin / end / instant), task and a 16-bit
+ * argument. Recording is an atomic slot claim, an esp_timer read, a lookup
+ * of the calling task in a short table and four stores, from any task or
+ * core. When the ring is full the oldest events are overwritten.
+ *
+ * writeJson() turns the ring into Chrome trace_event JSON (load it in
+ * Perfetto / chrome://tracing): one "thread" per FreeRTOS task, named after
+ * it, times in us. Tasks sharing a core preempt each other mid-slice, so
+ * keying the tracks on the core would interleave their begin / end pairs.
+ * Past kMaxTasks tasks the rest share an "other" track. Stamps
+ * come from esp_timer, one clock for both cores (the per-core cycle counters
+ * do not start together, so they cannot be compared across cores). Only the
+ * low 32 bits are kept (~71 min), and they are unwrapped event to event.
+ */
+#pragma once
+
+#ifndef MICTALK_TRACE
+#define MICTALK_TRACE 0
+#endif
+
+#if MICTALK_TRACE
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 1024 // 12 KB
+#endif
+
+class TraceRing {
+public:
+    static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "TRACE_EVENTS must be a power of 2");
+    static constexpr uint8_t kMaxTasks = 12;
+
+    struct Event {
+        uint32_t us;   // esp_timer_get_time(), low 32 bits
+        const char *name;
+        char phase;    // 'B', 'E' or 'i'
+        uint8_t tid;   // Slot in the task table (kMaxTasks = other)
+        uint16_t arg;
+    };
+
+    void record(const char *name, char phase, uint16_t arg) {
+        if (paused.load(std::memory_order_relaxed)) return;
+        uint32_t i = head.fetch_add(1, std::memory_order_relaxed) & (TRACE_EVENTS - 1);
+        Event &e = ring[i];
+        e.us = (uint32_t)esp_timer_get_time();
+        e.name = name;
+        e.phase = phase;
+        e.tid = taskId();
+        e.arg = arg;
+    }
+
+    // Streams the ring (oldest first) as trace_event JSON through emit(text, len).
+    // Recording pauses meanwhile so the events do not move underneath.
+    template <typename Emit>
+    void writeJson(Emit emit) {
+        paused.store(true);
+        delay(1); // Let an event being written on the other core land
+        uint32_t end = head.load(), n = end < TRACE_EVENTS ? end : TRACE_EVENTS;
+        static const char head_json[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        emit(head_json, (int)sizeof(head_json) - 1);
+        char buf[160];
+        int len;
+        // One named track per task, then the shared overflow track
+        bool first = true;
+        for (uint32_t i = 0; i <= kMaxTasks; i++) {
+            bool other = i == kMaxTasks;
+            if (!other && (i >= task_count.load() || !task_handle[i].load(std::memory_order_acquire))) continue;
+            len = snprintf(buf, sizeof(buf),
+                           "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                           first ? "" : ",", (unsigned)i, other ? "other" : task_name[i]);
+            first = false;
+            emit(buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+        }
+        int64_t t = 0; // us since the oldest event
+        uint32_t prev = 0;
+        for (uint32_t k = end - n; k != end; k++) {
+            const Event &e = ring[k & (TRACE_EVENTS - 1)];
+            // Signed: the other core may have stored a slightly earlier stamp after claiming a later slot
+            if (k != end - n) t += (int32_t)(e.us - prev);
+            prev = e.us;
+            if (e.phase == 'i') {
+                len = snprintf(buf, sizeof(buf),
+                               ",{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":1,\"tid\":%u,\"args\":{\"v\":%u}}",
+                               e.name, (long long)t, e.tid, e.arg);
+            } else {
+                len = snprintf(buf, sizeof(buf), ",{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%u}",
+                               e.name, e.phase, (long long)t, e.tid);
+            }
+            emit(buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+        }
+        emit("]}", 2);
+        paused.store(false);
+    }
+
+    uint32_t recorded() const { return head.load(std::memory_order_relaxed); }
+    void clear() { head.store(0); }
+
+private:
+    Event ring[TRACE_EVENTS];
+    std::atomic<uint32_t> head{0};
+    std::atomic<bool> paused{false};
+
+    // Task table: a slot is claimed once per task, its name copied before the handle is published
+    std::atomic<void *> task_handle[kMaxTasks] = {};
+    char task_name[kMaxTasks][configMAX_TASK_NAME_LEN + 8];
+    std::atomic<uint32_t> task_count{0};
+
+    uint8_t taskId() {
+        void *self = xTaskGetCurrentTaskHandle();
+        uint32_t n = task_count.load(std::memory_order_acquire);
+        if (n > kMaxTasks) n = kMaxTasks;
+        for (uint32_t i = 0; i < n; i++)
+            if (task_handle[i].load(std::memory_order_relaxed) == self) return (uint8_t)i;
+        if (n >= kMaxTasks) return kMaxTasks; // Table full: no more claims
+        uint32_t i = task_count.fetch_add(1); // Only this task can register itself: no duplicates
+        if (i >= kMaxTasks) return kMaxTasks;
+        snprintf(task_name[i], sizeof(task_name[i]), "%s (core %d)", pcTaskGetName(nullptr), (int)xPortGetCoreID());
+        task_handle[i].store(self, std::memory_order_release);
+        return (uint8_t)i;
+    }
+};
+
+static TraceRing traceRing;
+
+// Begin / end pair around the enclosing block
+class TraceScope {
+public:
+    explicit TraceScope(const char *n) : name(n) { traceRing.record(name, 'B', 0); }
+    ~TraceScope() { traceRing.record(name, 'E', 0); }
+
+private:
+    const char *name;
+};
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#define TRACE_BEGIN(name) traceRing.record(name, 'B', 0)
+#define TRACE_END(name) traceRing.record(name, 'E', 0)
+#define TRACE_INSTANT(name, arg) traceRing.record(name, 'i', (uint16_t)(arg))
+#define TRACE_SCOPE(name) TraceScope TRACE_CAT(trace_scope_, __LINE__)(name)
+
+#else
+
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name) do {} while (0)
+#define TRACE_INSTANT(name, arg) do {} while (0)
+#define TRACE_SCOPE(name) do {} while (0)
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file vad.h
+ * @brief Energy + spectral-flatness voice/sound activity detector.
+ *
+ * Each chunk is classified as ACTIVE or SILENT:
+ * - Energy: chunk RMS in dBFS compared against an adaptive noise floor
+ *   (drops quickly to quieter levels, creeps up slowly when it is louder,
+ *   and far slower while a sound is active, so a long held sound is not
+ *   taken for the floor).
+ * - Spectral flatness: geometric / arithmetic mean of the power spectrum.
+ *   Steady broadband noise (fans, hiss) is flat (~1), voices and tones are
+ *   peaky (~0), so a small energy rise only counts if the spectrum is peaky.
+ *
+ * A short onset count and a longer hangover keep word endings and pauses
+ * between syllables inside the active region.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "fft.h"
+
+class VoiceActivityDetector {
+public:
+    static constexpr int   kFFT         = 256;
+    static constexpr float kFloorDb     = -100.0f;
+    static constexpr float kMarginDb    = 9.0f;   // Above floor + peaky spectrum = active
+    static constexpr float kLoudDb      = 20.0f;  // Above floor by this much = active regardless
+    static constexpr float kMaxFlatness = 0.35f;
+    static constexpr float kRiseDb      = 0.03f;  // Noise floor creep per chunk (~2 dB/s at 70 chunks/s)
+    static constexpr float kRiseActiveDb = 0.001f; // ...while active (~4 dB/min: a new steady noise still wins)
+    static constexpr int   kOnsetChunks = 2;
+    static constexpr int   kHangChunks  = 20;     // ~280 ms at 17 kHz / 240
+
+    void begin() {
+        noise_floor = -60.0f;
+        level_db = kFloorDb;
+        flatness = 1.0f;
+        onset = 0;
+        hang = 0;
+        active = false;
+    }
+
+    // Classifies one chunk (n <= kFFT samples) and returns the new state
+    bool process(const int16_t *x, size_t n) {
+        if (n > (size_t)kFFT) n = kFFT;
+
+        // --- ENERGY ---
+        float sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            float v = x[i] * (1.0f / 32768.0f);
+            re[i] = v;
+            im[i] = 0;
+            sum += v * v;
+        }
+        for (int i = n; i < kFFT; i++) re[i] = im[i] = 0;
+        float ms = sum / (n ? n : 1);
+        level_db = (ms > 1e-10f) ? 10.0f * log10f(ms) : kFloorDb;
+
+        // --- SPECTRAL FLATNESS (skip DC, use bins 1..N/2) ---
+        fft.forward(re, im);
+        float log_sum = 0, lin_sum = 0;
+        const int bins = kFFT / 2;
+        for (int k = 1; k <= bins; k++) {
+            float p = re[k] * re[k] + im[k] * im[k] + 1e-12f;
+            log_sum += logf(p);
+            lin_sum += p;
+        }
+        flatness = expf(log_sum / bins) / (lin_sum / bins);
+
+        // --- ADAPTIVE NOISE FLOOR ---
+        if (level_db < noise_floor) noise_floor = 0.5f * (noise_floor + level_db);
+        else noise_floor += active ? kRiseActiveDb : kRiseDb; // Decision of the previous chunk
+        if (noise_floor < kFloorDb) noise_floor = kFloorDb;
+
+        // --- DECISION WITH ONSET / HANGOVER ---
+        float above = level_db - noise_floor;
+        bool speech = (above > kLoudDb) || (above > kMarginDb && flatness < kMaxFlatness);
+        if (speech) {
+            if (++onset >= kOnsetChunks) {
+                active = true;
+                hang = kHangChunks;
+            }
+        } else {
+            onset = 0;
+            if (hang > 0) hang--;
+            else active = false;
+        }
+        return active;
+    }
+
+    bool isActive() const { return active; }
+    float levelDb() const { return level_db; }
+    float noiseFloorDb() const { return noise_floor; }
+    float spectralFlatness() const { return flatness; }
+
+private:
+    float noise_floor = -60.0f;
+    float level_db = kFloorDb;
+    float flatness = 1.0f;
+    int   onset = 0;
+    int   hang = 0;
+    bool  active = false;
+
+    float re[kFFT];
+    float im[kFFT];
+    ComplexFFT<kFFT> fft;
+};
@@ -0,0 +1,182 @@
+/**
+ * @file viz.h
+ * @brief Fixed-point spectrum / VU analysis and bar renderers shared by both screens.
+ *
+ * Integer only per chunk (the float math runs once, for the tables), so it is
+ * cheap on the Cardputer's ESP32-S3 and needs no arduinoFFT or PSRAM:
+ *
+ * - FixedFFT: radix-2 complex FFT on int16 with Q15 twiddles, halving every
+ *   stage so nothing overflows (result = X / N).
+ * - VizSpectrum: Hann window, 256-point FFT (shorter chunks are zero-padded),
+ *   power per bin, bins grouped into bars (loudest bin wins), each bar a
+ *   0-255 level over 72 dB below full scale (integer log2, ~0.3 dB).
+ * - vuMeasure()/vuWidth(): peak and mean absolute level of a chunk and the
+ *   meter bar length for them.
+ * - vizDrawBars()/vizDrawHBar(): incremental bar drawing for any LovyanGFX
+ *   target (panel, sprite, canvas). Only the part of a bar that grew or shrank
+ *   since the last call is filled; mark(x, y, w, h) is called for each filled
+ *   rectangle (the Tab5 tile compositor; a no-op on the Cardputer). Reset the
+ *   previous-state arrays to the floor after clearing the target.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "trace.h"
+
+template <int N>
+class FixedFFT {
+    static_assert((N & (N - 1)) == 0, "FFT size must be a power of 2");
+
+public:
+    FixedFFT() {
+        for (int i = 0; i < N / 2; i++) {
+            cos_t[i] = (int16_t)lroundf(32767.0f * cosf(2.0f * (float)M_PI * i / N));
+            sin_t[i] = (int16_t)lroundf(32767.0f * sinf(2.0f * (float)M_PI * i / N));
+        }
+    }
+
+    // In place, X[k] / N = sum x[n] e^(-2*pi*i*k*n/N) / N
+    void forward(int16_t *re, int16_t *im) const {
+        for (int i = 1, j = 0; i < N; i++) { // Bit reversal
+            int bit = N >> 1;
+            for (; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if (i < j) {
+                int16_t t = re[i]; re[i] = re[j]; re[j] = t;
+                t = im[i]; im[i] = im[j]; im[j] = t;
+            }
+        }
+        for (int len = 2; len <= N; len <<= 1) {
+            int half = len >> 1;
+            int step = N / len;
+            for (int i = 0; i < N; i += len) {
+                for (int j = 0; j < half; j++) {
+                    int32_t wr = cos_t[j * step], wi = -sin_t[j * step];
+                    int a = i + j, b = a + half;
+                    int32_t tr = (re[b] * wr - im[b] * wi) >> 15;
+                    int32_t ti = (re[b] * wi + im[b] * wr) >> 15;
+                    int32_t ar = re[a], ai = im[a];
+                    re[b] = (int16_t)((ar - tr) >> 1);
+                    im[b] = (int16_t)((ai - ti) >> 1);
+                    re[a] = (int16_t)((ar + tr) >> 1);
+                    im[a] = (int16_t)((ai + ti) >> 1);
+                }
+            }
+        }
+    }
+
+private:
+    int16_t cos_t[N / 2], sin_t[N / 2];
+};
+
+// log2(v) in Q8 (v > 0), linear between powers of two
+static inline int32_t vizLog2Q8(uint32_t v) {
+    if (!v) return 0;
+    int e = 31 - __builtin_clz(v);
+    uint32_t m = e >= 8 ? v >> (e - 8) : v << (8 - e);
+    return e * 256 + (int32_t)(m & 0xFF);
+}
+
+class VizSpectrum {
+public:
+    static constexpr int kFFT = 256;
+    static constexpr int kBins = kFFT / 2;
+    static constexpr int kRangeDb = 72; // Level 0 .. 255 spans this much below full scale
+
+    VizSpectrum() {
+        for (int i = 0; i < kFFT; i++) window[i] = (int16_t)lroundf(32767.0f * (0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / kFFT)));
+    }
+
+    // Levels (0-255) for `bars` bars from DC+1 to fs/2 of the chunk; gain is the display scale factor
+    void analyze(const int16_t *x, size_t n, int gain, uint8_t *levels, int bars) {
+        if (n > (size_t)kFFT) n = kFFT;
+        for (size_t i = 0; i < n; i++) {
+            int32_t v = x[i] * gain;
+            v = v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+            re[i] = (int16_t)((v * window[i]) >> 15);
+            im[i] = 0;
+        }
+        for (int i = n; i < kFFT; i++) re[i] = im[i] = 0;
+        TRACE_BEGIN("fft");
+        fft.forward(re, im);
+        TRACE_END("fft");
+
+        // Full-scale sine through the Hann window and the /N FFT: |X| = 32768 / 4, power 2^26
+        const int32_t ref_q8 = 26 * 256;
+        for (int b = 0; b < bars; b++) {
+            int k0 = 1 + b * (kBins - 1) / bars;
+            int k1 = 1 + (b + 1) * (kBins - 1) / bars;
+            if (k1 <= k0) k1 = k0 + 1;
+            uint32_t p = 0;
+            for (int k = k0; k < k1; k++) {
+                uint32_t q = (uint32_t)(re[k] * re[k]) + (uint32_t)(im[k] * im[k]);
+                if (q > p) p = q;
+            }
+            // dB = 10 log10(p / ref) = 3.0103 * log2(...), in tenths
+            int32_t db10 = (vizLog2Q8(p) - ref_q8) * 30103 / 256000;
+            int32_t lv = (db10 + kRangeDb * 10) * 255 / (kRangeDb * 10);
+            levels[b] = lv <= 0 || !p ? 0 : lv >= 255 ? 255 : (uint8_t)lv;
+        }
+    }
+
+private:
+    FixedFFT<kFFT> fft;
+    int16_t window[kFFT]; // Hann, Q15
+    int16_t re[kFFT], im[kFFT];
+};
+
+struct VuLevel {
+    int32_t peak; // Largest |sample|
+    int32_t avg;  // Mean |sample|
+};
+
+static inline VuLevel vuMeasure(const int16_t *x, size_t n) {
+    int32_t peak = 0, sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = x[i] < 0 ? -x[i] : x[i];
+        if (v > peak) peak = v;
+        sum += v;
+    }
+    return {peak, n ? (int32_t)(sum / (int32_t)n) : 0};
+}
+
+// Bar length for a level: full_w when level * gain reaches full_level
+static inline int32_t vuWidth(int32_t level, int gain, int32_t full_w, int32_t full_level) {
+    int32_t w = (int32_t)((int64_t)level * gain * full_w / full_level);
+    return w > full_w ? full_w : w;
+}
+
+// Vertical bars standing on `bottom`, barW apart (drawn barW - gap wide), up to `height` at 255.
+// prev_top[i] holds the bar top drawn last time (bottom = empty).
+template <typename GFX, typename Mark>
+void vizDrawBars(GFX &g, int x0, int bottom, int height, int barW, int gap, const uint8_t *levels, int bars,
+                 int16_t *prev_top, uint16_t fg, uint16_t bg, Mark mark) {
+    for (int i = 0; i < bars; i++) {
+        int x = x0 + i * barW;
+        int y = bottom - levels[i] * height / 255;
+        int py = prev_top[i];
+        if (y < py) { // Taller: fill from the new top down to the old one
+            g.fillRect(x, y, barW - gap, py - y, fg);
+            mark(x, y, barW - gap, py - y);
+        } else if (y > py) { // Shorter: erase from the old top down to the new one
+            g.fillRect(x, py, barW - gap, y - py, bg);
+            mark(x, py, barW - gap, y - py);
+        }
+        prev_top[i] = y;
+    }
+}
+
+// Horizontal bar from x0, w long (prev_w: length drawn last time, 0 = empty)
+template <typename GFX, typename Mark>
+void vizDrawHBar(GFX &g, int x0, int y, int w, int h, int32_t &prev_w, uint16_t fg, uint16_t bg, Mark mark) {
+    if (w > prev_w) {
+        g.fillRect(x0 + prev_w, y, w - prev_w, h, fg);
+        mark(x0 + prev_w, y, w - prev_w, h);
+    } else if (w < prev_w) {
+        g.fillRect(x0 + w, y, prev_w - w, h, bg);
+        mark(x0 + w, y, prev_w - w, h);
+    }
+    prev_w = w;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file wav.h
+ * @brief Canonical 44-byte PCM WAV header (mono, 16-bit little endian).
+ *
+ * Shared by everything that hands audio out as a file: the SD recorder
+ * writes it at the front of each segment (and patches the sizes on close),
+ * and HTTP downloads send it ahead of the samples.
+ */
+#pragma once
+
+#include <stdint.h>
+
+static constexpr uint32_t kWavHeaderBytes = 44;
+
+static inline void wavPut16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static inline void wavPut32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+// Fills `out` (kWavHeaderBytes) for `data_bytes` of 16-bit mono samples at `samplerate`
+static inline void makeWavHeader(uint8_t *out, uint32_t data_bytes, uint32_t samplerate) {
+    const uint16_t channels = 1, bits = 16;
+    const uint16_t block_align = channels * bits / 8;
+    out[0] = 'R'; out[1] = 'I'; out[2] = 'F'; out[3] = 'F';
+    wavPut32(out + 4, 36 + data_bytes);
+    out[8] = 'W'; out[9] = 'A'; out[10] = 'V'; out[11] = 'E';
+    out[12] = 'f'; out[13] = 'm'; out[14] = 't'; out[15] = ' ';
+    wavPut32(out + 16, 16);                         // fmt chunk size
+    wavPut16(out + 20, 1);                          // PCM
+    wavPut16(out + 22, channels);
+    wavPut32(out + 24, samplerate);
+    wavPut32(out + 28, samplerate * block_align);   // Byte rate
+    wavPut16(out + 32, block_align);
+    wavPut16(out + 34, bits);
+    out[36] = 'd'; out[37] = 'a'; out[38] = 't'; out[39] = 'a';
+    wavPut32(out + 40, data_bytes);
+}
@@ -197,6 +197,16 @@ const char index_html[] PROGMEM = R"rawliteral(
             opacity: 0.3;
             pointer-events: none;
         }
+
+        .overlay-lufs {
+            position: absolute;
+            bottom: 10px;
+            left: 10px;
+            font-family: monospace;
+            font-size: 0.85rem;
+            opacity: 0.8;
+            pointer-events: none;
+        }
     </style>
 </head>
 <body>
@@ -217,6 +227,16 @@ const char index_html[] PROGMEM = R"rawliteral(
             </select>
         </div>
 
+        <div class="control-group">
+            <label title="Peak of each snapshot, or EBU R128 loudness from the device">Source</label>
+            <select id="meterSource" onchange="onSourceChange()">
+                <option value="peak" selected>Peak</option>
+                <option value="m">LUFS Momentary</option>
+                <option value="s">LUFS Short-Term</option>
+            </select>
+            <button onclick="resetLoudness()" title="Restart integrated loudness">RESET I</button>
+        </div>
+
         <div class="control-group">
             <label>Gain</label>
             <select id="gain">
@@ -263,6 +283,7 @@ const char index_html[] PROGMEM = R"rawliteral(
 
     <div class="meter-stage" id="stage">
         <canvas id="vuCanvas"></canvas>
+        <div class="overlay-lufs" id="lufsReadout"></div>
         <div class="overlay-fps">RENDER: GPU // FPS: <span id="fps">--</span></div>
     </div>
 
@@ -276,6 +297,8 @@ const char index_html[] PROGMEM = R"rawliteral(
         const themeSelector = document.getElementById('themeSelector');
         const stereoSimCheck = document.getElementById('stereoSim');
         const noiseAmtSelect = document.getElementById('noiseAmt');
+        const sourceSelect = document.getElementById('meterSource');
+        const lufsReadout = document.getElementById('lufsReadout');
 
         // Detect if running on device
         const isLocal = window.location.protocol === 'file:';
@@ -291,6 +314,8 @@ const char index_html[] PROGMEM = R"rawliteral(
         // --- APP STATE ---
         let isConnected = false;
         let pollInterval = null;
+        let loudInterval = null;
+        let baseUrl = '';
         let animFrame = null;
         let lastTime = 0;
         let frameCount = 0;
@@ -335,23 +360,33 @@ const char index_html[] PROGMEM = R"rawliteral(
             statusLight.className = "status-light connected";
 
             // Use relative path if IP matches current host (avoids CORS)
-            let url = (ip === window.location.hostname && !isLocal) ? '/data' : `http://${ip}/data`;
+            baseUrl = (ip === window.location.hostname && !isLocal) ? '' : `http://${ip}`;
+            let url = baseUrl + '/data';
 
             pollInterval = setInterval(() => {
                 fetch(url)
                     .then(r => r.json())
-                    .then(json => processData(json.data))
+                    .then(json => processData(json.data || []))  // Silent chunks arrive as a data-less heartbeat
                     .catch(e => {
                         console.error(e);
                         statusLight.className = "status-light error";
                     });
             }, 40);
 
+            // Loudness is integrated on the device, so a slower poll is enough
+            loudInterval = setInterval(() => {
+                fetch(baseUrl + '/loudness')
+                    .then(r => r.json())
+                    .then(processLoudness)
+                    .catch(e => console.error(e));
+            }, 100);
+
             loop(0);
         }
 
         function disconnect() {
             clearInterval(pollInterval);
+            clearInterval(loudInterval);
             cancelAnimationFrame(animFrame);
             isConnected = false;
             connectBtn.innerText = "CONNECT";
@@ -360,7 +395,38 @@ const char index_html[] PROGMEM = R"rawliteral(
             requestDraw();
         }
 
+        // --- LOUDNESS (EBU R128) ---
+        // Maps LUFS onto the existing -20 / 0 / +3 scale with 0 at the -23 LUFS target
+        const LUFS_TARGET = -23;
+        function lufsToNeedle(lufs) {
+            if (lufs <= LUFS_TARGET) return Math.max(0, 0.5 * (lufs - (LUFS_TARGET - 20)) / 20);
+            return 0.5 + 0.5 * (lufs - LUFS_TARGET) / 3;
+        }
+
+        function fmtLu(v) { return (v <= -99) ? '-inf' : v.toFixed(1); }
+
+        function processLoudness(l) {
+            lufsReadout.innerText = `M ${fmtLu(l.m)}  S ${fmtLu(l.s)}  I ${fmtLu(l.i)} LUFS  |  TP ${fmtLu(l.tp)} dBTP`;
+            const src = sourceSelect.value;
+            if (src === 'peak') return;
+
+            // The device meters one mono signal, so both needles share it
+            targetVolL = targetVolR = Math.min(lufsToNeedle(src === 'm' ? l.m : l.s), 1.2);
+        }
+
+        function onSourceChange() {
+            targetVolL = targetVolR = 0;
+            requestDraw();
+        }
+
+        function resetLoudness() {
+            fetch(baseUrl + '/loudness?reset=1').catch(e => console.error(e));
+        }
+
         function processData(data) {
+            statusLight.className = "status-light connected";
+            if (sourceSelect.value !== 'peak') return;
+
             let maxVal = 0;
             for (let v of data) {
                 if (Math.abs(v) > maxVal) maxVal = Math.abs(v);
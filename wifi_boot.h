@@ -0,0 +1,203 @@
+/**
+ * @file wifi_boot.h
+ * @brief Asynchronous WiFi bring-up from a cached AP, and boot phase timing.
+ *
+ * setup() no longer waits for the network: WifiBoot::begin() starts the
+ * connection and returns, capture and the display start right away, and
+ * loop() calls poll() until the link is up (the web server is already
+ * listening by then).
+ *
+ * Most of a cold connect is the channel scan and DHCP. After each successful
+ * connect the AP's BSSID and channel are cached in NVS (only when they
+ * change, to spare the flash), and the next boot goes straight to that AP.
+ * Optionally the last lease is reused as a static IP, which skips DHCP too.
+ * If the cached AP does not answer within kCachedTimeoutMs the cache is
+ * ignored and a normal scan + DHCP connect follows.
+ *
+ * BootTimeline records when each boot phase finished, for /boot.
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include "trace.h"
+
+class BootTimeline {
+public:
+    static constexpr int kMaxPhases = 12;
+
+    // Records that `name` (a string literal) finished now
+    void mark(const char *name) {
+        if (count < kMaxPhases) phases[count++] = {name, millis()};
+    }
+
+    // [{"phase":"sd","at":412,"took":120},...]: "at" is ms since power-on, "took" since the previous mark
+    int json(char *out, size_t len) const {
+        int n = snprintf(out, len, "[");
+        uint32_t prev = 0;
+        for (int i = 0; i < count && n < (int)len; i++) {
+            n += snprintf(out + n, len - n, "%s{\"phase\":\"%s\",\"at\":%lu,\"took\":%lu}", i ? "," : "",
+                          phases[i].name, (unsigned long)phases[i].ms, (unsigned long)(phases[i].ms - prev));
+            prev = phases[i].ms;
+        }
+        if (n < (int)len) n += snprintf(out + n, len - n, "]");
+        return n;
+    }
+
+private:
+    struct Phase {
+        const char *name;
+        uint32_t ms;
+    };
+    Phase phases[kMaxPhases];
+    int count = 0;
+};
+
+class WifiBoot {
+public:
+    static constexpr uint32_t kCachedTimeoutMs = 4000; // Cached AP silent this long: fall back to a scan
+
+    // Starts connecting and returns at once; `timeline` gets a "wifi" mark when the link first comes up
+    void begin(const char *ssid_, const char *pass_, BootTimeline *timeline_ = nullptr) {
+        strncpy(ssid, ssid_, sizeof(ssid) - 1);
+        strncpy(pass, pass_, sizeof(pass) - 1);
+        timeline = timeline_;
+        load();
+
+        WiFi.persistent(false); // The SDK's own copy would rewrite flash on every begin()
+        WiFi.mode(WIFI_STA);
+        from_cache = cache_valid;
+        if (from_cache) {
+            if (use_static && cache.ip) {
+                WiFi.config(IPAddress(cache.ip), IPAddress(cache.gw), IPAddress(cache.mask), IPAddress(cache.dns));
+            }
+            WiFi.begin(ssid, pass, cache.channel, cache.bssid);
+        } else {
+            WiFi.begin(ssid, pass);
+        }
+        started_ms = millis();
+        state = CONNECTING;
+        TRACE_INSTANT("wifi_begin", from_cache);
+    }
+
+    // Call every loop() pass. Returns true on the pass the link comes up (first time or after a drop).
+    bool poll() {
+        bool up = WiFi.status() == WL_CONNECTED;
+        if (state == CONNECTED) {
+            if (!up) { // The SDK reconnects by itself; just notice when it is back
+                state = CONNECTING;
+                TRACE_INSTANT("wifi_lost", 0);
+            }
+            return false;
+        }
+        if (up) {
+            state = CONNECTED;
+            TRACE_INSTANT("wifi_up", WiFi.channel());
+            if (!connected_ms) {
+                connected_ms = millis();
+                if (timeline) timeline->mark("wifi");
+            }
+            save();
+            return true;
+        }
+        if (from_cache && millis() - started_ms > kCachedTimeoutMs) {
+            // AP moved, channel changed, or the cached lease is no good: start over the normal way
+            from_cache = false;
+            fallbacks++;
+            TRACE_INSTANT("wifi_fallback", fallbacks);
+            WiFi.disconnect();
+            WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+            WiFi.begin(ssid, pass);
+        }
+        return false;
+    }
+
+    bool connected() const { return state == CONNECTED; }
+    uint32_t connectedAt() const { return connected_ms; } // millis() of the first connect, 0 = not yet
+    bool usedCache() const { return from_cache; }
+
+    // Reuse the last DHCP lease as a static IP from the next boot on (skips DHCP)
+    void setStaticIp(bool on) {
+        use_static = on;
+        Preferences prefs;
+        prefs.begin(kNamespace, false);
+        prefs.putBool("static", on);
+        prefs.end();
+    }
+
+    // Drops the cached AP and lease; the next boot scans
+    void forget() {
+        Preferences prefs;
+        prefs.begin(kNamespace, false);
+        prefs.clear();
+        prefs.end();
+        cache_valid = false;
+        use_static = false;
+    }
+
+    int json(char *out, size_t len) const {
+        return snprintf(out, len,
+                        "{\"connected\":%d,\"cached\":%d,\"static\":%d,\"fallbacks\":%lu,\"connect_ms\":%lu,"
+                        "\"channel\":%d,\"rssi\":%d}",
+                        connected() ? 1 : 0, from_cache ? 1 : 0, use_static ? 1 : 0, (unsigned long)fallbacks,
+                        (unsigned long)(connected_ms ? connected_ms - started_ms : 0),
+                        connected() ? (int)WiFi.channel() : 0, connected() ? (int)WiFi.RSSI() : 0);
+    }
+
+private:
+    static constexpr const char *kNamespace = "wifiboot";
+
+    struct Cache {
+        uint8_t  bssid[6];
+        uint8_t  channel;
+        uint32_t ip, gw, mask, dns;
+    };
+
+    enum State : uint8_t { IDLE, CONNECTING, CONNECTED };
+
+    char ssid[33] = "";
+    char pass[65] = "";
+    BootTimeline *timeline = nullptr;
+
+    Cache cache = {};
+    bool  cache_valid = false;
+    bool  use_static = false;
+    bool  from_cache = false;
+    State state = IDLE;
+    uint32_t started_ms = 0;
+    uint32_t connected_ms = 0;
+    uint32_t fallbacks = 0;
+
+    void load() {
+        Preferences prefs;
+        if (!prefs.begin(kNamespace, true)) return; // Nothing cached yet
+        char saved[33] = "";
+        prefs.getString("ssid", saved, sizeof(saved));
+        cache_valid = strcmp(saved, ssid) == 0 && prefs.getBytes("ap", &cache, sizeof(cache)) == sizeof(cache) &&
+                      cache.channel > 0;
+        use_static = prefs.getBool("static", false);
+        prefs.end();
+    }
+
+    // Writes the AP and lease only when they differ from what is stored
+    void save() {
+        Cache now;
+        memset(&now, 0, sizeof(now)); // Padding too: compared and stored as bytes
+        memcpy(now.bssid, WiFi.BSSID(), sizeof(now.bssid));
+        now.channel = (uint8_t)WiFi.channel();
+        now.ip = (uint32_t)WiFi.localIP();
+        now.gw = (uint32_t)WiFi.gatewayIP();
+        now.mask = (uint32_t)WiFi.subnetMask();
+        now.dns = (uint32_t)WiFi.dnsIP();
+        if (cache_valid && memcmp(&now, &cache, sizeof(now)) == 0) return;
+
+        Preferences prefs;
+        prefs.begin(kNamespace, false);
+        prefs.putString("ssid", ssid);
+        prefs.putBytes("ap", &now, sizeof(now));
+        prefs.end();
+        cache = now;
+        cache_valid = true;
+    }
+};